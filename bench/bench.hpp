@@ -17,6 +17,8 @@
 #include <unordered_set>
 #include <map>
 
+#include "key_file.hpp"
+
 namespace bench {
 
 static const uint64_t kNumIntRecords = 100000000;
@@ -51,8 +53,46 @@ uint64_t stringToUint64(std::string str_key) {
     return __builtin_bswap64(int_key);
 }
 
+// Opens the binary key file written by gen_workload (length-prefixed,
+// see surf::KeyFile) and indexes at most max_keys keys. Returns false
+// if there is no such file.
+bool openKeyFile(const std::string& path, const uint64_t max_keys, surf::KeyFile& key_file) {
+    if (!key_file.open(path, surf::kKeysLengthPrefixed))
+	return false;
+    key_file.index(max_keys);
+    return true;
+}
+
+std::string keyAt(const surf::KeyFile& key_file, const uint64_t i) {
+    return std::string(key_file.keyData(i), key_file.keyLen(i));
+}
+
+// Byte-wise order of keys i and j, as std::string::compare
+bool keyLess(const surf::KeyFile& key_file, const uint64_t i, const uint64_t j) {
+    uint64_t len_i = key_file.keyLen(i);
+    uint64_t len_j = key_file.keyLen(j);
+    int cmp = memcmp(key_file.keyData(i), key_file.keyData(j), (len_i < len_j) ? len_i : len_j);
+    return (cmp < 0) || ((cmp == 0) && (len_i < len_j));
+}
+
+// Reads the file_name + ".bin" file written by gen_workload. Returns
+// false if there is no such file.
+bool loadKeysFromBinaryFile(const std::string& file_name, const uint64_t num_records,
+			    std::vector<std::string> &keys) {
+    surf::KeyFile key_file;
+    if (!openKeyFile(file_name + ".bin", num_records, key_file))
+	return false;
+    keys.reserve(keys.size() + key_file.numKeys());
+    for (uint64_t i = 0; i < key_file.numKeys(); i++)
+	keys.push_back(keyAt(key_file, i));
+    return true;
+}
+
+// Prefers the binary key file from gen_workload when there is one
 void loadKeysFromFile(const std::string& file_name, const bool is_key_int, 
 		      std::vector<std::string> &keys) {
+    if (loadKeysFromBinaryFile(file_name, is_key_int ? kNumIntRecords : kNumEmailRecords, keys))
+	return;
     std::ifstream infile(file_name);
     std::string key;
     uint64_t count = 0;
@@ -75,6 +115,16 @@ void loadKeysFromFile(const std::string& file_name, const bool is_key_int,
 
 void loadKeysFromFile(const std::string& file_name, uint64_t num_records,
 		      std::vector<uint64_t> &keys) {
+    surf::KeyFile key_file;
+    if (openKeyFile(file_name + ".bin", num_records, key_file)) {
+	keys.reserve(keys.size() + key_file.numKeys());
+	for (uint64_t i = 0; i < key_file.numKeys(); i++) {
+	    uint64_t int_key;
+	    memcpy(&int_key, key_file.keyData(i), 8);
+	    keys.push_back(__builtin_bswap64(int_key));
+	}
+	return;
+    }
     std::ifstream infile(file_name);
     uint64_t count = 0;
     while (count < num_records && infile.good()) {
@@ -98,6 +148,104 @@ void selectKeysToInsert(const unsigned percent,
     sort(insert_keys.begin(), insert_keys.end());
 }
 
+// A key of an indexed surf::KeyFile, with its first 8 bytes (big-endian,
+// zero-padded) as sort key
+struct KeyRef {
+    uint64_t prefix;
+    uint32_t id;
+    uint32_t len;
+};
+
+// LSD radix sort of KeyRef's by prefix, 16 bits per pass; stable, and
+// digits where all prefixes agree are skipped
+void radixSortByPrefix(std::vector<KeyRef>& refs) {
+    static const int kDigitBits = 16;
+    static const uint64_t kNumBuckets = (1 << kDigitBits);
+    std::vector<KeyRef> buf(refs.size());
+    std::vector<uint64_t> counts(kNumBuckets + 1);
+    for (int shift = 0; shift < 64; shift += kDigitBits) {
+	std::fill(counts.begin(), counts.end(), 0);
+	for (uint64_t i = 0; i < refs.size(); i++)
+	    counts[((refs[i].prefix >> shift) & (kNumBuckets - 1)) + 1]++;
+	bool single_bucket = false;
+	for (uint64_t b = 1; b <= kNumBuckets; b++)
+	    single_bucket = single_bucket || (counts[b] == refs.size());
+	if (single_bucket)
+	    continue;
+	for (uint64_t b = 1; b <= kNumBuckets; b++)
+	    counts[b] += counts[b - 1];
+	for (uint64_t i = 0; i < refs.size(); i++)
+	    buf[counts[(refs[i].prefix >> shift) & (kNumBuckets - 1)]++] = refs[i];
+	refs.swap(buf);
+    }
+}
+
+// Same as above, picking from a mapped key file without a string per
+// key: the keys are chosen in one pass (selection sampling), radix
+// sorted by their first 8 bytes and, where those tie, compared in
+// place; strings are built for the chosen keys only (keys of at most
+// 8 bytes, e.g., integer keys, straight from the sort key).
+void selectKeysToInsert(const unsigned percent,
+			std::vector<std::string> &insert_keys,
+			const surf::KeyFile& key_file) {
+    uint64_t num_keys = key_file.numKeys();
+    uint64_t num_insert_keys = num_keys * percent / 100;
+    std::vector<KeyRef> refs;
+    refs.reserve(num_insert_keys);
+    std::mt19937_64 rng(2018);
+    for (uint64_t i = 0; i < num_keys && refs.size() < num_insert_keys; i++) {
+	// pick key i with probability (keys still needed) / (keys left)
+	if (rng() % (num_keys - i) >= num_insert_keys - refs.size())
+	    continue;
+	KeyRef ref;
+	uint64_t prefix = 0;
+	ref.id = i;
+	ref.len = key_file.keyLen(i);
+	memcpy(&prefix, key_file.keyData(i), (ref.len < 8) ? ref.len : 8);
+	ref.prefix = __builtin_bswap64(prefix);
+	refs.push_back(ref);
+    }
+
+    radixSortByPrefix(refs);
+    uint64_t start = 0;
+    while (start < refs.size()) {
+	uint64_t end = start + 1;
+	while (end < refs.size() && refs[end].prefix == refs[start].prefix)
+	    end++;
+	if (end - start > 1)
+	    sort(refs.begin() + start, refs.begin() + end,
+		 [&key_file](const KeyRef& a, const KeyRef& b) {
+		     return keyLess(key_file, a.id, b.id);
+		 });
+	start = end;
+    }
+
+    insert_keys.reserve(insert_keys.size() + refs.size());
+    for (uint64_t i = 0; i < refs.size(); i++) {
+	if (refs[i].len <= 8) {
+	    uint64_t prefix = __builtin_bswap64(refs[i].prefix);
+	    insert_keys.push_back(std::string(reinterpret_cast<const char*>(&prefix), refs[i].len));
+	} else {
+	    insert_keys.push_back(keyAt(key_file, refs[i].id));
+	}
+    }
+}
+
+// Loads the load-phase keys of file_name and selects percent% of them
+// to insert, from the binary key file when there is one
+void loadKeysToInsert(const std::string& file_name, const bool is_key_int,
+		      const unsigned percent, std::vector<std::string> &insert_keys) {
+    surf::KeyFile key_file;
+    if (openKeyFile(file_name + ".bin", is_key_int ? kNumIntRecords : kNumEmailRecords,
+		    key_file)) {
+	selectKeysToInsert(percent, insert_keys, key_file);
+	return;
+    }
+    std::vector<std::string> load_keys;
+    loadKeysFromFile(file_name, is_key_int, load_keys);
+    selectKeysToInsert(percent, insert_keys, load_keys);
+}
+
 // 0 < percent <= 100
 void selectIntKeysToInsert(const unsigned percent, 
 			   std::vector<uint64_t> &insert_keys, 
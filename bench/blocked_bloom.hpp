@@ -0,0 +1,110 @@
+#ifndef BLOCKED_BLOOM_H_
+#define BLOCKED_BLOOM_H_
+
+#include <smmintrin.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "MurmurHash3.h"
+
+namespace bench {
+
+// Split block Bloom filter (as in Impala / Parquet): a key sets one bit
+// in each of the 8 32-bit words of a single 256-bit block, so a lookup
+// touches one cache line. The 8 bit positions come from multiplying the
+// key hash by 8 odd salts; the masks are built and tested with SSE4.1
+// (2 x 128 bits per block), which only these functions are compiled for.
+class BlockedBloomFilter {
+public:
+    static const uint32_t kBlockBits = 256;
+
+    BlockedBloomFilter(const std::vector<std::string>& keys, const uint32_t bits_per_key)
+	: blocks_(NULL), num_blocks_(0) {
+	uint64_t bits = (uint64_t)keys.size() * bits_per_key;
+	num_blocks_ = (bits + kBlockBits - 1) / kBlockBits;
+	if (num_blocks_ == 0)
+	    num_blocks_ = 1;
+	void* blocks = NULL;
+	if (posix_memalign(&blocks, 64, num_blocks_ * sizeof(Block)) != 0)
+	    exit(1);
+	blocks_ = reinterpret_cast<Block*>(blocks);
+	memset(blocks_, 0, num_blocks_ * sizeof(Block));
+	for (size_t i = 0; i < keys.size(); i++)
+	    insert(hash(keys[i]));
+    }
+
+    ~BlockedBloomFilter() {
+	free(blocks_);
+    }
+
+    __attribute__((target("sse4.1")))
+    bool lookup(const std::string& key) const {
+	uint64_t h = hash(key);
+	const Block& block = blocks_[blockIndex(h)];
+	__m128i mask_lo, mask_hi;
+	makeMask((uint32_t)h, mask_lo, mask_hi);
+	// testc: all bits of the mask set in the block
+	return _mm_testc_si128(_mm_load_si128(&block.words[0]), mask_lo)
+	    && _mm_testc_si128(_mm_load_si128(&block.words[1]), mask_hi);
+    }
+
+    uint64_t getMemoryUsage() const {
+	return num_blocks_ * sizeof(Block);
+    }
+
+private:
+    struct Block {
+	__m128i words[2];
+    };
+
+    static uint64_t hash(const std::string& key) {
+	uint64_t out[2];
+	MurmurHash3_x64_128(key.c_str(), key.size(), 0xbc9f1d34, out);
+	return out[0];
+    }
+
+    // high 32 bits pick the block (multiply-shift range reduction)
+    uint64_t blockIndex(const uint64_t h) const {
+	return ((h >> 32) * num_blocks_) >> 32;
+    }
+
+    // One bit per 32-bit word: the top 5 bits of h * salt[i]. SSE has
+    // no per-lane variable shift, so 1 << bit is made as the float
+    // 2^bit (bit placed in the exponent) converted back to an integer;
+    // 2^31 overflows to 0x80000000, which is 1 << 31 as well.
+    __attribute__((target("sse4.1")))
+    static void makeMask(const uint32_t h, __m128i& mask_lo, __m128i& mask_hi) {
+	const __m128i salt_lo = _mm_setr_epi32(0x47b6137bU, 0x44974d91U,
+					       0x8824ad5bU, 0xa2b7289dU);
+	const __m128i salt_hi = _mm_setr_epi32(0x705495c7U, 0x2df1424bU,
+					       0x9efc4947U, 0x5c6bfb31U);
+	const __m128i one = _mm_set1_epi32(0x3f800000); // 1.0f
+	__m128i key = _mm_set1_epi32(h);
+	__m128i bits_lo = _mm_srli_epi32(_mm_mullo_epi32(key, salt_lo), 27);
+	__m128i bits_hi = _mm_srli_epi32(_mm_mullo_epi32(key, salt_hi), 27);
+	mask_lo = _mm_cvttps_epi32(_mm_castsi128_ps(
+	    _mm_add_epi32(_mm_slli_epi32(bits_lo, 23), one)));
+	mask_hi = _mm_cvttps_epi32(_mm_castsi128_ps(
+	    _mm_add_epi32(_mm_slli_epi32(bits_hi, 23), one)));
+    }
+
+    __attribute__((target("sse4.1")))
+    void insert(const uint64_t h) {
+	Block& block = blocks_[blockIndex(h)];
+	__m128i mask_lo, mask_hi;
+	makeMask((uint32_t)h, mask_lo, mask_hi);
+	_mm_store_si128(&block.words[0], _mm_or_si128(_mm_load_si128(&block.words[0]), mask_lo));
+	_mm_store_si128(&block.words[1], _mm_or_si128(_mm_load_si128(&block.words[1]), mask_hi));
+    }
+
+    Block* blocks_;
+    uint64_t num_blocks_;
+};
+
+} // namespace bench
+
+#endif // BLOCKED_BLOOM_H_
@@ -0,0 +1,92 @@
+#ifndef CPU_TOPOLOGY_H_
+#define CPU_TOPOLOGY_H_
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "replicated_surf.hpp"
+
+namespace bench {
+
+// CPUs this process may run on and the NUMA node of each, read from
+// sysfs (no libnuma needed). Without NUMA information in sysfs all
+// CPUs are on node 0.
+class CpuTopology {
+public:
+    CpuTopology() {
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+	    return;
+
+	std::vector<int> node_ids = surf::numaNodeIds();
+	for (size_t n = 0; n < node_ids.size(); n++) {
+	    std::vector<int> node_cpus = surf::numaNodeCpuList(node_ids[n]);
+	    for (size_t i = 0; i < node_cpus.size(); i++)
+		if (node_cpus[i] < CPU_SETSIZE && CPU_ISSET(node_cpus[i], &allowed))
+		    addCpu(node_cpus[i], node_ids[n]);
+	}
+	if (cpus_.empty()) {
+	    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &allowed))
+		    addCpu(cpu, 0);
+	}
+    }
+
+    int numCpus() const {
+	return (int)cpus_.size();
+    }
+
+    int numNodes() const {
+	return (int)node_ids_.size();
+    }
+
+    // Compact order: all CPUs of the first node, then of the next one,
+    // so that a run with few threads stays on one node
+    int cpu(const int i) const {
+	return cpus_[i % cpus_.size()];
+    }
+
+    int node(const int i) const {
+	return nodes_[i % nodes_.size()];
+    }
+
+    // CPUs of node, in the same order
+    std::vector<int> nodeCpus(const int node) const {
+	std::vector<int> node_cpus;
+	for (size_t i = 0; i < cpus_.size(); i++)
+	    if (nodes_[i] == node)
+		node_cpus.push_back(cpus_[i]);
+	return node_cpus;
+    }
+
+private:
+    void addCpu(const int cpu, const int node) {
+	cpus_.push_back(cpu);
+	nodes_.push_back(node);
+	if (std::find(node_ids_.begin(), node_ids_.end(), node) == node_ids_.end())
+	    node_ids_.push_back(node);
+    }
+
+    std::vector<int> cpus_;
+    std::vector<int> nodes_;
+    // distinct nodes of cpus_ (node ids need not be contiguous)
+    std::vector<int> node_ids_;
+};
+
+// Pins the calling thread to cpu; returns false on failure
+inline bool pinThread(const int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0);
+}
+
+} // namespace bench
+
+#endif // CPU_TOPOLOGY_H_
@@ -8,6 +8,8 @@ namespace bench {
 
 class Filter {
 public:
+    virtual ~Filter() {}
+
     virtual bool lookup(const std::string& key) = 0;
     virtual bool lookupRange(const std::string& left_key, const std::string& right_key) = 0;
     virtual bool approxCount(const std::string& left_key, const std::string& right_key) = 0;
@@ -0,0 +1,40 @@
+#ifndef FILTER_BLOCKED_BLOOM_H_
+#define FILTER_BLOCKED_BLOOM_H_
+
+#include <string>
+#include <vector>
+
+#include "blocked_bloom.hpp"
+
+namespace bench {
+
+class FilterBlockedBloom : public Filter {
+public:
+    FilterBlockedBloom(const std::vector<std::string>& keys, const uint32_t bits_per_key)
+	: filter_(keys, bits_per_key) {}
+
+    bool lookup(const std::string& key) {
+	return filter_.lookup(key);
+    }
+
+    bool lookupRange(const std::string& left_key, const std::string& right_key) {
+	std::cout << kRed << "A Bloom filter does not support range queries\n" << kNoColor;
+	return false;
+    }
+
+    bool approxCount(const std::string& left_key, const std::string& right_key) {
+	std::cout << kRed << "A Bloom filter does not support approximate count queries\n" << kNoColor;
+	return false;
+    }
+
+    uint64_t getMemoryUsage() {
+	return filter_.getMemoryUsage();
+    }
+
+private:
+    BlockedBloomFilter filter_;
+};
+
+} // namespace bench
+
+#endif // FILTER_BLOCKED_BLOOM_H
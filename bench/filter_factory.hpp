@@ -2,8 +2,10 @@
 #define FILTER_FACTORY_H_
 
 #include "filter.hpp"
+#include "filter_blocked_bloom.hpp"
 #include "filter_bloom.hpp"
 #include "filter_surf.hpp"
+#include "filter_xor.hpp"
 
 namespace bench {
 
@@ -20,8 +22,31 @@ public:
 	    return new FilterSuRF(keys, surf::kReal, 0, suffix_len);
         else if (filter_type.compare(std::string("SuRFMixed")) == 0)
 	    return new FilterSuRF(keys, surf::kMixed, suffix_len, suffix_len);
+	// same as above, with Elias-Fano encoded LOUDS-Sparse node boundaries
+	else if (filter_type.compare(std::string("SuRFEF")) == 0)
+	    return new FilterSuRF(keys, surf::kNone, 0, 0, surf::kLoudsEliasFano);
+	else if (filter_type.compare(std::string("SuRFHashEF")) == 0)
+	    return new FilterSuRF(keys, surf::kHash, suffix_len, 0, surf::kLoudsEliasFano);
+	else if (filter_type.compare(std::string("SuRFRealEF")) == 0)
+	    return new FilterSuRF(keys, surf::kReal, 0, suffix_len, surf::kLoudsEliasFano);
+	else if (filter_type.compare(std::string("SuRFMixedEF")) == 0)
+	    return new FilterSuRF(keys, surf::kMixed, suffix_len, suffix_len, surf::kLoudsEliasFano);
+	// SuRFHash with the CRC32C / 64-bit multiply suffix hash
+	else if (filter_type.compare(std::string("SuRFHashCRC")) == 0)
+	    return new FilterSuRF(keys, surf::kHash, suffix_len, 0,
+				  surf::kLoudsBitvector, surf::kHashCRC32C);
+	else if (filter_type.compare(std::string("SuRFHashMul")) == 0)
+	    return new FilterSuRF(keys, surf::kHash, suffix_len, 0,
+				  surf::kLoudsBitvector, surf::kHashMultiply);
 	else if (filter_type.compare(std::string("Bloom")) == 0)
 	    return new FilterBloom(keys);
+	// point-query baselines; suffix_len is the bits per key of BlockedBloom
+	else if (filter_type.compare(std::string("BlockedBloom")) == 0)
+	    return new FilterBlockedBloom(keys, suffix_len);
+	else if (filter_type.compare(std::string("Xor8")) == 0)
+	    return new FilterXor<uint8_t>(keys);
+	else if (filter_type.compare(std::string("Xor16")) == 0)
+	    return new FilterXor<uint16_t>(keys);
 	else
 	    return new FilterSuRF(keys, surf::kReal, 0, suffix_len); // default
     }
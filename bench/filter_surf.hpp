@@ -13,15 +13,33 @@ public:
     // Requires that keys are sorted
     FilterSuRF(const std::vector<std::string>& keys,
 	       const surf::SuffixType suffix_type,
-               const uint32_t hash_suffix_len, const uint32_t real_suffix_len) {
+               const uint32_t hash_suffix_len, const uint32_t real_suffix_len,
+	       const surf::LoudsEncoding louds_encoding = surf::kLoudsBitvector,
+	       const surf::SuffixHashType hash_type = surf::kHashLevelDB) {
 	// uses default sparse-dense size ratio
-	filter_ = new surf::SuRF(keys, surf::kIncludeDense, surf::kSparseDenseRatio,
-				 suffix_type, hash_suffix_len, real_suffix_len);
+	owned_filter_ = new surf::SuRF(keys, surf::kIncludeDense, surf::kSparseDenseRatio,
+				       suffix_type, hash_suffix_len, real_suffix_len,
+				       louds_encoding, hash_type);
+	filter_ = owned_filter_;
+	iter_ = surf::SuRF::Iter(filter_);
+	iter2_ = surf::SuRF::Iter(filter_);
     }
 
+    // A view of filter that is not owned: each thread of a multi-thread
+    // run queries the shared SuRF through its own view, whose range
+    // query iterators are private to that thread
+    FilterSuRF(const surf::SuRF* filter) : filter_(filter), owned_filter_(NULL),
+					   iter_(filter), iter2_(filter) {}
+
     ~FilterSuRF() {
-	filter_->destroy();
-	delete filter_;
+	if (owned_filter_ == NULL)
+	    return;
+	owned_filter_->destroy();
+	delete owned_filter_;
+    }
+
+    const surf::SuRF* getSuRF() {
+	return filter_;
     }
 
     bool lookup(const std::string& key) {
@@ -30,11 +48,11 @@ public:
 
     bool lookupRange(const std::string& left_key, const std::string& right_key) {
 	//return filter_->lookupRange(left_key, false, right_key, false);
-	return filter_->lookupRange(left_key, true, right_key, true);
+	return filter_->lookupRange(left_key, true, right_key, true, iter_);
     }
 
     bool approxCount(const std::string& left_key, const std::string& right_key) {
-	return filter_->approxCount(left_key, right_key);
+	return filter_->approxCount(left_key, right_key, iter_, iter2_);
     }
 
     uint64_t getMemoryUsage() {
@@ -42,7 +60,10 @@ public:
     }
 
 private:
-    surf::SuRF* filter_;
+    const surf::SuRF* filter_;
+    surf::SuRF* owned_filter_; // NULL for a view
+    surf::SuRF::Iter iter_;
+    surf::SuRF::Iter iter2_;
 };
 
 } // namespace bench
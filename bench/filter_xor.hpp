@@ -0,0 +1,40 @@
+#ifndef FILTER_XOR_H_
+#define FILTER_XOR_H_
+
+#include <string>
+#include <vector>
+
+#include "xor_filter.hpp"
+
+namespace bench {
+
+template <typename FingerprintT>
+class FilterXor : public Filter {
+public:
+    FilterXor(const std::vector<std::string>& keys) : filter_(keys) {}
+
+    bool lookup(const std::string& key) {
+	return filter_.lookup(key);
+    }
+
+    bool lookupRange(const std::string& left_key, const std::string& right_key) {
+	std::cout << kRed << "A xor filter does not support range queries\n" << kNoColor;
+	return false;
+    }
+
+    bool approxCount(const std::string& left_key, const std::string& right_key) {
+	std::cout << kRed << "A xor filter does not support approximate count queries\n" << kNoColor;
+	return false;
+    }
+
+    uint64_t getMemoryUsage() {
+	return filter_.getMemoryUsage();
+    }
+
+private:
+    XorFilter<FingerprintT> filter_;
+};
+
+} // namespace bench
+
+#endif // FILTER_XOR_H
@@ -0,0 +1,118 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// Every kLatencySampleInterval-th query is timed. The interval is odd,
+// so that in the mix workload (even: point, odd: range) both kinds of
+// queries are sampled.
+static const int kLatencySampleInterval = 17;
+
+inline uint64_t getNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Latency histogram in the style of HdrHistogram: values below
+// kSubBucketCount are counted exactly; above that, every power-of-two
+// range [2^k, 2^(k+1)) is split into kSubBucketCount equal buckets,
+// which keeps the relative error of a reported value under 1%.
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 7;
+    static const uint64_t kSubBucketCount = (1 << kSubBucketBits);
+
+    LatencyHistogram() : counts_((64 - kSubBucketBits + 1) * kSubBucketCount, 0),
+			 count_(0), max_(0) {};
+
+    void record(const uint64_t value) {
+	counts_[index(value)]++;
+	count_++;
+	if (value > max_)
+	    max_ = value;
+    }
+
+    void merge(const LatencyHistogram& other) {
+	for (uint64_t i = 0; i < counts_.size(); i++)
+	    counts_[i] += other.counts_[i];
+	count_ += other.count_;
+	if (other.max_ > max_)
+	    max_ = other.max_;
+    }
+
+    // Highest value of the bucket holding the p-th percentile (0 < p <= 100)
+    uint64_t percentile(const double p) const {
+	uint64_t target = (uint64_t)(count_ * p / 100.0 + 0.5);
+	if (target == 0)
+	    target = 1;
+	uint64_t seen = 0;
+	for (uint64_t i = 0; i < counts_.size(); i++) {
+	    seen += counts_[i];
+	    if (seen >= target) {
+		uint64_t value = highestValue(i);
+		return (value < max_) ? value : max_;
+	    }
+	}
+	return max_;
+    }
+
+    uint64_t count() const {
+	return count_;
+    }
+
+    uint64_t max() const {
+	return max_;
+    }
+
+    void print(const std::string& name) const {
+	if (count_ == 0)
+	    return;
+	printf("%s latency (ns, %lu samples): p50 = %lu, p90 = %lu, p99 = %lu, p99.9 = %lu, max = %lu\n",
+	       name.c_str(), count_, percentile(50), percentile(90), percentile(99),
+	       percentile(99.9), max_);
+    }
+
+private:
+    static uint64_t index(const uint64_t value) {
+	if (value < kSubBucketCount)
+	    return value;
+	int shift = (63 - __builtin_clzll(value)) - kSubBucketBits;
+	return (shift + 1) * kSubBucketCount + ((value >> shift) - kSubBucketCount);
+    }
+
+    static uint64_t highestValue(const uint64_t idx) {
+	if (idx < kSubBucketCount)
+	    return idx;
+	int shift = idx / kSubBucketCount - 1;
+	uint64_t sub_bucket = idx % kSubBucketCount + kSubBucketCount;
+	return ((sub_bucket + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t max_;
+};
+
+// Runs query, timing it into latency if i is a sampled query index
+template <typename Query>
+inline void timeQuery(const int i, LatencyHistogram& latency, Query query) {
+    if (i % kLatencySampleInterval != 0) {
+	query();
+	return;
+    }
+    uint64_t start = getNowNs();
+    query();
+    latency.record(getNowNs() - start);
+}
+
+} // namespace bench
+
+#endif // LATENCY_H_
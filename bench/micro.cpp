@@ -0,0 +1,230 @@
+#include "bench.hpp"
+#include "surf.hpp"
+
+// Micro benchmarks for the building blocks of SuRF. Every operation is
+// timed over kNumOps calls, with sequential or random arguments, and
+// warm (arguments confined to a small window that is touched once
+// before timing) or cold (arguments over the whole structure, caches
+// flushed before timing).
+
+namespace micro {
+
+using namespace surf;
+
+static const uint64_t kNumOps = 2000000;
+static const position_t kWarmWindow = 4096;
+static const uint64_t kFlushSize = (256 << 20);
+
+static uint64_t sink = 0;
+
+void flushCaches() {
+    static std::vector<char> buf(kFlushSize);
+    for (uint64_t i = 0; i < kFlushSize; i += 64)
+	buf[i]++;
+    sink += buf[sink % kFlushSize];
+}
+
+// kNumOps arguments in [0, n)
+std::vector<position_t> makeArgs(const position_t n, const bool random, const bool cold,
+				 std::mt19937_64& rng) {
+    position_t range = n;
+    if (!cold && (range > kWarmWindow))
+	range = kWarmWindow;
+    std::vector<position_t> args(kNumOps);
+    for (uint64_t i = 0; i < kNumOps; i++)
+	args[i] = random ? (rng() % range) : (i % range);
+    return args;
+}
+
+template <typename Op>
+void run(const std::string& name, const position_t n, Op op, std::mt19937_64& rng) {
+    for (int r = 0; r < 2; r++) {
+	for (int c = 0; c < 2; c++) {
+	    bool random = (r == 1);
+	    bool cold = (c == 1);
+	    std::vector<position_t> args = makeArgs(n, random, cold, rng);
+	    uint64_t sum = 0;
+	    if (cold) {
+		flushCaches();
+	    } else {
+		for (uint64_t i = 0; i < kNumOps; i++)
+		    sum += op(args[i]);
+	    }
+	    double start_time = bench::getNow();
+	    for (uint64_t i = 0; i < kNumOps; i++)
+		sum += op(args[i]);
+	    double end_time = bench::getNow();
+	    sink += sum;
+	    printf("%-28s %-10s %-4s %8.2f ns/op\n", name.c_str(),
+		   random ? "random" : "sequential", cold ? "cold" : "warm",
+		   (end_time - start_time) * 1e9 / kNumOps);
+	}
+    }
+}
+
+// Iterators only step sequentially; warm reruns the first kWarmWindow
+// keys, cold walks the whole filter.
+void runIter(const std::string& name, const SuRF& surf, const bool forward) {
+    for (int c = 0; c < 2; c++) {
+	bool cold = (c == 1);
+	SuRF::Iter iter = forward ? surf.moveToFirst() : surf.moveToLast();
+	uint64_t steps = 0;
+	if (cold)
+	    flushCaches();
+	double start_time = bench::getNow();
+	for (uint64_t i = 0; i < kNumOps; i++) {
+	    bool valid = forward ? iter++ : iter--;
+	    steps++;
+	    if (!valid || (!cold && (steps == kWarmWindow))) {
+		iter = forward ? surf.moveToFirst() : surf.moveToLast();
+		steps = 0;
+	    }
+	}
+	double end_time = bench::getNow();
+	sink += steps;
+	printf("%-28s %-10s %-4s %8.2f ns/op\n", name.c_str(), "sequential",
+	       cold ? "cold" : "warm", (end_time - start_time) * 1e9 / kNumOps);
+    }
+}
+
+} // namespace micro
+
+int main(int argc, char *argv[]) {
+    using namespace surf;
+    if (argc > 2) {
+	std::cout << "Usage:\n";
+	std::cout << "1. number of random 64-bit keys (optional, default 10000000)\n";
+	return -1;
+    }
+    uint64_t num_keys = 10000000;
+    if (argc == 2)
+	num_keys = strtoull(argv[1], nullptr, 10);
+    if (num_keys == 0) {
+	std::cout << bench::kRed << "WRONG number of keys\n" << bench::kNoColor;
+	return -1;
+    }
+
+    std::mt19937_64 rng(2017);
+    std::vector<uint64_t> int_keys(num_keys);
+    for (uint64_t i = 0; i < num_keys; i++)
+	int_keys[i] = rng();
+    std::sort(int_keys.begin(), int_keys.end());
+    std::vector<std::string> keys;
+    for (uint64_t i = 0; i < num_keys; i++)
+	keys.push_back(uint64ToString(int_keys[i]));
+    std::vector<uint64_t>().swap(int_keys);
+
+    // all-sparse trie, so that the vectors cover every level
+    SuRFBuilder builder(false, 0, kReal, 0, 8);
+    builder.build(keys);
+    std::vector<position_t> num_items_per_level;
+    std::vector<position_t> num_suffix_bits_per_level;
+    for (level_t level = 0; level < builder.getTreeHeight(); level++) {
+	num_items_per_level.push_back(builder.getLabels()[level].size());
+	num_suffix_bits_per_level.push_back(builder.getSuffixCounts()[level] * 8);
+    }
+    BitvectorRank rank_bv(kRankBasicBlockSize, builder.getChildIndicatorBits(),
+			  num_items_per_level);
+    BitvectorSelect select_bv(kSelectSampleInterval, builder.getLoudsBits(),
+			      num_items_per_level);
+    LabelVector labels(builder.getLabels());
+    BitvectorSuffix suffixes(kReal, 0, 8, builder.getSuffixes(), num_suffix_bits_per_level);
+    SuRF filter(keys, kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+
+    std::cout << bench::kGreen << num_keys << " keys, " << rank_bv.numBits() << " items, "
+	      << select_bv.numOnes() << " nodes" << bench::kNoColor << "\n";
+
+    micro::run("rank", rank_bv.numBits(), [&](const position_t pos) {
+	return rank_bv.rank(pos);
+    }, rng);
+    micro::run("select", select_bv.numOnes(), [&](const position_t rank) {
+	return select_bv.select(rank + 1);
+    }, rng);
+    micro::run("distanceToNextSetBit", select_bv.numBits() - 1, [&](const position_t pos) {
+	return select_bv.distanceToNextSetBit(pos);
+    }, rng);
+
+    // LabelVector::search switches between linear, binary and SIMD search
+    // by node size; time each bucket on labels present in the node
+    const int kNumBuckets = 4;
+    const position_t bucket_limits[kNumBuckets] = {3, 12, 64, kFanout + 1};
+    const char* bucket_names[kNumBuckets] = {"search size 1-2", "search size 3-11",
+					     "search size 12-63", "search size 64-256"};
+    std::vector<position_t> node_starts[kNumBuckets];
+    std::vector<position_t> node_sizes[kNumBuckets];
+    for (position_t node = 0; node < select_bv.numOnes(); node++) {
+	position_t start = select_bv.select(node + 1);
+	position_t size = (start == select_bv.numBits() - 1)
+	    ? 1 : select_bv.distanceToNextSetBit(start);
+	int b = 0;
+	while (size >= bucket_limits[b])
+	    b++;
+	node_starts[b].push_back(start);
+	node_sizes[b].push_back(size);
+    }
+    for (int b = 0; b < kNumBuckets; b++) {
+	if (node_starts[b].empty())
+	    continue;
+	micro::run(bucket_names[b], node_starts[b].size(), [&](const position_t i) {
+	    position_t pos = node_starts[b][i];
+	    position_t size = node_sizes[b][i];
+	    label_t target = labels[pos + (i % size)];
+	    return (position_t)labels.search(target, pos, size) + pos;
+	}, rng);
+    }
+
+    position_t num_suffixes = suffixes.numBits() / 8;
+    micro::run("suffix read", num_suffixes, [&](const position_t idx) {
+	return suffixes.read(idx);
+    }, rng);
+    micro::run("suffix checkEquality", num_suffixes, [&](const position_t idx) {
+	return (position_t)suffixes.checkEquality(idx, keys[idx % keys.size()], 3);
+    }, rng);
+
+    // key -> ordinal next to the plain lookup it extends
+    micro::run("lookupKey", num_keys, [&](const position_t i) {
+	return (position_t)filter.lookupKey(keys[i]);
+    }, rng);
+    micro::run("leafId", num_keys, [&](const position_t i) {
+	uint64_t id = 0;
+	filter.leafId(keys[i], id);
+	return (position_t)id;
+    }, rng);
+
+    micro::runIter("iter ++", filter, true);
+    micro::runIter("iter --", filter, false);
+
+    // equi-width histogram over the key space: one approxCounts call
+    // vs. an approxCount call per interval
+    const uint64_t kNumIntervals = 1000;
+    std::vector<std::string> boundaries;
+    for (uint64_t i = 0; i <= kNumIntervals; i++)
+	boundaries.push_back(uint64ToString((UINT64_MAX / kNumIntervals) * i));
+    std::vector<uint64_t> counts;
+    double start_time = bench::getNow();
+    filter.approxCounts(boundaries, counts);
+    double end_time = bench::getNow();
+    for (uint64_t i = 0; i < kNumIntervals; i++)
+	micro::sink += counts[i];
+    printf("%-28s %-10s %-4s %8.2f ns/op\n", "approxCounts", "sequential", "warm",
+	   (end_time - start_time) * 1e9 / kNumIntervals);
+    start_time = bench::getNow();
+    for (uint64_t i = 0; i < kNumIntervals; i++)
+	micro::sink += filter.approxCount(boundaries[i], boundaries[i + 1]);
+    end_time = bench::getNow();
+    printf("%-28s %-10s %-4s %8.2f ns/op\n", "approxCount per interval", "sequential", "warm",
+	   (end_time - start_time) * 1e9 / kNumIntervals);
+
+    // equi-depth split keys, one trie descent each
+    std::vector<std::string> split_keys;
+    start_time = bench::getNow();
+    filter.quantiles(kNumIntervals, split_keys);
+    end_time = bench::getNow();
+    for (size_t i = 0; i < split_keys.size(); i++)
+	micro::sink += split_keys[i].size();
+    printf("%-28s %-10s %-4s %8.2f ns/op\n", "quantiles", "sequential", "warm",
+	   (end_time - start_time) * 1e9 / kNumIntervals);
+
+    std::cout << "(checksum " << micro::sink << ")\n";
+    return 0;
+}
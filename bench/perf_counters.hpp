@@ -0,0 +1,135 @@
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace bench {
+
+// Hardware counters of the calling thread (user space only) through
+// perf_event_open. Each event is opened on its own, so an event the
+// CPU or kernel does not support (or perf_event_paranoid forbids) is
+// reported as unavailable without losing the others. Counts are scaled
+// by enabled / running time when the kernel multiplexes the events.
+class PerfCounters {
+public:
+    enum Event {
+	kCycles = 0,
+	kInstructions,
+	kLLCMisses,
+	kDTLBMisses,
+	kBranchMisses,
+	kNumEvents
+    };
+
+    PerfCounters() {
+	for (int i = 0; i < kNumEvents; i++) {
+	    fds_[i] = -1;
+	    values_[i] = 0;
+	}
+    }
+
+    ~PerfCounters() {
+	for (int i = 0; i < kNumEvents; i++)
+	    if (fds_[i] >= 0)
+		close(fds_[i]);
+    }
+
+    // Returns false if no event could be opened
+    bool open() {
+	bool opened = false;
+	for (int i = 0; i < kNumEvents; i++) {
+	    struct perf_event_attr attr;
+	    memset(&attr, 0, sizeof(attr));
+	    attr.size = sizeof(attr);
+	    setEvent(i, attr);
+	    attr.disabled = 1;
+	    attr.exclude_kernel = 1;
+	    attr.exclude_hv = 1;
+	    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	    fds_[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	    opened = opened || (fds_[i] >= 0);
+	}
+	return opened;
+    }
+
+    void start() {
+	for (int i = 0; i < kNumEvents; i++) {
+	    if (fds_[i] < 0)
+		continue;
+	    ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+
+    void stop() {
+	for (int i = 0; i < kNumEvents; i++) {
+	    if (fds_[i] < 0)
+		continue;
+	    ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+	    uint64_t buf[3]; // value, time enabled, time running
+	    if (read(fds_[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) {
+		values_[i] = 0;
+		continue;
+	    }
+	    values_[i] = (double)buf[0] * buf[1] / buf[2];
+	}
+    }
+
+    // Prints each available counter divided by num_ops
+    void print(const uint64_t num_ops) const {
+	static const char* kNames[kNumEvents] = {"cycles", "instructions", "LLC misses",
+						 "dTLB misses", "branch misses"};
+	if (num_ops == 0)
+	    return;
+	for (int i = 0; i < kNumEvents; i++) {
+	    if (fds_[i] < 0)
+		printf("%s/op = n/a\n", kNames[i]);
+	    else
+		printf("%s/op = %.2f\n", kNames[i], values_[i] / num_ops);
+	}
+	if (fds_[kCycles] >= 0 && fds_[kInstructions] >= 0 && values_[kCycles] > 0)
+	    printf("IPC = %.2f\n", values_[kInstructions] / values_[kCycles]);
+    }
+
+private:
+    static void setEvent(const int event, struct perf_event_attr& attr) {
+	static const uint64_t kReadMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8)
+	    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	switch (event) {
+	case kCycles:
+	    attr.type = PERF_TYPE_HARDWARE;
+	    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	    break;
+	case kInstructions:
+	    attr.type = PERF_TYPE_HARDWARE;
+	    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	    break;
+	case kLLCMisses:
+	    attr.type = PERF_TYPE_HW_CACHE;
+	    attr.config = PERF_COUNT_HW_CACHE_LL | kReadMiss;
+	    break;
+	case kDTLBMisses:
+	    attr.type = PERF_TYPE_HW_CACHE;
+	    attr.config = PERF_COUNT_HW_CACHE_DTLB | kReadMiss;
+	    break;
+	default:
+	    attr.type = PERF_TYPE_HARDWARE;
+	    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+	}
+    }
+
+    int fds_[kNumEvents];
+    double values_[kNumEvents];
+};
+
+} // namespace bench
+
+#endif // PERF_COUNTERS_H_
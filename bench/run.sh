@@ -9,6 +9,12 @@ echo 'SuRF, random int, point queries'
 echo 'SuRFHash, 4-bit suffixes, random int, point queries'
 ../build/bench/workload SuRFHash 4 mixed 50 0 randint point zipfian
 
+echo 'SuRFHashCRC, 4-bit CRC32C suffixes, random int, point queries'
+../build/bench/workload SuRFHashCRC 4 mixed 50 0 randint point zipfian
+
+echo 'SuRFHashMul, 4-bit multiply-hash suffixes, random int, point queries'
+../build/bench/workload SuRFHashMul 4 mixed 50 0 randint point zipfian
+
 echo 'SuRFReal, 4-bit suffixes, random int, point queries'
 ../build/bench/workload SuRFReal 4 mixed 50 0 randint point zipfian
 
@@ -35,6 +41,14 @@ echo 'SuRFMixed, 2-bit hash suffixes and 2-bit real suffixes, random int, point
 echo 'SuRFReal, 4-bit suffixes, random int, range queries'
 ../build/bench/workload SuRFReal 4 mixed 50 0 randint range zipfian
 
+# Elias-Fano vs plain-bitvector louds bits: compare Throughput and Memory
+# with the SuRFReal runs above
+echo 'SuRFRealEF, 4-bit suffixes, random int, point queries'
+../build/bench/workload SuRFRealEF 4 mixed 50 0 randint point zipfian
+
+echo 'SuRFRealEF, 4-bit suffixes, random int, range queries'
+../build/bench/workload SuRFRealEF 4 mixed 50 0 randint range zipfian
+
 # echo 'SuRFReal, 4-bit suffixes, email, point queries'
 # ../build/bench/workload SuRFReal 4 mixed 50 0 email range zipfian
 
@@ -1,11 +1,16 @@
 #include "bench.hpp"
 #include "filter_factory.hpp"
+#include "latency.hpp"
+#include "perf_counters.hpp"
 
 int main(int argc, char *argv[]) {
     if (argc != 9) {
 	std::cout << "Usage:\n";
-	std::cout << "1. filter type: SuRF, SuRFHash, SuRFReal, SuRFMixed, Bloom\n";
-	std::cout << "2. suffix length: 0 < len <= 64 (for SuRFHash and SuRFReal only)\n";
+	std::cout << "1. filter type: SuRF, SuRFHash, SuRFReal, SuRFMixed, Bloom, BlockedBloom, Xor8, Xor16\n";
+	std::cout << "   (SuRF types with suffix EF, e.g. SuRFRealEF, use Elias-Fano louds bits)\n";
+	std::cout << "   (SuRFHashCRC, SuRFHashMul: SuRFHash with CRC32C / multiply hash)\n";
+	std::cout << "2. suffix length: 0 < len <= 64 (for SuRFHash and SuRFReal only;\n"
+		  << "   bits per key for BlockedBloom)\n";
 	std::cout << "3. workload type: mixed, alterByte (only for email key)\n";
 	std::cout << "4. percentage of keys inserted: 0 < num <= 100\n";
 	std::cout << "5. byte position (conting from last, only for alterByte): num\n";
@@ -29,7 +34,16 @@ int main(int argc, char *argv[]) {
 	&& filter_type.compare(std::string("SuRFHash")) != 0
 	&& filter_type.compare(std::string("SuRFReal")) != 0
 	&& filter_type.compare(std::string("SuRFMixed")) != 0
+	&& filter_type.compare(std::string("SuRFEF")) != 0
+	&& filter_type.compare(std::string("SuRFHashEF")) != 0
+	&& filter_type.compare(std::string("SuRFRealEF")) != 0
+	&& filter_type.compare(std::string("SuRFHashCRC")) != 0
+	&& filter_type.compare(std::string("SuRFHashMul")) != 0
+	&& filter_type.compare(std::string("SuRFMixedEF")) != 0
 	&& filter_type.compare(std::string("Bloom")) != 0
+	&& filter_type.compare(std::string("BlockedBloom")) != 0
+	&& filter_type.compare(std::string("Xor8")) != 0
+	&& filter_type.compare(std::string("Xor16")) != 0
 	&& filter_type.compare(std::string("ARF")) != 0) {
 	std::cout << bench::kRed << "WRONG filter type\n" << bench::kNoColor;
 	return -1;
@@ -77,11 +91,9 @@ int main(int argc, char *argv[]) {
     // load keys from files =======================================
     std::string load_file = "workloads/load_";
     load_file += key_type;
-    std::vector<std::string> load_keys;
-    if (key_type.compare(std::string("email")) == 0)
-	bench::loadKeysFromFile(load_file, false, load_keys);
-    else
-	bench::loadKeysFromFile(load_file, true, load_keys);
+    std::vector<std::string> insert_keys;
+    bench::loadKeysToInsert(load_file, key_type.compare(std::string("email")) != 0,
+			    percent, insert_keys);
 
     std::string txn_file = "workloads/txn_";
     txn_file += key_type;
@@ -93,9 +105,6 @@ int main(int argc, char *argv[]) {
     else
 	bench::loadKeysFromFile(txn_file, true, txn_keys);
 
-    std::vector<std::string> insert_keys;
-    bench::selectKeysToInsert(percent, insert_keys, load_keys);
-
     if (workload_type.compare(std::string("alterByte")) == 0)
 	bench::modifyKeyByte(txn_keys, byte_pos);
 
@@ -122,25 +131,32 @@ int main(int argc, char *argv[]) {
     // execute transactions =======================================
     int64_t positives = 0;
     uint64_t count = 0;
+    bench::LatencyHistogram point_latency, range_latency, count_latency;
+    // set BENCH_PERF_COUNTERS=1 to count hardware events over the queries
+    bench::PerfCounters perf_counters;
+    bool use_perf_counters = (getenv("BENCH_PERF_COUNTERS") != NULL);
+    if (use_perf_counters && !perf_counters.open()) {
+	std::cout << bench::kRed << "perf counters not available\n" << bench::kNoColor;
+	use_perf_counters = false;
+    }
+#ifdef SURF_STATS
+    surf::resetQueryStats();
+#endif
+#ifdef SURF_TRACE
+    surf::resetPhaseTrace();
+#endif
+    if (use_perf_counters)
+	perf_counters.start();
     double start_time = bench::getNow();
 
     if (query_type.compare(std::string("point")) == 0) {
 	for (int i = 0; i < (int)txn_keys.size(); i++)
-	    positives += (int)filter->lookup(txn_keys[i]);
+	    bench::timeQuery(i, point_latency, [&] {
+		positives += (int)filter->lookup(txn_keys[i]);
+	    });
     } else if (query_type.compare(std::string("range")) == 0) {
 	for (int i = 0; i < (int)txn_keys.size(); i++)
-	    if (key_type.compare(std::string("email")) == 0) {
-		std::string ret_str = txn_keys[i];
-		ret_str[ret_str.size() - 1] += (char)bench::kEmailRangeSize;
-		positives += (int)filter->lookupRange(txn_keys[i], ret_str);
-	    } else {
-		positives += (int)filter->lookupRange(txn_keys[i], bench::uint64ToString(bench::stringToUint64(txn_keys[i]) + bench::kIntRangeSize));
-	    }
-    } else if (query_type.compare(std::string("mix")) == 0) {
-	for (int i = 0; i < (int)txn_keys.size(); i++) {
-	    if (i % 2 == 0) {
-		positives += (int)filter->lookup(txn_keys[i]);
-	    } else {
+	    bench::timeQuery(i, range_latency, [&] {
 		if (key_type.compare(std::string("email")) == 0) {
 		    std::string ret_str = txn_keys[i];
 		    ret_str[ret_str.size() - 1] += (char)bench::kEmailRangeSize;
@@ -148,23 +164,46 @@ int main(int argc, char *argv[]) {
 		} else {
 		    positives += (int)filter->lookupRange(txn_keys[i], bench::uint64ToString(bench::stringToUint64(txn_keys[i]) + bench::kIntRangeSize));
 		}
+	    });
+    } else if (query_type.compare(std::string("mix")) == 0) {
+	for (int i = 0; i < (int)txn_keys.size(); i++) {
+	    if (i % 2 == 0) {
+		bench::timeQuery(i, point_latency, [&] {
+		    positives += (int)filter->lookup(txn_keys[i]);
+		});
+	    } else {
+		bench::timeQuery(i, range_latency, [&] {
+		    if (key_type.compare(std::string("email")) == 0) {
+			std::string ret_str = txn_keys[i];
+			ret_str[ret_str.size() - 1] += (char)bench::kEmailRangeSize;
+			positives += (int)filter->lookupRange(txn_keys[i], ret_str);
+		    } else {
+			positives += (int)filter->lookupRange(txn_keys[i], bench::uint64ToString(bench::stringToUint64(txn_keys[i]) + bench::kIntRangeSize));
+		    }
+		});
 	    }
 	}
     } else if (query_type.compare(std::string("count-long")) == 0) {
 	for (int i = 0; i < (int)txn_keys.size() - 1; i++)
-	    count += filter->approxCount(left_keys[i], right_keys[i]);
+	    bench::timeQuery(i, count_latency, [&] {
+		count += filter->approxCount(left_keys[i], right_keys[i]);
+	    });
     } else if (query_type.compare(std::string("count-short")) == 0) {
 	for (int i = 0; i < (int)txn_keys.size(); i++)
-	    if (key_type.compare(std::string("email")) == 0) {
-		std::string ret_str = txn_keys[i];
-		ret_str[ret_str.size() - 1] += (char)bench::kEmailRangeSize;
-		count += filter->approxCount(txn_keys[i], ret_str);
-	    } else {
-		count += filter->approxCount(txn_keys[i], bench::uint64ToString(bench::stringToUint64(txn_keys[i]) + bench::kIntRangeSize));
-	    }
+	    bench::timeQuery(i, count_latency, [&] {
+		if (key_type.compare(std::string("email")) == 0) {
+		    std::string ret_str = txn_keys[i];
+		    ret_str[ret_str.size() - 1] += (char)bench::kEmailRangeSize;
+		    count += filter->approxCount(txn_keys[i], ret_str);
+		} else {
+		    count += filter->approxCount(txn_keys[i], bench::uint64ToString(bench::stringToUint64(txn_keys[i]) + bench::kIntRangeSize));
+		}
+	    });
     }
 
     double end_time = bench::getNow();
+    if (use_perf_counters)
+	perf_counters.stop();
 
     // compute true positives ======================================
     std::map<std::string, bool> ht;
@@ -219,6 +258,17 @@ int main(int argc, char *argv[]) {
     // print
     double tput = txn_keys.size() / (end_time - start_time) / 1000000; // Mops/sec
     std::cout << bench::kGreen << "Throughput = " << bench::kNoColor << tput << "\n";
+    point_latency.print("Point");
+    range_latency.print("Range");
+    count_latency.print("Count");
+    if (use_perf_counters)
+	perf_counters.print(txn_keys.size());
+#ifdef SURF_STATS
+    surf::getQueryStats().print();
+#endif
+#ifdef SURF_TRACE
+    surf::getPhaseTrace().print();
+#endif
 
     std::cout << "positives = " << positives << "\n";
     std::cout << "true positives = " << true_positives << "\n";
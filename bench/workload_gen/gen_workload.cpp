@@ -0,0 +1,217 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Generates the load and transaction key sets of the benchmarks without
+// YCSB. As in YCSB, record i has key id hash(i); transactions read
+// record ids drawn from the request distribution (zipfian ids are
+// scrambled with the same hash, latest favors the last records).
+// The keys are written as a uint32_t length (host byte order) followed
+// by the key bytes, the format of bench::loadKeysFromBinaryFile and of
+// surf::KeyFile (kKeysLengthPrefixed). Integer keys (randint,
+// timestamp) are 8-byte big-endian strings. Output is deterministic
+// for a given seed.
+
+namespace gen {
+
+static const uint64_t kDefaultNumRecords = 100000000;
+static const uint64_t kDefaultNumTxns = 10000000;
+static const uint64_t kDefaultSeed = 2018;
+static const double kZipfianConstant = 0.99;
+// timestamp keys: record i lies in [kTimestampStart + i * kTimestampGap,
+// kTimestampStart + (i + 1) * kTimestampGap)
+static const uint64_t kTimestampStart = 1514764800000000000ULL; // 2018-01-01, in ns
+static const uint64_t kTimestampGap = 1000;
+
+static const char* kGreen = "\033[0;32m";
+static const char* kRed = "\033[0;31m";
+static const char* kNoColor = "\033[0;0m";
+
+// FNV-1 over the 8 bytes of val, as YCSB's Utils.FNVhash64
+uint64_t fnvHash64(uint64_t val) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; i++) {
+	uint64_t octet = val & 0xff;
+	val >>= 8;
+	hash ^= octet;
+	hash *= 1099511628211ULL;
+    }
+    return hash & 0x7FFFFFFFFFFFFFFFULL;
+}
+
+std::string uint64ToString(const uint64_t key) {
+    uint64_t endian_swapped_key = __builtin_bswap64(key);
+    return std::string(reinterpret_cast<const char*>(&endian_swapped_key), 8);
+}
+
+// Email-like key of record id, with the host name reversed as in
+// gen_load.py (e.g., "com.example@john.smith42")
+std::string emailKey(const uint64_t id) {
+    static const char* kHosts[] = {"gmail.com", "yahoo.com", "hotmail.com", "aol.com",
+				   "outlook.com", "mail.ru", "qq.com", "cs.cmu.edu",
+				   "web.de", "orange.fr", "comcast.net", "icloud.com"};
+    static const int kNumHosts = sizeof(kHosts) / sizeof(kHosts[0]);
+    static const char kNameChars[] = "abcdefghijklmnopqrstuvwxyz0123456789._";
+    std::mt19937_64 rng(fnvHash64(id));
+    const char* host = kHosts[rng() % kNumHosts];
+    std::string reversed_host;
+    const char* end = host + strlen(host);
+    while (end > host) {
+	const char* start = end;
+	while ((start > host) && (*(start - 1) != '.'))
+	    start--;
+	reversed_host.append(start, end - start);
+	end = start;
+	if (end > host) {
+	    reversed_host.push_back('.');
+	    end--;
+	}
+    }
+    int name_len = 4 + rng() % 16;
+    std::string name;
+    name.push_back('a' + rng() % 26);
+    for (int i = 1; i < name_len; i++)
+	name.push_back(kNameChars[rng() % (sizeof(kNameChars) - 1)]);
+    return reversed_host + "@" + name;
+}
+
+std::string makeKey(const std::string& key_type, const uint64_t id) {
+    if (key_type.compare("randint") == 0)
+	return uint64ToString(fnvHash64(id));
+    if (key_type.compare("timestamp") == 0)
+	return uint64ToString(kTimestampStart + id * kTimestampGap
+			      + fnvHash64(id) % kTimestampGap);
+    return emailKey(id);
+}
+
+// Zipfian over [0, n) with YCSB's ZipfianGenerator algorithm
+// (Gray et al., "Quickly Generating Billion-Record Synthetic Databases")
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(const uint64_t n, const double theta) : n_(n), theta_(theta) {
+	zetan_ = zeta(n, theta);
+	alpha_ = 1.0 / (1.0 - theta);
+	eta_ = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zetan_);
+    }
+
+    uint64_t next(std::mt19937_64& rng) {
+	double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+	double uz = u * zetan_;
+	if (uz < 1.0)
+	    return 0;
+	if (uz < 1.0 + pow(0.5, theta_))
+	    return 1;
+	uint64_t ret = (uint64_t)(n_ * pow(eta_ * u - eta_ + 1, alpha_));
+	return (ret < n_) ? ret : (n_ - 1);
+    }
+
+private:
+    static double zeta(const uint64_t n, const double theta) {
+	double sum = 0;
+	for (uint64_t i = 0; i < n; i++)
+	    sum += 1 / pow(i + 1, theta);
+	return sum;
+    }
+
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+};
+
+bool writeKey(std::ofstream& out, const std::string& key) {
+    uint32_t len = key.length();
+    out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+    out.write(key.data(), len);
+    return out.good();
+}
+
+} // namespace gen
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 7) {
+	std::cout << "Usage:\n";
+	std::cout << "1. key type: randint, timestamp, email\n";
+	std::cout << "2. distribution: uniform, zipfian, latest\n";
+	std::cout << "3. number of records (optional, default " << gen::kDefaultNumRecords << ")\n";
+	std::cout << "4. number of transactions (optional, default " << gen::kDefaultNumTxns << ")\n";
+	std::cout << "5. seed (optional, default " << gen::kDefaultSeed << ")\n";
+	std::cout << "6. output directory (optional, default workloads)\n";
+	std::cout << "Writes <dir>/load_<key type>.bin and <dir>/txn_<key type>_<distribution>.bin\n";
+	return -1;
+    }
+
+    std::string key_type = argv[1];
+    std::string distribution = argv[2];
+    uint64_t num_records = (argc > 3) ? strtoull(argv[3], nullptr, 10) : gen::kDefaultNumRecords;
+    uint64_t num_txns = (argc > 4) ? strtoull(argv[4], nullptr, 10) : gen::kDefaultNumTxns;
+    uint64_t seed = (argc > 5) ? strtoull(argv[5], nullptr, 10) : gen::kDefaultSeed;
+    std::string out_dir = (argc > 6) ? argv[6] : "workloads";
+
+    if (key_type.compare("randint") != 0
+	&& key_type.compare("timestamp") != 0
+	&& key_type.compare("email") != 0) {
+	std::cout << gen::kRed << "WRONG key type\n" << gen::kNoColor;
+	return -1;
+    }
+
+    if (distribution.compare("uniform") != 0
+	&& distribution.compare("zipfian") != 0
+	&& distribution.compare("latest") != 0) {
+	std::cout << gen::kRed << "WRONG distribution\n" << gen::kNoColor;
+	return -1;
+    }
+
+    if (num_records == 0) {
+	std::cout << gen::kRed << "WRONG number of records\n" << gen::kNoColor;
+	return -1;
+    }
+
+    std::cout << gen::kGreen << "key type = " << key_type << "\n";
+    std::cout << "distribution = " << distribution << gen::kNoColor << "\n";
+
+    std::string load_file = out_dir + "/load_" + key_type + ".bin";
+    std::ofstream load_out(load_file, std::ios::binary);
+    for (uint64_t i = 0; i < num_records; i++) {
+	if (!gen::writeKey(load_out, gen::makeKey(key_type, i))) {
+	    std::cout << gen::kRed << "cannot write " << load_file << "\n" << gen::kNoColor;
+	    return -1;
+	}
+    }
+    load_out.close();
+
+    std::string txn_file = out_dir + "/txn_" + key_type + "_" + distribution + ".bin";
+    std::ofstream txn_out(txn_file, std::ios::binary);
+    std::mt19937_64 rng(seed);
+    gen::ZipfianGenerator* zipfian = nullptr;
+    if (distribution.compare("uniform") != 0)
+	zipfian = new gen::ZipfianGenerator(num_records, gen::kZipfianConstant);
+    for (uint64_t i = 0; i < num_txns; i++) {
+	uint64_t id;
+	if (distribution.compare("uniform") == 0)
+	    id = rng() % num_records;
+	else if (distribution.compare("zipfian") == 0)
+	    id = gen::fnvHash64(zipfian->next(rng)) % num_records;
+	else // latest
+	    id = num_records - 1 - zipfian->next(rng);
+	if (!gen::writeKey(txn_out, gen::makeKey(key_type, id))) {
+	    std::cout << gen::kRed << "cannot write " << txn_file << "\n" << gen::kNoColor;
+	    return -1;
+	}
+    }
+    txn_out.close();
+    delete zipfian;
+
+    std::cout << num_records << " records -> " << load_file << "\n";
+    std::cout << num_txns << " transactions -> " << txn_file << "\n";
+    return 0;
+}
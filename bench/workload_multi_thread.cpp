@@ -1,61 +1,200 @@
 #include "bench.hpp"
+#include "cpu_topology.hpp"
 #include "filter_factory.hpp"
+#include "filter_surf.hpp"
+#include "latency.hpp"
+#include "replicated_surf.hpp"
 
 //#define VERBOSE 1
 
+static const int kQueryPoint = 0;
+static const int kQueryRange = 1;
+static const int kQueryCount = 2;
+static const int kQueryMix = 3; // point, range and count in turn
+
 static std::vector<std::string> txn_keys;
 static std::vector<std::string> upper_bound_keys;
+// all workers start together
+static pthread_barrier_t start_barrier;
 
 typedef struct ThreadArg {
     int thread_id;
     bench::Filter* filter;
+    surf::ReplicatedSuRF* replicated; // if set, filter is made in the thread
+    int cpu; // -1: not pinned
     int start_pos;
     int end_pos;
     int query_type;
     int64_t out_positives;
+    double start_time;
+    double end_time;
     double tput;
+    bench::LatencyHistogram* latency;
 } ThreadArg;
 
+static inline int getQueryType(const int query_type, const int i) {
+    return (query_type == kQueryMix) ? (i % 3) : query_type;
+}
+
 void* execute_workload(void* arg) {
     ThreadArg* thread_arg = (ThreadArg*)arg;
+    if (thread_arg->cpu >= 0 && !bench::pinThread(thread_arg->cpu))
+	std::cout << bench::kRed << "Unable to pin thread to cpu " << thread_arg->cpu
+		  << "\n" << bench::kNoColor;
+    bench::Filter* filter = thread_arg->filter;
+    if (thread_arg->replicated != NULL) {
+	// pinned: the replica of this thread's node stays the local one
+	filter = new bench::FilterSuRF(thread_arg->replicated->local());
+	thread_arg->filter = filter;
+    }
+    bench::LatencyHistogram& latency = *thread_arg->latency;
     int64_t positives = 0;
+    pthread_barrier_wait(&start_barrier);
+
     double start_time = bench::getNow();
-    if (thread_arg->query_type == 0) { // point
-	for (int i = thread_arg->start_pos; i < thread_arg->end_pos; i++)
-	    positives += (int)thread_arg->filter->lookup(txn_keys[i]);
-    } else { // range
-	for (int i = thread_arg->start_pos; i < thread_arg->end_pos; i++)
-	    positives += (int)thread_arg->filter->lookupRange(txn_keys[i], 
-							      upper_bound_keys[i]);
+    for (int i = thread_arg->start_pos; i < thread_arg->end_pos; i++) {
+	bench::timeQuery(i, latency, [&] {
+	    switch (getQueryType(thread_arg->query_type, i)) {
+	    case kQueryPoint:
+		positives += (int)filter->lookup(txn_keys[i]);
+		break;
+	    case kQueryRange:
+		positives += (int)filter->lookupRange(txn_keys[i], upper_bound_keys[i]);
+		break;
+	    default:
+		positives += (int)filter->approxCount(txn_keys[i], upper_bound_keys[i]);
+	    }
+	});
     }
     double end_time = bench::getNow();
     double tput = (thread_arg->end_pos - thread_arg->start_pos) / (end_time - start_time) / 1000000; // Mops/sec
 
 #ifdef VERBOSE
-    std::cout << "Thread #" << thread_arg->thread_id << bench::kGreen 
-    	      << ": Throughput = " << bench::kNoColor << tput << "\n";
-#else
-    std::cout << tput << "\n";
+    std::cout << "Thread #" << thread_arg->thread_id << " (cpu " << thread_arg->cpu << ")"
+	      << bench::kGreen << ": Throughput = " << bench::kNoColor << tput << "\n";
 #endif
 
     thread_arg->out_positives = positives;
+    thread_arg->start_time = start_time;
+    thread_arg->end_time = end_time;
     thread_arg->tput = tput;
     pthread_exit(NULL);
     return NULL;
 }
 
+// "sweep": 1, 2, 4, ... up to num_cpus (and num_cpus itself);
+// otherwise a comma-separated list of thread counts
+static std::vector<int> parseThreadCounts(const std::string& arg, const int num_cpus) {
+    std::vector<int> counts;
+    if (arg.compare(std::string("sweep")) == 0) {
+	int n = 1;
+	for (; n < num_cpus; n *= 2)
+	    counts.push_back(n);
+	counts.push_back(num_cpus);
+	return counts;
+    }
+    std::stringstream ss(arg);
+    std::string count;
+    while (std::getline(ss, count, ',')) {
+	int n = atoi(count.c_str());
+	if (n <= 0)
+	    return std::vector<int>();
+	counts.push_back(n);
+    }
+    return counts;
+}
+
+// Runs the whole transaction list split over num_threads threads;
+// returns the aggregate (wall clock) throughput in Mops/sec
+static double runThreads(const int num_threads, bench::Filter* filter,
+			 surf::ReplicatedSuRF* replicated,
+			 const bench::CpuTopology& topology, const bool pin,
+			 const int query_type, bench::LatencyHistogram& latency,
+			 int64_t& positives) {
+    pthread_t* threads = new pthread_t[num_threads];
+    ThreadArg* thread_args = new ThreadArg[num_threads];
+    std::vector<bench::FilterSuRF*> views;
+    bench::FilterSuRF* filter_surf = dynamic_cast<bench::FilterSuRF*>(filter);
+    int num_txns = (int)txn_keys.size();
+    int num_txns_per_thread = num_txns / num_threads;
+    for (int i = 0; i < num_threads; i++) {
+	thread_args[i].thread_id = i;
+	thread_args[i].filter = filter;
+	thread_args[i].replicated = replicated;
+	if (filter_surf != NULL && replicated == NULL) {
+	    // the SuRF iterators used by range and count queries are per thread
+	    views.push_back(new bench::FilterSuRF(filter_surf->getSuRF()));
+	    thread_args[i].filter = views.back();
+	}
+	thread_args[i].cpu = pin ? topology.cpu(i) : -1;
+	thread_args[i].start_pos = num_txns_per_thread * i;
+	thread_args[i].end_pos = (i == num_threads - 1) ? num_txns : num_txns_per_thread * (i + 1);
+	thread_args[i].query_type = query_type;
+	thread_args[i].out_positives = 0;
+	thread_args[i].tput = 0;
+	thread_args[i].latency = new bench::LatencyHistogram();
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, num_threads);
+    for (int i = 0; i < num_threads; i++) {
+	int rc = pthread_create(&threads[i], NULL, execute_workload, (void*)(&thread_args[i]));
+	if (rc) {
+	    std::cout << "Error: unable to create thread " << rc << std::endl;
+	    exit(-1);
+	}
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+	void* status;
+	int rc = pthread_join(threads[i], &status);
+	if (rc) {
+	    std::cout << "Error:unable to join " << rc << endl;
+	    exit(-1);
+	}
+    }
+    pthread_barrier_destroy(&start_barrier);
+
+    // from the first thread starting to the last one finishing
+    double start_time = thread_args[0].start_time;
+    double end_time = thread_args[0].end_time;
+    positives = 0;
+    for (int i = 0; i < num_threads; i++) {
+	start_time = std::min(start_time, thread_args[i].start_time);
+	end_time = std::max(end_time, thread_args[i].end_time);
+	positives += thread_args[i].out_positives;
+	latency.merge(*thread_args[i].latency);
+	delete thread_args[i].latency;
+    }
+    for (size_t i = 0; i < views.size(); i++)
+	delete views[i];
+    if (replicated != NULL) {
+	for (int i = 0; i < num_threads; i++)
+	    delete thread_args[i].filter;
+    }
+    delete[] threads;
+    delete[] thread_args;
+    return num_txns / (end_time - start_time) / 1000000; // Mops/sec
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 10) {
+    if (argc < 10 || argc > 12) {
 	std::cout << "Usage:\n";
-	std::cout << "1. filter type: SuRF, SuRFHash, SuRFReal, Bloom\n";
-	std::cout << "2. suffix length: 0 < len <= 64 (for SuRFHash and SuRFReal only)\n";
+	std::cout << "1. filter type: SuRF, SuRFHash, SuRFReal, Bloom, BlockedBloom, Xor8, Xor16\n";
+	std::cout << "   (SuRF types with suffix EF, e.g. SuRFRealEF, use Elias-Fano louds bits)\n";
+	std::cout << "   (SuRFHashCRC, SuRFHashMul: SuRFHash with CRC32C / multiply hash)\n";
+	std::cout << "2. suffix length: 0 < len <= 64 (for SuRFHash and SuRFReal only;\n"
+		  << "   bits per key for BlockedBloom)\n";
 	std::cout << "3. workload type: mixed, alterByte (only for email key)\n";
 	std::cout << "4. percentage of keys inserted: 0 < num <= 100\n";
 	std::cout << "5. byte position (conting from last, only for alterByte): num\n";
 	std::cout << "6. key type: randint, email\n";
-	std::cout << "7. query type: point, range\n";
+	std::cout << "7. query type: point, range, count, mix (point, range and count in turn)\n";
 	std::cout << "8. distribution: uniform, zipfian, latest\n";
-	std::cout << "9. number of threads\n";
+	std::cout << "9. number of threads: num, comma-separated list (e.g. 1,2,4), "
+		  << "or sweep (powers of 2 up to the number of cpus)\n";
+	std::cout << "10. pin threads to cpus (optional, default 1): 0, 1\n";
+	std::cout << "11. replicate the filter per NUMA node (optional, default 0; "
+		  << "SuRF types only): 0, 1\n";
 	return -1;
     }
 
@@ -67,13 +206,23 @@ int main(int argc, char *argv[]) {
     std::string key_type = argv[6];
     std::string query_type = argv[7];
     std::string distribution = argv[8];
-    int num_threads = atoi(argv[9]);
+    std::string threads_arg = argv[9];
+    bool pin = (argc > 10) ? (atoi(argv[10]) != 0) : true;
+    bool replicate = (argc > 11) ? (atoi(argv[11]) != 0) : false;
 
     // check args ====================================================
     if (filter_type.compare(std::string("SuRF")) != 0
 	&& filter_type.compare(std::string("SuRFHash")) != 0
 	&& filter_type.compare(std::string("SuRFReal")) != 0
+	&& filter_type.compare(std::string("SuRFEF")) != 0
+	&& filter_type.compare(std::string("SuRFHashEF")) != 0
+	&& filter_type.compare(std::string("SuRFRealEF")) != 0
+	&& filter_type.compare(std::string("SuRFHashCRC")) != 0
+	&& filter_type.compare(std::string("SuRFHashMul")) != 0
 	&& filter_type.compare(std::string("Bloom")) != 0
+	&& filter_type.compare(std::string("BlockedBloom")) != 0
+	&& filter_type.compare(std::string("Xor8")) != 0
+	&& filter_type.compare(std::string("Xor16")) != 0
 	&& filter_type.compare(std::string("ARF")) != 0) {
 	std::cout << bench::kRed << "WRONG filter type\n" << bench::kNoColor;
 	return -1;
@@ -102,8 +251,16 @@ int main(int argc, char *argv[]) {
 	return -1;
     }
 
-    if (query_type.compare(std::string("point")) != 0
-	&& query_type.compare(std::string("range")) != 0) {
+    int query_type_id;
+    if (query_type.compare(std::string("point")) == 0) {
+	query_type_id = kQueryPoint;
+    } else if (query_type.compare(std::string("range")) == 0) {
+	query_type_id = kQueryRange;
+    } else if (query_type.compare(std::string("count")) == 0) {
+	query_type_id = kQueryCount;
+    } else if (query_type.compare(std::string("mix")) == 0) {
+	query_type_id = kQueryMix;
+    } else {
 	std::cout << bench::kRed << "WRONG query type\n" << bench::kNoColor;
 	return -1;
     }
@@ -115,14 +272,23 @@ int main(int argc, char *argv[]) {
 	return -1;
     }
 
+    bench::CpuTopology topology;
+    if (topology.numCpus() == 0) {
+	std::cout << bench::kRed << "Unable to read the cpu affinity\n" << bench::kNoColor;
+	return -1;
+    }
+    std::vector<int> thread_counts = parseThreadCounts(threads_arg, topology.numCpus());
+    if (thread_counts.empty()) {
+	std::cout << bench::kRed << "WRONG number of threads\n" << bench::kNoColor;
+	return -1;
+    }
+
     // load keys from files =======================================
     std::string load_file = "workloads/load_";
     load_file += key_type;
-    std::vector<std::string> load_keys;
-    if (key_type.compare(std::string("email")) == 0)
-	bench::loadKeysFromFile(load_file, false, load_keys);
-    else
-	bench::loadKeysFromFile(load_file, true, load_keys);
+    std::vector<std::string> insert_keys;
+    bench::loadKeysToInsert(load_file, key_type.compare(std::string("email")) != 0,
+			    percent, insert_keys);
 
     std::string txn_file = "workloads/txn_";
     txn_file += key_type;
@@ -134,14 +300,11 @@ int main(int argc, char *argv[]) {
     else
 	bench::loadKeysFromFile(txn_file, true, txn_keys);
 
-    std::vector<std::string> insert_keys;
-    bench::selectKeysToInsert(percent, insert_keys, load_keys);
-
     if (workload_type.compare(std::string("alterByte")) == 0)
 	bench::modifyKeyByte(txn_keys, byte_pos);
 
-    // compute upperbound keys for range queries =================
-    if (query_type.compare(std::string("range")) == 0) {
+    // compute upperbound keys for range and count queries ======
+    if (query_type_id != kQueryPoint) {
 	for (int i = 0; i < (int)txn_keys.size(); i++)
 	    upper_bound_keys.push_back(bench::getUpperBoundKey(key_type, txn_keys[i]));
     }
@@ -153,61 +316,58 @@ int main(int argc, char *argv[]) {
     std::cout << bench::kGreen << "Memory = " << bench::kNoColor << filter->getMemoryUsage() << std::endl;
 #endif
 
-    // execute transactions =======================================
-    pthread_t* threads = new pthread_t[num_threads];
-    pthread_attr_t attr;
-    // Initialize and set thread joinable
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    
-    ThreadArg* thread_args = new ThreadArg[num_threads];
-    int num_txns = (int)txn_keys.size();
-    int num_txns_per_thread = num_txns / num_threads;
-    for (int i = 0; i < num_threads; i++) {
-	thread_args[i].thread_id = i;
-	thread_args[i].filter = filter;
-	thread_args[i].start_pos = num_txns_per_thread * i;
-	thread_args[i].end_pos = num_txns_per_thread * (i + 1);
-	if (query_type.compare(std::string("point")) == 0)
-	    thread_args[i].query_type = 0;
+    surf::ReplicatedSuRF* replicated = NULL;
+    if (replicate) {
+	bench::FilterSuRF* filter_surf = dynamic_cast<bench::FilterSuRF*>(filter);
+	if (filter_surf == NULL)
+	    std::cout << bench::kRed << "Only SuRF filters are replicated\n" << bench::kNoColor;
 	else
-	    thread_args[i].query_type = 1;
-	thread_args[i].out_positives = 0;
-	thread_args[i].tput = 0;
-    }
-
-    for (int i = 0; i < num_threads; i++) {
-	int rc = pthread_create(&threads[i], NULL, execute_workload, (void*)(&thread_args[i]));
-	if (rc) {
-	    std::cout << "Error: unable to create thread " << rc << std::endl;
-	    exit(-1);
-	}
-    }
-
-    // free attribute and wait for the other threads
-    pthread_attr_destroy(&attr);
-    for (int i = 0; i < num_threads; i++) {
-	void* status;
-	int rc = pthread_join(threads[i], &status);
-	if (rc) {
-	    std::cout << "Error:unable to join " << rc << endl;
-	    exit(-1);
-	}
-    }
-
-    double tput = 0;
-    for (int i = 0; i < num_threads; i++) {
-	tput += thread_args[i].tput;
+	    replicated = new surf::ReplicatedSuRF(*filter_surf->getSuRF());
     }
 
 #ifdef VERBOSE
-    std::cout << bench::kGreen << "Throughput = " << bench::kNoColor << tput << "\n";
+    std::cout << bench::kGreen << "Cpus = " << bench::kNoColor << topology.numCpus()
+	      << bench::kGreen << ", NUMA nodes = " << bench::kNoColor << topology.numNodes()
+	      << bench::kGreen << ", replicas = " << bench::kNoColor
+	      << ((replicated != NULL) ? replicated->numReplicas() : 0) << "\n";
+#endif
 
-    int positives = 0;
-    for (int i = 0; i < num_threads; i++) {
-	positives += (thread_args[i].out_positives);
+    // execute transactions =======================================
+    // Scaling is relative to the per-thread throughput of the first
+    // thread count: efficiency = tput / (threads * base per-thread tput)
+    std::string latency_name = query_type;
+    latency_name[0] = toupper(latency_name[0]);
+    double base_tput_per_thread = 0;
+    int64_t positives = 0;
+    bench::LatencyHistogram latency;
+#ifdef SURF_TRACE
+    surf::resetPhaseTrace();
+#endif
+    for (size_t c = 0; c < thread_counts.size(); c++) {
+	int num_threads = thread_counts[c];
+	bench::LatencyHistogram run_latency;
+	double tput = runThreads(num_threads, filter, replicated, topology, pin,
+				 query_type_id, run_latency, positives);
+	if (c == 0)
+	    base_tput_per_thread = tput / num_threads;
+	double speedup = tput / (base_tput_per_thread * thread_counts[0]);
+	double efficiency = tput / (base_tput_per_thread * num_threads);
+	std::cout << bench::kGreen << "Threads = " << bench::kNoColor << num_threads
+		  << bench::kGreen << ", Throughput = " << bench::kNoColor << tput
+		  << bench::kGreen << ", Speedup = " << bench::kNoColor << speedup
+		  << bench::kGreen << ", Efficiency = " << bench::kNoColor << efficiency << "\n";
+#ifdef VERBOSE
+	run_latency.print(latency_name);
+#endif
+	latency.merge(run_latency);
     }
+#ifdef SURF_TRACE
+    // phases summed over all threads and thread counts
+    surf::getPhaseTrace().print();
+#endif
 
+#ifdef VERBOSE
+    // positives of the last run ===================================
     // compute true positives ======================================
     std::map<std::string, bool> ht;
     for (int i = 0; i < (int)insert_keys.size(); i++)
@@ -215,13 +375,11 @@ int main(int argc, char *argv[]) {
 
     int64_t true_positives = 0;
     std::map<std::string, bool>::iterator ht_iter;
-    if (query_type.compare(std::string("point")) == 0) {
-	for (int i = 0; i < (int)txn_keys.size(); i++) {
+    for (int i = 0; i < (int)txn_keys.size(); i++) {
+	if (getQueryType(query_type_id, i) == kQueryPoint) {
 	    ht_iter = ht.find(txn_keys[i]);
 	    true_positives += (ht_iter != ht.end());
-	}
-    } else if (query_type.compare(std::string("range")) == 0) {
-	for (int i = 0; i < (int)txn_keys.size(); i++) {
+	} else {
 	    ht_iter = ht.upper_bound(txn_keys[i]);
 	    if (ht_iter != ht.end()) {
 		std::string fetched_key = ht_iter->first;
@@ -242,12 +400,12 @@ int main(int argc, char *argv[]) {
     std::cout << "true negatives = " << true_negatives << "\n";
     std::cout << bench::kGreen << "False Positive Rate = " << bench::kNoColor << fp_rate << "\n";
 #else
-    std::cout << tput << "\n";
+    // over all thread counts
+    latency.print(latency_name);
     std::cout << bench::kGreen << bench::kNoColor << "\n\n";
 #endif
 
-    delete[] threads;
-    delete[] thread_args;
+    delete replicated;
 
     pthread_exit(NULL);
     return 0;
@@ -0,0 +1,130 @@
+#ifndef XOR_FILTER_H_
+#define XOR_FILTER_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "MurmurHash3.h"
+
+namespace bench {
+
+// Static xor filter (Graf and Lemire, "Xor Filters: Faster and Smaller
+// Than Bloom and Cuckoo Filters", 2020). Each key maps to one slot in
+// each third of a table of about 1.23 n fingerprints; construction
+// peels the 3-hypergraph and assigns the slots so that the three
+// fingerprints of a key xor to the key's own fingerprint. A lookup
+// reads 3 slots; FingerprintT (uint8_t or uint16_t) sets the false
+// positive rate to about 2^-8 or 2^-16.
+template <typename FingerprintT>
+class XorFilter {
+public:
+    XorFilter(const std::vector<std::string>& keys) : seed_(0), block_length_(0) {
+	std::vector<uint64_t> key_hashes;
+	key_hashes.reserve(keys.size());
+	for (size_t i = 0; i < keys.size(); i++)
+	    key_hashes.push_back(hashKey(keys[i]));
+	// peeling never succeeds with duplicate hashes
+	std::sort(key_hashes.begin(), key_hashes.end());
+	key_hashes.erase(std::unique(key_hashes.begin(), key_hashes.end()), key_hashes.end());
+
+	uint64_t capacity = 32 + (uint64_t)(1.23 * key_hashes.size());
+	block_length_ = capacity / 3;
+	fingerprints_.resize(block_length_ * 3, 0);
+	std::vector<uint64_t> stack;
+	while (!peel(key_hashes, stack))
+	    seed_++;
+	assign(stack);
+    }
+
+    bool lookup(const std::string& key) const {
+	uint64_t h = fmix64(hashKey(key) + seed_);
+	FingerprintT f = fingerprint(h);
+	return f == (fingerprints_[slot(h, 0)] ^ fingerprints_[slot(h, 1)]
+		     ^ fingerprints_[slot(h, 2)]);
+    }
+
+    uint64_t getMemoryUsage() const {
+	return fingerprints_.size() * sizeof(FingerprintT);
+    }
+
+private:
+    static uint64_t hashKey(const std::string& key) {
+	uint64_t out[2];
+	MurmurHash3_x64_128(key.c_str(), key.size(), 0xbc9f1d34, out);
+	return out[0];
+    }
+
+    static FingerprintT fingerprint(const uint64_t h) {
+	return (FingerprintT)(h ^ (h >> 32));
+    }
+
+    // Slot of h in third i of the table
+    uint64_t slot(const uint64_t h, const int i) const {
+	uint64_t r = (i == 0) ? h : ((h << (21 * i)) | (h >> (64 - 21 * i)));
+	return (((r & 0xffffffffULL) * block_length_) >> 32) + i * block_length_;
+    }
+
+    // Fills stack with (hash, slot) pairs in peeling order; returns
+    // false if the hypergraph of this seed has a core that cannot be
+    // peeled
+    bool peel(const std::vector<uint64_t>& key_hashes, std::vector<uint64_t>& stack) const {
+	uint64_t num_slots = fingerprints_.size();
+	// per slot: number of keys and xor of their hashes
+	std::vector<uint32_t> counts(num_slots, 0);
+	std::vector<uint64_t> xors(num_slots, 0);
+	for (size_t k = 0; k < key_hashes.size(); k++) {
+	    uint64_t h = fmix64(key_hashes[k] + seed_);
+	    for (int i = 0; i < 3; i++) {
+		uint64_t s = slot(h, i);
+		counts[s]++;
+		xors[s] ^= h;
+	    }
+	}
+
+	std::vector<uint64_t> queue;
+	for (uint64_t s = 0; s < num_slots; s++)
+	    if (counts[s] == 1)
+		queue.push_back(s);
+	stack.clear();
+	while (!queue.empty()) {
+	    uint64_t s = queue.back();
+	    queue.pop_back();
+	    if (counts[s] != 1)
+		continue;
+	    uint64_t h = xors[s];
+	    stack.push_back(h);
+	    stack.push_back(s);
+	    for (int i = 0; i < 3; i++) {
+		uint64_t other = slot(h, i);
+		counts[other]--;
+		xors[other] ^= h;
+		if (counts[other] == 1)
+		    queue.push_back(other);
+	    }
+	}
+	return (stack.size() == 2 * key_hashes.size());
+    }
+
+    // In reverse peeling order, a key's slot is the only one of its
+    // three that no later key depends on
+    void assign(const std::vector<uint64_t>& stack) {
+	for (size_t i = stack.size(); i > 0; i -= 2) {
+	    uint64_t h = stack[i - 2];
+	    uint64_t s = stack[i - 1];
+	    fingerprints_[s] = 0;
+	    fingerprints_[s] = fingerprint(h) ^ fingerprints_[slot(h, 0)]
+		^ fingerprints_[slot(h, 1)] ^ fingerprints_[slot(h, 2)];
+	}
+    }
+
+    uint64_t seed_;
+    uint64_t block_length_;
+    std::vector<FingerprintT> fingerprints_;
+};
+
+} // namespace bench
+
+#endif // XOR_FILTER_H_
@@ -6,12 +6,13 @@
 #include <vector>
 
 #include "config.hpp"
+#include "serial_sink.hpp"
 
 namespace surf {
 
 class Bitvector {
 public:
-    Bitvector() : num_bits_(0), bits_(nullptr) {};
+    Bitvector() : num_bits_(0), bits_(nullptr), aliased_(false) {};
 
     Bitvector(const std::vector<std::vector<word_t> >& bitvector_per_level, 
 	      const std::vector<position_t>& num_bits_per_level, 
@@ -20,6 +21,7 @@ public:
 	if (end_level == 0)
 	    end_level = bitvector_per_level.size();
 	num_bits_ = totalNumBits(num_bits_per_level, start_level, end_level);
+	aliased_ = false;
 	bits_ = new word_t[numWords()];
 	memset(bits_, 0, bitsSize());
 	concatenateBitvectors(bitvector_per_level, num_bits_per_level, start_level, end_level);
@@ -48,6 +50,10 @@ public:
 	return (sizeof(Bitvector) + bitsSize());
     }
 
+    const word_t* getBits() const {
+	return bits_;
+    }
+
     bool readBit(const position_t pos) const;
 
     position_t distanceToNextSetBit(const position_t pos) const;
@@ -65,6 +71,7 @@ private:
 protected:
     position_t num_bits_;
     word_t* bits_;
+    bool aliased_; // bits_ (and any LUT) point into a serialized buffer
 };
 
 bool Bitvector::readBit (const position_t pos) const {
@@ -98,7 +105,7 @@ position_t Bitvector::distanceToNextSetBit (const position_t pos) const {
 	    return (distance + __builtin_clzll(test_bits));
 	distance += kWordSize;
     }
-    return distance;
+    return (num_bits_ - pos);
 }
 
 position_t Bitvector::distanceToPrevSetBit (const position_t pos) const {
@@ -23,6 +23,10 @@ static const bool kIncludeDense = true;
 static const uint32_t kSparseDenseRatio = 16;
 static const label_t kTerminator = 255;
 
+// rank/select directory sampling used by the LOUDS encodings
+static const position_t kRankBasicBlockSize = 512;
+static const position_t kSelectSampleInterval = 64;
+
 static const int kHashShift = 7;
 
 static const int kCouldBePositive = 2018; // used in suffix comparison
@@ -34,6 +38,55 @@ enum SuffixType {
     kMixed = 3
 };
 
+// Encoding of the LOUDS-Sparse node boundary bits (louds bits).
+// kLoudsEliasFano stores the node start positions in Elias-Fano form,
+// which is smaller when most sparse nodes have few labels.
+enum LoudsEncoding {
+    kLoudsBitvector = 0,
+    kLoudsEliasFano = 1
+};
+
+// Hash function used for kHash/kMixed suffixes. It is recorded in the
+// serialized suffix vectors, so a filter is always probed with the
+// hash it was built with.
+enum SuffixHashType {
+    kHashLevelDB = 0, // 4 bytes per step
+    kHashCRC32C = 1, // SSE4.2 crc32 instruction, 8 bytes per step
+    kHashMultiply = 2 // 64-bit multiply-xorshift, 8 bytes per step
+};
+
+// Query type whose false positive rate the bits-per-key budget
+// builder optimizes when choosing the suffix configuration.
+enum QueryPriority {
+    kPointQueries = 0,
+    kRangeQueries = 1
+};
+
+// Serialized SuRF: header (magic, version, section count, format),
+// then a directory of (offset, size) pairs, one per section; see
+// SuRF::serialize.
+static const uint32_t kSerializedMagic = 0x46527553; // "SuRF"
+static const uint32_t kSerializedVersion = 1;
+static const uint32_t kNumSerializedSections = 10;
+// kSerializeCompact leaves out the rank/select look-up tables; they
+// are recomputed from the bits when the filter is loaded.
+enum SerializeFormat {
+    kSerializeFull = 0,
+    kSerializeCompact = 1
+};
+static const uint64_t kSerializedHeaderSize
+    = sizeof(uint32_t) * 4 + sizeof(uint64_t) * 2 * kNumSerializedSections;
+
+// Serialized PartitionedSuRF: header (magic, version, number of
+// partitions, fence bytes), then the fence index and the partitions;
+// see PartitionedSuRF::serialize.
+static const uint32_t kPartitionedMagic = 0x50527553; // "SuRP"
+static const uint32_t kPartitionedVersion = 1;
+static const uint64_t kPartitionedHeaderSize = sizeof(uint32_t) * 2 + sizeof(uint64_t) * 2;
+
+// The suffix hash is 32-bit; kHashShift bits of it are skipped.
+static const level_t kMaxHashSuffixLen = 32 - kHashShift;
+
 void align(char*& ptr) {
     ptr = (char*)(((uint64_t)ptr + 7) & ~((uint64_t)7));
 }
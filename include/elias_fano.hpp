@@ -0,0 +1,331 @@
+#ifndef ELIASFANO_H_
+#define ELIASFANO_H_
+
+#include <assert.h>
+
+#include <vector>
+
+#include "config.hpp"
+#include "popcount.h"
+#include "select.hpp"
+#include "serial_sink.hpp"
+
+namespace surf {
+
+// Elias-Fano encoding of the positions of the 1's in a bitvector.
+// Provides the select/readBit/distanceToNextSetBit interface of
+// BitvectorSelect, so that it can replace it for the LOUDS bits.
+// Each 1 at position p is split into a high part (p >> low_len_),
+// stored in unary in high_bits_, and a low part of low_len_ bits.
+// Like BitvectorSelect, it assumes that the first bit in the
+// bitvector is one.
+class EliasFano {
+public:
+    EliasFano() : num_bits_(0), num_ones_(0), low_len_(0), num_low_words_(0),
+		  num_zero_samples_(0), low_bits_(nullptr), zero_lut_(nullptr),
+		  high_bits_(nullptr), aliased_(false) {};
+
+    EliasFano(const std::vector<std::vector<word_t> >& bitvector_per_level,
+	      const std::vector<position_t>& num_bits_per_level,
+	      const level_t start_level = 0,
+	      level_t end_level = 0/* non-inclusive */) {
+	if (end_level == 0)
+	    end_level = bitvector_per_level.size();
+	std::vector<position_t> positions;
+	aliased_ = false;
+	num_bits_ = 0;
+	for (level_t level = start_level; level < end_level; level++) {
+	    for (position_t pos = 0; pos < num_bits_per_level[level]; pos++) {
+		if (bitvector_per_level[level][pos / kWordSize] & (kMsbMask >> (pos % kWordSize)))
+		    positions.push_back(num_bits_ + pos);
+	    }
+	    num_bits_ += num_bits_per_level[level];
+	}
+	encode(positions);
+    }
+
+    ~EliasFano() {}
+
+    static level_t computeLowLen(const position_t num_bits, const position_t num_ones) {
+	if ((num_ones == 0) || (num_bits <= num_ones))
+	    return 0;
+	return (kWordSize - 1) - __builtin_clzll((uint64_t)(num_bits / num_ones));
+    }
+
+    position_t numBits() const {
+	return num_bits_;
+    }
+
+    position_t numOnes() const {
+	return num_ones_;
+    }
+
+    // Returns the postion of the rank-th 1 bit.
+    // posistion is zero-based; rank is one-based.
+    // Returns numBits() if rank > numOnes().
+    position_t select(position_t rank) const {
+	assert(rank > 0);
+	if (rank > num_ones_)
+	    return num_bits_;
+	position_t idx = rank - 1;
+	position_t high = high_bits_->select(rank) - idx;
+	return ((high << low_len_) | readLow(idx));
+    }
+
+    bool readBit(const position_t pos) const {
+	assert(pos < num_bits_);
+	position_t value = 0;
+	return ((lowerBound(pos, &value) < num_ones_) && (value == pos));
+    }
+
+    position_t distanceToNextSetBit(const position_t pos) const {
+	assert(pos < num_bits_);
+	position_t value = 0;
+	if (lowerBound(pos + 1, &value) >= num_ones_)
+	    return (num_bits_ - pos);
+	return (value - pos);
+    }
+
+    position_t lowBitsSize() const {
+	return (num_low_words_ * (kWordSize / 8));
+    }
+
+    position_t zeroLutSize() const {
+	return (num_zero_samples_ * sizeof(position_t));
+    }
+
+    // Without include_luts, zero_lut_ and the select LUT of the high
+    // bits are left out and rebuilt on load
+    position_t serializedSize(const bool include_luts = true) const {
+	position_t size = sizeof(num_bits_) + sizeof(num_ones_) + sizeof(low_len_)
+	    + sizeof(num_low_words_) + sizeof(num_zero_samples_);
+	sizeAlign(size);
+	size += lowBitsSize();
+	if (include_luts)
+	    size += zeroLutSize();
+	sizeAlign(size);
+	size += high_bits_->serializedSize(include_luts);
+	return size;
+    }
+
+    position_t size() const {
+	return (sizeof(EliasFano) + lowBitsSize() + zeroLutSize() + high_bits_->size());
+    }
+
+    void serialize(SerialSink& sink, const bool include_luts = true) const {
+	sink.write(&num_bits_, sizeof(num_bits_));
+	sink.write(&num_ones_, sizeof(num_ones_));
+	sink.write(&low_len_, sizeof(low_len_));
+	sink.write(&num_low_words_, sizeof(num_low_words_));
+	sink.write(&num_zero_samples_, sizeof(num_zero_samples_));
+	sink.align();
+	sink.write(low_bits_, lowBitsSize());
+	if (include_luts)
+	    sink.write(zero_lut_, zeroLutSize());
+	sink.align();
+	high_bits_->serialize(sink, include_luts);
+    }
+
+    void serialize(char*& dst) const {
+	BufferSink sink(dst);
+	serialize(sink);
+	dst = sink.position();
+    }
+
+    // See BitvectorRank::deSerialize for alias and has_luts.
+    static EliasFano* deSerialize(char*& src, const bool alias = false,
+				  const bool has_luts = true) {
+	EliasFano* ef = new EliasFano();
+	memcpy(&(ef->num_bits_), src, sizeof(ef->num_bits_));
+	src += sizeof(ef->num_bits_);
+	memcpy(&(ef->num_ones_), src, sizeof(ef->num_ones_));
+	src += sizeof(ef->num_ones_);
+	memcpy(&(ef->low_len_), src, sizeof(ef->low_len_));
+	src += sizeof(ef->low_len_);
+	memcpy(&(ef->num_low_words_), src, sizeof(ef->num_low_words_));
+	src += sizeof(ef->num_low_words_);
+	memcpy(&(ef->num_zero_samples_), src, sizeof(ef->num_zero_samples_));
+	src += sizeof(ef->num_zero_samples_);
+	align(src);
+	if (!has_luts) {
+	    ef->low_bits_ = new word_t[ef->num_low_words_];
+	    memcpy(ef->low_bits_, src, ef->lowBitsSize());
+	    src += ef->lowBitsSize();
+	} else if (alias) {
+	    ef->aliased_ = true;
+	    ef->low_bits_ = reinterpret_cast<word_t*>(src);
+	    src += ef->lowBitsSize();
+	    ef->zero_lut_ = reinterpret_cast<position_t*>(src);
+	    src += ef->zeroLutSize();
+	} else {
+	    ef->low_bits_ = new word_t[ef->num_low_words_];
+	    memcpy(ef->low_bits_, src, ef->lowBitsSize());
+	    src += ef->lowBitsSize();
+	    ef->zero_lut_ = new position_t[ef->num_zero_samples_];
+	    memcpy(ef->zero_lut_, src, ef->zeroLutSize());
+	    src += ef->zeroLutSize();
+	}
+	align(src);
+	ef->high_bits_ = BitvectorSelect::deSerialize(src, alias, has_luts);
+	if (!has_luts)
+	    ef->initZeroLut(ef->high_bits_->getBits(), ef->high_bits_->numBits());
+	return ef;
+    }
+
+    void destroy() {
+	if (!aliased_) {
+	    delete[] low_bits_;
+	    delete[] zero_lut_;
+	}
+	high_bits_->destroy();
+	delete high_bits_;
+    }
+
+private:
+    void encode(const std::vector<position_t>& positions);
+    void initZeroLut(const word_t* high_words, const position_t num_high_bits);
+
+    word_t readLow(const position_t idx) const {
+	if (low_len_ == 0)
+	    return 0;
+	uint64_t bit_pos = (uint64_t)idx * low_len_;
+	position_t word_id = bit_pos / kWordSize;
+	position_t offset = bit_pos % kWordSize;
+	word_t low = low_bits_[word_id] >> offset;
+	if (offset + low_len_ > kWordSize)
+	    low |= (low_bits_[word_id + 1] << (kWordSize - offset));
+	return (low & ((1ULL << low_len_) - 1));
+    }
+
+    // Returns the position of the rank-th 0 bit in high_bits_.
+    // rank is one-based.
+    position_t selectZero(const position_t rank) const;
+
+    // Returns the index of the first 1 at a position >= pos and stores
+    // that position in value; returns numOnes() if there is none.
+    position_t lowerBound(const position_t pos, position_t* value) const;
+
+private:
+    position_t num_bits_;
+    position_t num_ones_;
+    level_t low_len_; // in bits
+    position_t num_low_words_;
+    position_t num_zero_samples_;
+    word_t* low_bits_;
+    // Slot i stores the position right after the (i * kSelectSampleInterval)-th
+    // 0 bit in high_bits_; slot 0 stores 0.
+    position_t* zero_lut_;
+    BitvectorSelect* high_bits_;
+    bool aliased_; // low_bits_ and zero_lut_ point into a serialized buffer
+};
+
+void EliasFano::encode(const std::vector<position_t>& positions) {
+    num_ones_ = positions.size();
+    low_len_ = computeLowLen(num_bits_, num_ones_);
+
+    uint64_t num_low_bits = (uint64_t)num_ones_ * low_len_;
+    num_low_words_ = num_low_bits / kWordSize + 1;
+    low_bits_ = new word_t[num_low_words_];
+    memset(low_bits_, 0, lowBitsSize());
+
+    position_t num_high_bits = num_ones_ + (num_bits_ >> low_len_) + 1;
+    std::vector<word_t> high_words(num_high_bits / kWordSize + 1, 0);
+    word_t low_mask = (1ULL << low_len_) - 1;
+    for (position_t i = 0; i < num_ones_; i++) {
+	if (low_len_ > 0) {
+	    uint64_t bit_pos = (uint64_t)i * low_len_;
+	    position_t word_id = bit_pos / kWordSize;
+	    position_t offset = bit_pos % kWordSize;
+	    word_t low = positions[i] & low_mask;
+	    low_bits_[word_id] |= (low << offset);
+	    if (offset + low_len_ > kWordSize)
+		low_bits_[word_id + 1] |= (low >> (kWordSize - offset));
+	}
+	position_t high_pos = (positions[i] >> low_len_) + i;
+	high_words[high_pos / kWordSize] |= (kMsbMask >> (high_pos % kWordSize));
+    }
+
+    initZeroLut(high_words.data(), num_high_bits);
+
+    std::vector<std::vector<word_t> > high_bits_per_level(1, high_words);
+    std::vector<position_t> num_high_bits_per_level(1, num_high_bits);
+    high_bits_ = new BitvectorSelect(kSelectSampleInterval, high_bits_per_level,
+				     num_high_bits_per_level);
+}
+
+// zero_lut_[i] = 1 + position of the (i * kSelectSampleInterval)-th 0 bit
+void EliasFano::initZeroLut(const word_t* high_words, const position_t num_high_bits) {
+    std::vector<position_t> zero_lut_vector;
+    zero_lut_vector.push_back(0);
+    position_t next_sample = kSelectSampleInterval;
+    position_t cumu_zeros = 0;
+    position_t num_words = (num_high_bits + kWordSize - 1) / kWordSize;
+    for (position_t i = 0; i < num_words; i++) {
+	word_t zeros = ~high_words[i];
+	if ((i == num_words - 1) && ((num_high_bits % kWordSize) != 0))
+	    zeros &= ~(kOneMask >> (num_high_bits % kWordSize));
+	position_t num_zeros_in_word = popcount(zeros);
+	while (next_sample <= cumu_zeros + num_zeros_in_word) {
+	    position_t pos = i * kWordSize
+		+ select64_popcount_search(zeros, next_sample - cumu_zeros);
+	    zero_lut_vector.push_back(pos + 1);
+	    next_sample += kSelectSampleInterval;
+	}
+	cumu_zeros += num_zeros_in_word;
+    }
+    num_zero_samples_ = zero_lut_vector.size();
+    zero_lut_ = new position_t[num_zero_samples_];
+    for (position_t i = 0; i < num_zero_samples_; i++)
+	zero_lut_[i] = zero_lut_vector[i];
+}
+
+position_t EliasFano::selectZero(const position_t rank) const {
+    assert(rank > 0);
+    position_t lut_idx = rank / kSelectSampleInterval;
+    position_t rank_left = rank % kSelectSampleInterval;
+    position_t pos = zero_lut_[lut_idx];
+    if (rank_left == 0)
+	return pos - 1;
+
+    const word_t* bits = high_bits_->getBits();
+    position_t word_id = pos / kWordSize;
+    position_t offset = pos % kWordSize;
+    word_t word = ~bits[word_id] << offset >> offset; //zero-out most significant bits
+    position_t zeros_count_in_word = popcount(word);
+    while (zeros_count_in_word < rank_left) {
+	word_id++;
+	word = ~bits[word_id];
+	rank_left -= zeros_count_in_word;
+	zeros_count_in_word = popcount(word);
+    }
+    return (word_id * kWordSize + select64_popcount_search(word, rank_left));
+}
+
+position_t EliasFano::lowerBound(const position_t pos, position_t* value) const {
+    position_t bucket = pos >> low_len_;
+    if (bucket > (num_bits_ >> low_len_))
+	return num_ones_;
+    position_t high_pos = (bucket == 0) ? 0 : (selectZero(bucket) + 1);
+    position_t idx = high_pos - bucket;
+    word_t target_low = pos & ((1ULL << low_len_) - 1);
+    // scan the elements sharing the high part of pos
+    while ((idx < num_ones_) && high_bits_->readBit(high_pos)) {
+	word_t low = readLow(idx);
+	if (low >= target_low) {
+	    *value = (bucket << low_len_) | low;
+	    return idx;
+	}
+	high_pos++;
+	idx++;
+    }
+    if (idx >= num_ones_)
+	return num_ones_;
+    // the answer is the first element in a later bucket
+    high_pos += high_bits_->distanceToNextSetBit(high_pos);
+    *value = ((high_pos - idx) << low_len_) | readLow(idx);
+    return idx;
+}
+
+} // namespace surf
+
+#endif // ELIASFANO_H_
@@ -1,8 +1,17 @@
 #ifndef HASH_H_
 #define HASH_H_
 
+#include <stdint.h>
+#include <string.h>
+
 #include <string>
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "config.hpp"
+
 namespace surf {
 
 //******************************************************
@@ -45,12 +54,124 @@ inline uint32_t Hash(const char* data, size_t n, uint32_t seed) {
     return h;
 }
 
+//******************************************************
+//CRC32C (Castagnoli)
+//******************************************************
+inline uint64_t DecodeFixed64(const char* ptr) {
+    uint64_t result;
+    memcpy(&result, ptr, sizeof(result));
+    return result;
+}
+
+// Bitwise CRC32C, for CPUs without the crc32 instruction; produces the
+// same values, so that filters stay portable across machines
+inline uint32_t crc32cByte(uint32_t crc, const uint8_t byte) {
+    crc ^= byte;
+    for (int i = 0; i < 8; i++)
+	crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+    return crc;
+}
+
+inline uint32_t crc32cSoftware(const char* data, size_t n, uint32_t crc) {
+    const char* limit = data + n;
+    while (data < limit) {
+	crc = crc32cByte(crc, static_cast<unsigned char>(*data));
+	data++;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+// The crc32 instruction (SSE4.2), compiled for this function only so
+// that the rest of the library does not require SSE4.2
+__attribute__((target("sse4.2")))
+inline uint32_t crc32cHardware(const char* data, size_t n, uint32_t crc) {
+    const char* limit = data + n;
+    uint64_t crc64 = crc;
+    while (data + 8 <= limit) {
+	crc64 = _mm_crc32_u64(crc64, DecodeFixed64(data));
+	data += 8;
+    }
+    crc = (uint32_t)crc64;
+    while (data < limit) {
+	crc = _mm_crc32_u8(crc, static_cast<unsigned char>(*data));
+	data++;
+    }
+    return crc;
+}
+
+inline bool hasCrc32Instruction() {
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+#endif
+
+inline uint32_t CRC32CHash(const char* data, size_t n, uint32_t seed) {
+#if defined(__x86_64__)
+    if (hasCrc32Instruction())
+	return ~crc32cHardware(data, n, ~seed);
+#endif
+    return ~crc32cSoftware(data, n, ~seed);
+}
+
+//******************************************************
+//64-BIT MULTIPLY-XORSHIFT HASH
+//******************************************************
+inline uint64_t fmix64(uint64_t h) {
+    // MurmurHash3 finalizer
+    h ^= (h >> 33);
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= (h >> 33);
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= (h >> 33);
+    return h;
+}
+
+inline uint32_t MultiplyHash(const char* data, size_t n, uint32_t seed) {
+    const uint64_t m = 0x9e3779b97f4a7c15ULL;
+    const char* limit = data + n;
+    uint64_t h = seed ^ (n * m);
+
+    // Pick up eight bytes at a time
+    while (data + 8 <= limit) {
+	h ^= DecodeFixed64(data) * m;
+	h = ((h << 31) | (h >> 33)) * m;
+	data += 8;
+    }
+
+    // Pick up remaining bytes
+    if (data < limit) {
+	uint64_t w = 0;
+	memcpy(&w, data, limit - data);
+	h ^= w * m;
+	h = ((h << 31) | (h >> 33)) * m;
+    }
+    return (uint32_t)fmix64(h);
+}
+
+static const uint32_t kSuffixHashSeed = 0xbc9f1d34;
+
 inline uint32_t suffixHash(const std::string &key) {
-    return Hash(key.c_str(), key.size(), 0xbc9f1d34);
+    return Hash(key.c_str(), key.size(), kSuffixHashSeed);
 }
 
 inline uint32_t suffixHash(const char* key, const int keylen) {
-    return Hash(key, keylen, 0xbc9f1d34);
+    return Hash(key, keylen, kSuffixHashSeed);
+}
+
+inline uint32_t suffixHash(const SuffixHashType type, const char* key, const int keylen) {
+    switch (type) {
+    case kHashCRC32C:
+	return CRC32CHash(key, keylen, kSuffixHashSeed);
+    case kHashMultiply:
+	return MultiplyHash(key, keylen, kSuffixHashSeed);
+    default:
+	return Hash(key, keylen, kSuffixHashSeed);
+    }
+}
+
+inline uint32_t suffixHash(const SuffixHashType type, const std::string &key) {
+    return suffixHash(type, key.c_str(), key.size());
 }
 
 } // namespace surf
@@ -0,0 +1,183 @@
+#ifndef KEYFILE_H_
+#define KEYFILE_H_
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf {
+
+enum KeyFileFormat {
+    kKeysNewline = 0,       // one key per line; keys must not contain '\n'
+    kKeysLengthPrefixed = 1 // uint32_t length (host byte order), then the key bytes
+};
+
+// Reads a (sorted) key file through a read-only mapping, one key at a
+// time. Pages behind the read position are dropped every kReleaseSize
+// bytes, so scanning a file much larger than memory keeps only a small
+// window of it resident.
+//
+// For random access, index() builds an offset table of the keys; they
+// are then read in place with keyData/keyLen, without a string per key.
+class KeyFile {
+public:
+    static const uint64_t kReleaseSize = (1 << 24);
+
+    KeyFile() : data_(nullptr), size_(0), pos_(0), released_(0), format_(kKeysNewline) {};
+
+    ~KeyFile() {
+	close();
+    }
+
+    bool open(const std::string& path, const KeyFileFormat format);
+    void close();
+
+    // Copies the next key into key; returns false at the end of the
+    // file (a truncated length-prefixed record also ends it).
+    bool next(std::string& key);
+
+    uint64_t size() const {
+	return size_;
+    }
+
+    // Builds the offset table of the first max_keys keys, ending at the
+    // same place as next(), and returns the number of keys indexed.
+    // The mapping is then advised for normal, not sequential, access.
+    uint64_t index(const uint64_t max_keys);
+
+    uint64_t numKeys() const {
+	return (offsets_.empty() ? 0 : (offsets_.size() - 1));
+    }
+
+    // Key i (< numKeys()) in place
+    const char* keyData(const uint64_t i) const {
+	return data_ + offsets_[i];
+    }
+
+    uint64_t keyLen(const uint64_t i) const {
+	return offsets_[i + 1] - offsets_[i] - separatorSize();
+    }
+
+private:
+    void release();
+    // bytes between the end of a key and the start of the next one
+    uint64_t separatorSize() const {
+	return ((format_ == kKeysNewline) ? 1 : sizeof(uint32_t));
+    }
+
+    char* data_;
+    uint64_t size_;
+    uint64_t pos_;
+    uint64_t released_;
+    KeyFileFormat format_;
+    // start of each indexed key, then that of a key after the last one
+    std::vector<uint64_t> offsets_;
+};
+
+bool KeyFile::open(const std::string& path, const KeyFileFormat format) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+	return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+	::close(fd);
+	return false;
+    }
+    format_ = format;
+    size_ = st.st_size;
+    if (size_ > 0) {
+	void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+	    ::close(fd);
+	    size_ = 0;
+	    return false;
+	}
+	data_ = reinterpret_cast<char*>(addr);
+	madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    return true;
+}
+
+void KeyFile::close() {
+    if (data_ != nullptr)
+	munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+    pos_ = 0;
+    released_ = 0;
+    offsets_.clear();
+}
+
+bool KeyFile::next(std::string& key) {
+    if (pos_ >= size_)
+	return false;
+    if (format_ == kKeysNewline) {
+	const char* start = data_ + pos_;
+	const char* end = reinterpret_cast<const char*>(memchr(start, '\n', size_ - pos_));
+	uint64_t len = (end == nullptr) ? (size_ - pos_) : (end - start);
+	key.assign(start, len);
+	pos_ += len + 1;
+    } else {
+	uint32_t len;
+	if (pos_ + sizeof(len) > size_)
+	    return false;
+	memcpy(&len, data_ + pos_, sizeof(len));
+	if (pos_ + sizeof(len) + len > size_)
+	    return false;
+	key.assign(data_ + pos_ + sizeof(len), len);
+	pos_ += sizeof(len) + len;
+    }
+    if (pos_ - released_ >= kReleaseSize)
+	release();
+    return true;
+}
+
+uint64_t KeyFile::index(const uint64_t max_keys) {
+    offsets_.clear();
+    uint64_t pos = 0;
+    while ((offsets_.size() < max_keys) && (pos < size_)) {
+	if (format_ == kKeysNewline) {
+	    const char* start = data_ + pos;
+	    const char* end = reinterpret_cast<const char*>(memchr(start, '\n', size_ - pos));
+	    uint64_t len = (end == nullptr) ? (size_ - pos) : (end - start);
+	    offsets_.push_back(pos);
+	    pos += len + 1;
+	} else {
+	    uint32_t len;
+	    if (pos + sizeof(len) > size_)
+		break;
+	    memcpy(&len, data_ + pos, sizeof(len));
+	    if (pos + sizeof(len) + len > size_)
+		break;
+	    offsets_.push_back(pos + sizeof(len));
+	    pos += sizeof(len) + len;
+	}
+    }
+    if (offsets_.empty())
+	return 0;
+    offsets_.push_back((format_ == kKeysNewline) ? pos : (pos + sizeof(uint32_t)));
+    madvise(data_, size_, MADV_NORMAL);
+    return numKeys();
+}
+
+void KeyFile::release() {
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t end = pos_ & ~(page_size - 1);
+    if (end <= released_)
+	return;
+    madvise(data_ + released_, end - released_, MADV_DONTNEED);
+    released_ = end;
+}
+
+} // namespace surf
+
+#endif // KEYFILE_H_
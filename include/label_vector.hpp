@@ -6,12 +6,14 @@
 #include <vector>
 
 #include "config.hpp"
+#include "serial_sink.hpp"
+#include "stats.hpp"
 
 namespace surf {
 
 class LabelVector {
 public:
-    LabelVector() : num_bytes_(0), labels_(nullptr) {};
+    LabelVector() : num_bytes_(0), labels_(nullptr), aliased_(false) {};
 
     LabelVector(const std::vector<std::vector<label_t> >& labels_per_level,
 		const level_t start_level = 0,
@@ -19,23 +21,23 @@ public:
 	if (end_level == 0)
 	    end_level = labels_per_level.size();
 
+	aliased_ = false;
 	num_bytes_ = 1;
 	for (level_t level = start_level; level < end_level; level++)
 	    num_bytes_ += labels_per_level[level].size();
 
-	//labels_ = new label_t[num_bytes_];
-	position_t alloc_bytes = num_bytes_ * (num_bytes_ / kWordSize + 1);
+	// simdSearch may read up to kSimdPadding bytes past the last label
+	position_t alloc_bytes = num_bytes_ + kSimdPadding;
 	labels_ = new label_t[alloc_bytes];
-	for (position_t i = 0; i < alloc_bytes; i++)
-	  labels_[i] = 0;
 
 	position_t pos = 0;
 	for (level_t level = start_level; level < end_level; level++) {
-	    for (position_t idx = 0; idx < labels_per_level[level].size(); idx++) {
-		labels_[pos] = labels_per_level[level][idx];
-		pos++;
-	    }
+	    position_t level_size = labels_per_level[level].size();
+	    if (level_size > 0)
+		memcpy(labels_ + pos, labels_per_level[level].data(), level_size);
+	    pos += level_size;
 	}
+	memset(labels_ + pos, 0, alloc_bytes - pos);
     }
 
     ~LabelVector() {}
@@ -62,6 +64,10 @@ public:
 	return labels_[pos];
     }
 
+    void prefetch(const position_t pos) const {
+	__builtin_prefetch(labels_ + pos);
+    }
+
     bool search(const label_t target, position_t& pos, const position_t search_len) const;
     bool searchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const;
 
@@ -72,36 +78,48 @@ public:
     bool binarySearchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const;
     bool linearSearchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const;
 
+    void serialize(SerialSink& sink) const {
+	sink.write(&num_bytes_, sizeof(num_bytes_));
+	sink.write(labels_, num_bytes_);
+	sink.align();
+    }
+
     void serialize(char*& dst) const {
-	memcpy(dst, &num_bytes_, sizeof(num_bytes_));
-	dst += sizeof(num_bytes_);
-	memcpy(dst, labels_, num_bytes_);
-	dst += num_bytes_;
-	align(dst);
+	BufferSink sink(dst);
+	serialize(sink);
+	dst = sink.position();
     }
     
-    static LabelVector* deSerialize(char*& src) {
+    // See BitvectorRank::deSerialize for alias.
+    static LabelVector* deSerialize(char*& src, const bool alias = false) {
 	LabelVector* lv = new LabelVector();
 	memcpy(&(lv->num_bytes_), src, sizeof(lv->num_bytes_));
 	src += sizeof(lv->num_bytes_);
 	
-	lv->labels_ = new label_t[lv->num_bytes_];
-	memcpy(lv->labels_, src, lv->num_bytes_);
+	if (alias) {
+	    lv->aliased_ = true;
+	    lv->labels_ = reinterpret_cast<label_t*>(src);
+	} else {
+	    lv->labels_ = new label_t[lv->num_bytes_ + kSimdPadding];
+	    memcpy(lv->labels_, src, lv->num_bytes_);
+	    memset(lv->labels_ + lv->num_bytes_, 0, kSimdPadding);
+	}
 	src += lv->num_bytes_;
-	
-	//lv->labels_ = const_cast<label_t*>(reinterpret_cast<const label_t*>(src));
-	//src += lv->num_bytes_;
 	align(src);
 	return lv;
     }
 
     void destroy() {
-	delete[] labels_;	
+	if (!aliased_)
+	    delete[] labels_;
     }
 
 private:
+    static const position_t kSimdPadding = 16;
+
     position_t num_bytes_;
     label_t* labels_;
+    bool aliased_; // labels_ points into a serialized buffer
 };
 
 bool LabelVector::search(const label_t target, position_t& pos, position_t search_len) const {
@@ -111,12 +129,17 @@ bool LabelVector::search(const label_t target, position_t& pos, position_t searc
 	search_len--;
     }
 
-    if (search_len < 3)
+    if (search_len < 3) {
+	SURF_STAT_INC(kStatSearchLinear);
 	return linearSearch(target, pos, search_len);
-    if (search_len < 12)
+    }
+    if (search_len < 12) {
+	SURF_STAT_INC(kStatSearchBinary);
 	return binarySearch(target, pos, search_len);
-    else
+    } else {
+	SURF_STAT_INC(kStatSearchSimd);
 	return simdSearch(target, pos, search_len);
+    }
 }
 
 bool LabelVector::searchGreaterThan(const label_t target, position_t& pos, position_t search_len) const {
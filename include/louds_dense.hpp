@@ -4,8 +4,11 @@
 #include <string>
 
 #include "config.hpp"
+#include "louds_sparse.hpp"
 #include "rank.hpp"
+#include "serial_sink.hpp"
 #include "suffix.hpp"
+#include "trace.hpp"
 #include "surf_builder.hpp"
 
 namespace surf {
@@ -42,6 +45,9 @@ public:
 	int getSuffix(word_t* suffix) const;
 	std::string getKeyWithSuffix(unsigned* bitlen) const;
 	position_t getSendOutNodeNum() const { return send_out_node_num_; };
+	// Levels of the current path that a search for key passes through
+	// unchanged (see LoudsDense::moveToKeyGreaterThan)
+	level_t matchedLevels(const std::string& key) const;
 
 	void setToFirstLabelInRoot();
 	void setToLastLabelInRoot();
@@ -51,6 +57,8 @@ public:
 	void operator --(int);
 
     private:
+	// keeps the first key_len levels and resets the search state
+	void truncate(const level_t key_len);
 	inline void append(position_t pos);
 	inline void set(level_t level, position_t pos);
 	inline void setSendOutNodeNum(position_t node_num) { send_out_node_num_ = node_num; };
@@ -79,6 +87,20 @@ public:
 	friend class LoudsDense;
     };
 
+    // One boundary of approxCount, split into the per-level positions
+    // and rank terms it contributes as the left and as the right end of
+    // an interval, so that a boundary shared by two neighboring
+    // intervals is extended and ranked once (see approxCountBoundary).
+    struct CountBoundary {
+	std::vector<position_t> path; // searched, then leftmost positions
+	level_t path_len; // searched levels of path
+	std::vector<position_t> left_pos; // kMaxPos ends the count
+	std::vector<position_t> left_terms;
+	std::vector<position_t> right_pos;
+	std::vector<position_t> right_terms;
+	position_t out_node_num;
+    };
+
 public:
     LoudsDense() {};
     LoudsDense(const SuRFBuilder* builder);
@@ -87,58 +109,137 @@ public:
 
     // Returns whether key exists in the trie so far
     // out_node_num == 0 means search terminates in louds-dense.
-    bool lookupKey(const std::string& key, position_t& out_node_num) const;
+    // key_hash: optional precomputed hashKey(key)
+    bool lookupKey(const std::string& key, position_t& out_node_num,
+		   const uint32_t* key_hash = nullptr) const;
+    uint32_t hashKey(const std::string& key) const { return suffixes_->hashKey(key); };
+    // One level of lookupKey, so that lookups in several tries can be
+    // interleaved. Start with level = 0 and node_num = 0; returns true
+    // once the lookup finished in louds-dense (answer in result).
+    // Otherwise level/node_num advance to the child node, whose bitmap
+    // words are prefetched; at level == getHeight(), node_num is the
+    // louds-dense lookupKey's out_node_num.
+    bool lookupKeyStep(const std::string& key, level_t& level, position_t& node_num,
+		       bool& result, const uint32_t* key_hash = nullptr) const;
     // return value indicates potential false positive
+    // num_kept: levels of iter's current path kept from an earlier
+    // search, at most iter.matchedLevels(key); 0 searches from the root
     bool moveToKeyGreaterThan(const std::string& key, 
-			      const bool inclusive, LoudsDense::Iter& iter) const;
+			      const bool inclusive, LoudsDense::Iter& iter,
+			      const level_t num_kept = 0) const;
     uint64_t approxCount(const LoudsDense::Iter* iter_left,
 			 const LoudsDense::Iter* iter_right,
 			 position_t& out_node_num_left,
 			 position_t& out_node_num_right) const;
+    // approxCount(left iter, right iter) ==
+    // approxCount(boundary of left iter, boundary of right iter).
+    // A non-empty boundary is the previous one of a sweep and is
+    // updated in place: the levels its path shares with iter's keep
+    // their terms
+    void approxCountBoundary(const LoudsDense::Iter* iter,
+			     LoudsDense::CountBoundary& boundary) const;
+    uint64_t approxCount(const LoudsDense::CountBoundary& left,
+			 const LoudsDense::CountBoundary& right) const;
+    // Keys in the subtries of nodes [node_begin, node_end) of level,
+    // continued into louds_sparse below the last dense level (where
+    // level == getHeight() counts in louds_sparse only)
+    uint64_t countKeys(const level_t level, const position_t node_begin,
+		       const position_t node_end, const LoudsSparse* louds_sparse) const;
+    // Descends to the k-th key (from 0) of the trie and appends its
+    // labels to key. Returns true if the key ends in louds-dense;
+    // otherwise k is left as the rank of the key within sparse node
+    // out_node_num. k must be less than countKeys(0, 0, 1, louds_sparse).
+    bool selectKey(uint64_t& k, std::string& key, position_t& out_node_num,
+		   const LoudsSparse* louds_sparse) const;
+    // lookupKey that also adds to id the number of keys before key
+    // (up to out_node_num, where louds-sparse continues)
+    bool leafId(const std::string& key, position_t& out_node_num, uint64_t& id,
+		const LoudsSparse* louds_sparse, const uint32_t* key_hash = nullptr) const;
 
     uint64_t getHeight() const { return height_; };
-    uint64_t serializedSize() const;
+    // include_luts: see BitvectorRank::serializedSize
+    uint64_t serializedSize(const bool include_luts = true) const;
     uint64_t getMemoryUsage() const;
 
+    void serialize(SerialSink& sink, const bool include_luts = true) const {
+	sink.write(&height_, sizeof(height_));
+	sink.write(level_cuts_, sizeof(position_t) * height_);
+	sink.align();
+	label_bitmaps_->serialize(sink, include_luts);
+	child_indicator_bitmaps_->serialize(sink, include_luts);
+	prefixkey_indicator_bits_->serialize(sink, include_luts);
+	suffixes_->serialize(sink);
+	sink.align();
+    }
+
     void serialize(char*& dst) const {
-	memcpy(dst, &height_, sizeof(height_));
-	dst += sizeof(height_);
-	memcpy(dst, level_cuts_, sizeof(position_t) * height_);
-	dst += (sizeof(position_t) * height_);
-	align(dst);
-	label_bitmaps_->serialize(dst);
-	child_indicator_bitmaps_->serialize(dst);
-	prefixkey_indicator_bits_->serialize(dst);
-	suffixes_->serialize(dst);
-	align(dst);
-    }
-
-    static LoudsDense* deSerialize(char*& src) {
+	BufferSink sink(dst);
+	serialize(sink);
+	dst = sink.position();
+    }
+
+    // Sections: header (height, level cuts), label bitmaps, child
+    // indicator bitmaps, prefix key indicator bits, suffixes. serialize
+    // writes them back to back; sectionSizes reports their sizes in
+    // that order.
+    static const int kNumSections = 5;
+    void sectionSizes(uint64_t* sizes, const bool include_luts = true) const;
+
+    // sections[i] points to the start of section i; see
+    // LoudsSparse::deSerialize for alias and has_luts
+    static LoudsDense* deSerialize(char* const* sections, const bool alias,
+				   const bool has_luts = true) {
+	char* src = sections[0];
 	LoudsDense* louds_dense = new LoudsDense();
 	memcpy(&(louds_dense->height_), src, sizeof(louds_dense->height_));
 	src += sizeof(louds_dense->height_);
 	louds_dense->level_cuts_ = new position_t[louds_dense->height_];
 	memcpy(louds_dense->level_cuts_, src,
 	       sizeof(position_t) * (louds_dense->height_));
-	src += (sizeof(position_t) * (louds_dense->height_));
-	align(src);
-	louds_dense->label_bitmaps_ = BitvectorRank::deSerialize(src);
-	louds_dense->child_indicator_bitmaps_ = BitvectorRank::deSerialize(src);
-	louds_dense->prefixkey_indicator_bits_ = BitvectorRank::deSerialize(src);
-	louds_dense->suffixes_ = BitvectorSuffix::deSerialize(src);
-	align(src);
+	src = sections[1];
+	louds_dense->label_bitmaps_ = BitvectorRank::deSerialize(src, alias, has_luts);
+	src = sections[2];
+	louds_dense->child_indicator_bitmaps_ = BitvectorRank::deSerialize(src, alias, has_luts);
+	src = sections[3];
+	louds_dense->prefixkey_indicator_bits_ = BitvectorRank::deSerialize(src, alias, has_luts);
+	src = sections[4];
+	louds_dense->suffixes_ = BitvectorSuffix::deSerialize(src, alias);
 	return louds_dense;
     }
 
     void destroy() {
+	delete[] level_cuts_;
 	label_bitmaps_->destroy();
+	delete label_bitmaps_;
 	child_indicator_bitmaps_->destroy();
+	delete child_indicator_bitmaps_;
 	prefixkey_indicator_bits_->destroy();
+	delete prefixkey_indicator_bits_;
 	suffixes_->destroy();
+	delete suffixes_;
     }
 
 private:
     position_t getChildNodeNum(const position_t pos) const;
+    // countKeys for the label positions [pos_begin, pos_end) of level
+    uint64_t countKeysAt(level_t level, position_t pos_begin, position_t pos_end,
+			 const LoudsSparse* louds_sparse) const;
+    // countKeysAt(level, left[0], pos_end), reusing and extending the
+    // starts of the subtries on the levels below in left (as
+    // LoudsSparse::countKeysBetween, into which it continues); right
+    // receives their ends
+    uint64_t countKeysBetween(level_t level, std::vector<position_t>& left,
+			      position_t pos_end, std::vector<position_t>& right,
+			      const LoudsSparse* louds_sparse) const;
+    // Keys of level before label position pos: leaf labels and the
+    // prefix keys of the nodes before pos's node (and of that node
+    // too if with_prefix_key)
+    uint64_t leafRank(const level_t level, const position_t pos,
+		      const bool with_prefix_key) const;
+    // leafRank of level plus that of every level below it, down into
+    // louds_sparse, at the first node under a label from pos on
+    uint64_t countKeysBefore(level_t level, position_t pos, bool with_prefix_key,
+			     const LoudsSparse* louds_sparse) const;
     position_t getSuffixPos(const position_t pos, const bool is_prefix_key) const;
     position_t getNextPos(const position_t pos) const;
     position_t getPrevPos(const position_t pos, bool* is_out_of_bound) const;
@@ -151,7 +252,6 @@ private:
 
 private:
     static const position_t kNodeFanout = 256;
-    static const position_t kRankBasicBlockSize  = 512;
 
     level_t height_;
     position_t* level_cuts_; // position of the last bit at each level
@@ -197,30 +297,40 @@ LoudsDense::LoudsDense(const SuRFBuilder* builder) {
 	suffixes_ = new BitvectorSuffix(builder->getSuffixType(), 
 					hash_suffix_len, real_suffix_len,
                                         builder->getSuffixes(),
-					num_suffix_bits_per_level, 0, height_);
+					num_suffix_bits_per_level, 0, height_,
+					builder->getSuffixHashType());
     }
 }
 
-bool LoudsDense::lookupKey(const std::string& key, position_t& out_node_num) const {
+bool LoudsDense::lookupKey(const std::string& key, position_t& out_node_num,
+			   const uint32_t* key_hash) const {
+    SURF_TRACE_PHASE(kPhaseDense);
     position_t node_num = 0;
     position_t pos = 0;
     for (level_t level = 0; level < height_; level++) {
+	SURF_STAT_INC(kStatLevels);
 	pos = (node_num * kNodeFanout);
 	if (level >= key.length()) { //if run out of searchKey bytes
-	    if (prefixkey_indicator_bits_->readBit(node_num)) //if the prefix is also a key
-		return suffixes_->checkEquality(getSuffixPos(pos, true), key, level + 1);
-	    else
-		return false;
+	    if (prefixkey_indicator_bits_->readBit(node_num)) { //if the prefix is also a key
+		SURF_STAT_INC(kStatDenseLeaves);
+		return suffixes_->checkEquality(getSuffixPos(pos, true), key, level + 1, key_hash);
+	    }
+	    SURF_STAT_INC(kStatDenseMisses);
+	    return false;
 	}
 	pos += (label_t)key[level];
 
 	//child_indicator_bitmaps_->prefetch(pos);
 
-	if (!label_bitmaps_->readBit(pos)) //if key byte does not exist
+	if (!label_bitmaps_->readBit(pos)) { //if key byte does not exist
+	    SURF_STAT_INC(kStatDenseMisses);
 	    return false;
+	}
 
-	if (!child_indicator_bitmaps_->readBit(pos)) //if trie branch terminates
-	    return suffixes_->checkEquality(getSuffixPos(pos, false), key, level + 1);
+	if (!child_indicator_bitmaps_->readBit(pos)) { //if trie branch terminates
+	    SURF_STAT_INC(kStatDenseLeaves);
+	    return suffixes_->checkEquality(getSuffixPos(pos, false), key, level + 1, key_hash);
+	}
 
 	node_num = getChildNodeNum(pos);
     }
@@ -229,11 +339,55 @@ bool LoudsDense::lookupKey(const std::string& key, position_t& out_node_num) con
     return true;
 }
 
+bool LoudsDense::lookupKeyStep(const std::string& key, level_t& level, position_t& node_num,
+			       bool& result, const uint32_t* key_hash) const {
+    assert(level < height_);
+    SURF_STAT_INC(kStatLevels);
+    position_t pos = (node_num * kNodeFanout);
+    if (level >= key.length()) { //if run out of searchKey bytes
+	if (prefixkey_indicator_bits_->readBit(node_num)) { //if the prefix is also a key
+	    SURF_STAT_INC(kStatDenseLeaves);
+	    result = suffixes_->checkEquality(getSuffixPos(pos, true), key, level + 1, key_hash);
+	} else {
+	    SURF_STAT_INC(kStatDenseMisses);
+	    result = false;
+	}
+	return true;
+    }
+    pos += (label_t)key[level];
+
+    if (!label_bitmaps_->readBit(pos)) { //if key byte does not exist
+	SURF_STAT_INC(kStatDenseMisses);
+	result = false;
+	return true;
+    }
+
+    if (!child_indicator_bitmaps_->readBit(pos)) { //if trie branch terminates
+	SURF_STAT_INC(kStatDenseLeaves);
+	result = suffixes_->checkEquality(getSuffixPos(pos, false), key, level + 1, key_hash);
+	return true;
+    }
+
+    node_num = getChildNodeNum(pos);
+    level++;
+    if ((level < height_) && (level < key.length())) {
+	pos = (node_num * kNodeFanout) + (label_t)key[level];
+	label_bitmaps_->prefetch(pos);
+	child_indicator_bitmaps_->prefetch(pos);
+    }
+    return false;
+}
+
 bool LoudsDense::moveToKeyGreaterThan(const std::string& key, 
-				      const bool inclusive, LoudsDense::Iter& iter) const {
+				      const bool inclusive, LoudsDense::Iter& iter,
+				      const level_t num_kept) const {
+    SURF_TRACE_PHASE(kPhaseDense);
     position_t node_num = 0;
     position_t pos = 0;
-    for (level_t level = 0; level < height_; level++) {
+    iter.truncate(num_kept);
+    if (num_kept > 0)
+	node_num = getChildNodeNum(iter.pos_in_trie_[num_kept - 1]);
+    for (level_t level = num_kept; level < height_; level++) {
 	// if is_at_prefix_key_, pos is at the next valid position in the child node
 	pos = node_num * kNodeFanout;
 	if (level >= key.length()) { // if run out of searchKey bytes
@@ -299,6 +453,7 @@ uint64_t LoudsDense::approxCount(const LoudsDense::Iter* iter_left,
 				 const LoudsDense::Iter* iter_right,
 				 position_t& out_node_num_left,
 				 position_t& out_node_num_right) const {
+    SURF_TRACE_PHASE(kPhaseDense);
     std::vector<position_t> left_pos_list, right_pos_list;
     for (level_t i = 0; i < iter_left->key_len_; i++)
 	left_pos_list.push_back(iter_left->pos_in_trie_[i]);
@@ -362,18 +517,298 @@ uint64_t LoudsDense::approxCount(const LoudsDense::Iter* iter_left,
     return count;
 }
 
-uint64_t LoudsDense::serializedSize() const {
+void LoudsDense::approxCountBoundary(const LoudsDense::Iter* iter,
+				     LoudsDense::CountBoundary& boundary) const {
+    SURF_TRACE_PHASE(kPhaseDense);
+    if (height_ == 0) { // the sparse root
+	boundary.out_node_num = 0;
+	return;
+    }
+    level_t ori_len = iter->key_len_;
+    level_t prev_len = height_; // no previous path to meet
+    level_t level = 0;
+    if (boundary.path.empty()) {
+	boundary.path.resize(height_);
+	boundary.left_pos.resize(height_);
+	boundary.left_terms.resize(height_);
+	boundary.right_pos.resize(height_);
+	boundary.right_terms.resize(height_);
+    } else {
+	// above both paths' last searched levels, the terms only depend
+	// on the position
+	prev_len = boundary.path_len;
+	while ((level + 1 < ori_len) && (level + 1 < prev_len)
+	       && (boundary.path[level] == iter->pos_in_trie_[level]))
+	    level++;
+    }
+    boundary.path_len = ori_len;
+    for (level_t i = level; i < ori_len; i++)
+	boundary.path[i] = iter->pos_in_trie_[i];
+
+    // extend leftmost, as extendPosList, until the path meets the
+    // previous one's extension; both are the same from there on
+    level_t end_level = height_;
+    position_t path_pos = boundary.path[ori_len - 1];
+    for (level_t i = ori_len; i < height_; i++) {
+	if (path_pos != kMaxPos) {
+	    position_t node_num = getChildNodeNum(path_pos);
+	    if (!child_indicator_bitmaps_->readBit(path_pos))
+		node_num++;
+	    path_pos = (node_num * kNodeFanout);
+	    if (path_pos > level_cuts_[i])
+		path_pos = kMaxPos;
+	}
+	if ((i >= prev_len) && (boundary.path[i] == path_pos)) {
+	    end_level = i;
+	    break;
+	}
+	boundary.path[i] = path_pos;
+    }
+    if (end_level == height_) {
+	if (path_pos == kMaxPos) {
+	    boundary.out_node_num = path_pos;
+	} else {
+	    boundary.out_node_num = getChildNodeNum(path_pos);
+	    if (!child_indicator_bitmaps_->readBit(path_pos))
+		boundary.out_node_num++;
+	}
+    }
+
+    // the terms of approxCount(iter_left, iter_right), by side:
+    // num_leafs = right term - left term
+    for (level_t i = level; i < end_level; i++) {
+	position_t left_pos = boundary.path[i];
+	position_t left_term = 0;
+	if (left_pos != kMaxPos) {
+	    if (i == (ori_len - 1) && iter->is_at_prefix_key_)
+		left_pos = (left_pos / kNodeFanout) * kNodeFanout;
+	    position_t pos = left_pos;
+	    if (i >= ori_len)
+		pos = getNextPos(pos);
+	    left_term = label_bitmaps_->rank(pos) - child_indicator_bitmaps_->rank(pos)
+		+ prefixkey_indicator_bits_->rank(pos / kNodeFanout);
+	    if (child_indicator_bitmaps_->readBit(pos))
+		left_term++;
+	    if (i >= ori_len && prefixkey_indicator_bits_->readBit(pos / kNodeFanout))
+		left_term--;
+	    if (iter->is_search_complete_ && (i == ori_len - 1))
+		left_term++;
+	}
+	boundary.left_pos[i] = left_pos;
+	boundary.left_terms[i] = left_term;
+
+	position_t right_pos = boundary.path[i];
+	if (right_pos == kMaxPos)
+	    right_pos = level_cuts_[i];
+	if (i == (ori_len - 1) && iter->is_at_prefix_key_)
+	    right_pos = (right_pos / kNodeFanout) * kNodeFanout;
+	boundary.right_pos[i] = right_pos;
+	if (i >= ori_len && right_pos != level_cuts_[height_ - 1])
+	    right_pos = getNextPos(right_pos);
+	position_t right_term = label_bitmaps_->rank(right_pos)
+	    - child_indicator_bitmaps_->rank(right_pos)
+	    + prefixkey_indicator_bits_->rank(right_pos / kNodeFanout);
+	if (right_pos == level_cuts_[height_ - 1])
+	    right_term++;
+	if (child_indicator_bitmaps_->readBit(right_pos))
+	    right_term++;
+	if (i >= ori_len && prefixkey_indicator_bits_->readBit(right_pos / kNodeFanout))
+	    right_term--;
+	boundary.right_terms[i] = right_term;
+    }
+}
+
+uint64_t LoudsDense::approxCount(const LoudsDense::CountBoundary& left,
+				 const LoudsDense::CountBoundary& right) const {
+    uint64_t count = 0;
+    for (level_t i = 0; i < height_; i++) {
+	if (left.left_pos[i] == kMaxPos) break;
+	if (left.left_pos[i] < right.right_pos[i])
+	    count += (position_t)(right.right_terms[i] - left.left_terms[i]);
+    }
+    return count;
+}
+
+uint64_t LoudsDense::countKeys(const level_t level, const position_t node_begin,
+			       const position_t node_end,
+			       const LoudsSparse* louds_sparse) const {
+    if (level >= height_)
+	return louds_sparse->countKeys(node_begin, node_end);
+    uint64_t count = prefixkey_indicator_bits_->rankBefore(node_end)
+	- prefixkey_indicator_bits_->rankBefore(node_begin);
+    return count + countKeysAt(level, node_begin * kNodeFanout, node_end * kNodeFanout,
+			       louds_sparse);
+}
+
+// Keys end at labels without children and at prefix keys; the children
+// of a range of labels are a range of nodes at the next level
+uint64_t LoudsDense::countKeysAt(level_t level, position_t pos_begin, position_t pos_end,
+				 const LoudsSparse* louds_sparse) const {
+    uint64_t count = 0;
+    while (pos_begin < pos_end) {
+	position_t child_begin = child_indicator_bitmaps_->rankBefore(pos_begin);
+	position_t child_end = child_indicator_bitmaps_->rankBefore(pos_end);
+	count += (label_bitmaps_->rankBefore(pos_end) - label_bitmaps_->rankBefore(pos_begin))
+	    - (child_end - child_begin);
+	level++;
+	// child node numbers start from 1 (the root is node 0)
+	if (level >= height_)
+	    return count + louds_sparse->countKeys(child_begin + 1, child_end + 1);
+	count += prefixkey_indicator_bits_->rankBefore(child_end + 1)
+	    - prefixkey_indicator_bits_->rankBefore(child_begin + 1);
+	pos_begin = (child_begin + 1) * kNodeFanout;
+	pos_end = (child_end + 1) * kNodeFanout;
+    }
+    return count;
+}
+
+bool LoudsDense::selectKey(uint64_t& k, std::string& key, position_t& out_node_num,
+			   const LoudsSparse* louds_sparse) const {
+    // as LoudsSparse::selectKey: lo_bounds are where the subtries of
+    // the labels from lo on start at lo's level and the ones below
+    std::vector<position_t> lo_bounds(1, 0);
+    std::vector<position_t> mid_bounds;
+    position_t node_num = 0;
+    for (level_t level = 0; level < height_; level++) {
+	// the prefix key sorts before the node's labels
+	if (prefixkey_indicator_bits_->readBit(node_num)) {
+	    if (k == 0)
+		return true;
+	    k--;
+	}
+	position_t lo = lo_bounds[0];
+	position_t hi = lo + kNodeFanout - 1;
+	while (lo < hi) {
+	    position_t mid = lo + (hi - lo) / 2;
+	    uint64_t count = countKeysBetween(level, lo_bounds, mid + 1, mid_bounds,
+					      louds_sparse);
+	    if (count > k) {
+		hi = mid;
+	    } else {
+		k -= count;
+		lo = mid + 1;
+		lo_bounds.swap(mid_bounds);
+	    }
+	}
+	key.push_back((char)(lo % kNodeFanout));
+	if (!child_indicator_bitmaps_->readBit(lo))
+	    return true;
+	node_num = getChildNodeNum(lo);
+	// lo's subtrie starts with its child node
+	lo_bounds.erase(lo_bounds.begin());
+	if (lo_bounds.empty())
+	    lo_bounds.push_back(node_num * kNodeFanout);
+    }
+    out_node_num = node_num;
+    return false;
+}
+
+uint64_t LoudsDense::countKeysBetween(level_t level, std::vector<position_t>& left,
+				      position_t pos_end, std::vector<position_t>& right,
+				      const LoudsSparse* louds_sparse) const {
+    right.clear();
+    uint64_t count = 0;
+    position_t pos_begin = left[0];
+    for (size_t i = 1; ; i++) {
+	right.push_back(pos_end);
+	position_t child_begin = child_indicator_bitmaps_->rankBefore(pos_begin);
+	position_t child_end = child_indicator_bitmaps_->rankBefore(pos_end);
+	count += (label_bitmaps_->rankBefore(pos_end) - label_bitmaps_->rankBefore(pos_begin))
+	    - (child_end - child_begin);
+	if (child_begin == child_end)
+	    return count;
+	level++;
+	// child node numbers start from 1 (the root is node 0)
+	if (level >= height_) {
+	    if (i == left.size())
+		left.push_back(louds_sparse->getNodeStartPos(child_begin + 1));
+	    return count + louds_sparse->countKeysBetween(
+		left, i, louds_sparse->getNodeStartPos(child_end + 1), right);
+	}
+	count += prefixkey_indicator_bits_->rankBefore(child_end + 1)
+	    - prefixkey_indicator_bits_->rankBefore(child_begin + 1);
+	if (i == left.size())
+	    left.push_back((child_begin + 1) * kNodeFanout);
+	pos_begin = left[i];
+	pos_end = (child_end + 1) * kNodeFanout;
+    }
+}
+
+// The keys before key are, at each level, the leaves before the
+// position where key's path crosses that level
+bool LoudsDense::leafId(const std::string& key, position_t& out_node_num, uint64_t& id,
+			const LoudsSparse* louds_sparse, const uint32_t* key_hash) const {
+    position_t node_num = 0;
+    for (level_t level = 0; level < height_; level++) {
+	position_t pos = node_num * kNodeFanout;
+	if (level >= key.length()) {
+	    if (!prefixkey_indicator_bits_->readBit(node_num))
+		return false;
+	    id += countKeysBefore(level, pos, false, louds_sparse);
+	    return suffixes_->checkEquality(getSuffixPos(pos, true), key, level + 1, key_hash);
+	}
+	pos += (label_t)key[level];
+	if (!label_bitmaps_->readBit(pos))
+	    return false;
+	if (!child_indicator_bitmaps_->readBit(pos)) {
+	    id += countKeysBefore(level, pos, true, louds_sparse);
+	    return suffixes_->checkEquality(getSuffixPos(pos, false), key, level + 1, key_hash);
+	}
+	id += leafRank(level, pos, true);
+	node_num = getChildNodeNum(pos);
+    }
+    out_node_num = node_num;
+    return true;
+}
+
+uint64_t LoudsDense::leafRank(const level_t level, const position_t pos,
+			      const bool with_prefix_key) const {
+    position_t level_begin = (level == 0) ? 0 : (level_cuts_[level - 1] + 1);
+    position_t node_begin = level_begin / kNodeFanout;
+    position_t node_end = pos / kNodeFanout + (with_prefix_key ? 1 : 0);
+    return (label_bitmaps_->rankBefore(pos) - label_bitmaps_->rankBefore(level_begin))
+	- (child_indicator_bitmaps_->rankBefore(pos)
+	   - child_indicator_bitmaps_->rankBefore(level_begin))
+	+ (prefixkey_indicator_bits_->rankBefore(node_end)
+	   - prefixkey_indicator_bits_->rankBefore(node_begin));
+}
+
+uint64_t LoudsDense::countKeysBefore(level_t level, position_t pos, bool with_prefix_key,
+				     const LoudsSparse* louds_sparse) const {
+    uint64_t count = 0;
+    for (; level < height_; level++) {
+	count += leafRank(level, pos, with_prefix_key);
+	// the first child node of a label from pos on
+	position_t node_num = child_indicator_bitmaps_->rankBefore(pos) + 1;
+	pos = node_num * kNodeFanout;
+	with_prefix_key = false;
+	if (level + 1 == height_)
+	    return count + louds_sparse->countKeysBefore(node_num);
+    }
+    return count;
+}
+
+uint64_t LoudsDense::serializedSize(const bool include_luts) const {
     uint64_t size = sizeof(height_)
 	+ (sizeof(position_t) * height_);
     sizeAlign(size);
-    size += (label_bitmaps_->serializedSize()
-	     + child_indicator_bitmaps_->serializedSize()
-	     + prefixkey_indicator_bits_->serializedSize()
+    size += (label_bitmaps_->serializedSize(include_luts)
+	     + child_indicator_bitmaps_->serializedSize(include_luts)
+	     + prefixkey_indicator_bits_->serializedSize(include_luts)
 	     + suffixes_->serializedSize());
     sizeAlign(size);
     return size;
 }
 
+void LoudsDense::sectionSizes(uint64_t* sizes, const bool include_luts) const {
+    sizes[0] = sizeof(height_) + (sizeof(position_t) * height_);
+    sizeAlign(sizes[0]);
+    sizes[1] = label_bitmaps_->serializedSize(include_luts);
+    sizes[2] = child_indicator_bitmaps_->serializedSize(include_luts);
+    sizes[3] = prefixkey_indicator_bits_->serializedSize(include_luts);
+    sizes[4] = suffixes_->serializedSize();
+}
+
 uint64_t LoudsDense::getMemoryUsage() const {
     return (sizeof(LoudsDense)
 	    + label_bitmaps_->size()
@@ -433,6 +868,26 @@ void LoudsDense::Iter::clear() {
     is_at_prefix_key_ = false;
 }
 
+// The last level of a complete path may be a prefix key or a leaf; an
+// incomplete one continues in louds-sparse, so each level has a child
+level_t LoudsDense::Iter::matchedLevels(const std::string& key) const {
+    if (!is_valid_ || key_len_ == 0)
+	return 0;
+    level_t len = isComplete() ? (key_len_ - 1) : key_len_;
+    level_t level = 0;
+    while ((level < len) && (level < key.length())
+	   && (key_[level] == (label_t)key[level]))
+	level++;
+    return level;
+}
+
+void LoudsDense::Iter::truncate(const level_t key_len) {
+    setFlags(false, false, false, false);
+    send_out_node_num_ = 0;
+    key_len_ = key_len;
+    is_at_prefix_key_ = false;
+}
+
 int LoudsDense::Iter::compare(const std::string& key) const {
     if (is_at_prefix_key_ && (key_len_ - 1) < key.length())
 	return -1;
@@ -4,11 +4,14 @@
 #include <string>
 
 #include "config.hpp"
+#include "elias_fano.hpp"
 #include "label_vector.hpp"
 #include "rank.hpp"
 #include "select.hpp"
+#include "serial_sink.hpp"
 #include "suffix.hpp"
 #include "surf_builder.hpp"
+#include "trace.hpp"
 
 namespace surf {
 
@@ -24,6 +27,8 @@ public:
 		key_.push_back(0);
 		pos_in_trie_.push_back(0);
 	    }
+	    if (trie_->louds_encoding_ == kLoudsEliasFano)
+		node_bounds_.resize(pos_in_trie_.size());
 	}
 
 	void clear();
@@ -35,6 +40,9 @@ public:
 
 	position_t getStartNodeNum() const { return start_node_num_; };
 	void setStartNodeNum(position_t node_num) { start_node_num_ = node_num; };
+	// Levels of the current path that a search for key passes through
+	// unchanged (see LoudsSparse::moveToKeyGreaterThan)
+	level_t matchedLevels(const std::string& key) const;
 
 	void setToFirstLabelInRoot();
 	void setToLastLabelInRoot();
@@ -44,9 +52,15 @@ public:
 	void operator --(int);
 
     private:
-	void append(const position_t pos);
-	void append(const label_t label, const position_t pos);
+	// keeps the first key_len levels and resets the search state
+	void truncate(const level_t key_len);
+	void append(const position_t pos, const position_t node_num);
+	void append(const label_t label, const position_t pos, const position_t node_num);
 	void set(const level_t level, const position_t pos);
+	// whether pos is past the node at level / starts that node
+	bool isPastNode(const level_t level, const position_t pos);
+	bool isNodeStart(const level_t level, const position_t pos);
+	bool isEndofNode(const level_t level);
 
     private:
 	bool is_valid_; // True means the iter currently points to a valid key
@@ -57,11 +71,30 @@ public:
 
 	std::vector<label_t> key_;
 	std::vector<position_t> pos_in_trie_;
+	// Elias-Fano only: reading a louds bit there costs a search, so
+	// steps test the bounds of the node at each level instead
+	struct NodeBounds {
+	    position_t node_num;
+	    position_t start; // kMaxPos = not computed yet
+	    position_t end; // one past the last label; kMaxPos as above
+	};
+	std::vector<NodeBounds> node_bounds_;
 	bool is_at_terminator_;
 
 	friend class LoudsSparse;
     };
 
+    // One boundary of approxCount by level, as LoudsDense::CountBoundary
+    struct CountBoundary {
+	bool has_left; // false: counts nothing as the left end
+	std::vector<position_t> path; // searched, then leftmost positions
+	level_t path_len; // searched levels of path
+	std::vector<position_t> left_pos; // kMaxPos ends the count
+	std::vector<position_t> left_terms;
+	std::vector<position_t> right_pos;
+	std::vector<position_t> right_terms;
+    };
+
 public:
     LoudsSparse() {};
     LoudsSparse(const SuRFBuilder* builder);
@@ -70,41 +103,119 @@ public:
 
     // point query: trie walk starts at node "in_node_num" instead of root
     // in_node_num is provided by louds-dense's lookupKey function
-    bool lookupKey(const std::string& key, const position_t in_node_num) const;
+    // key_hash: optional precomputed hashKey(key)
+    bool lookupKey(const std::string& key, const position_t in_node_num,
+		   const uint32_t* key_hash = nullptr) const;
     // return value indicates potential false positive
+    // num_kept: as in LoudsDense::moveToKeyGreaterThan
     bool moveToKeyGreaterThan(const std::string& key, 
-			      const bool inclusive, LoudsSparse::Iter& iter) const;
+			      const bool inclusive, LoudsSparse::Iter& iter,
+			      const level_t num_kept = 0) const;
     uint64_t approxCount(const LoudsSparse::Iter* iter_left,
 			 const LoudsSparse::Iter* iter_right,
 			 const position_t in_node_num_left,
 			 const position_t in_node_num_right) const;
+    // approxCount(left iter, right iter, in_node_num_left, in_node_num_right) ==
+    // approxCount(boundary of left iter, boundary of right iter);
+    // a non-empty boundary is updated in place, as in louds-dense
+    void approxCountBoundary(const LoudsSparse::Iter* iter, const position_t in_node_num,
+			     LoudsSparse::CountBoundary& boundary) const;
+    uint64_t approxCount(const LoudsSparse::CountBoundary& left,
+			 const LoudsSparse::CountBoundary& right) const;
+    // Keys in the subtries of nodes [node_begin, node_end), which must
+    // be nodes of one level (node numbers count the louds-dense nodes)
+    uint64_t countKeys(const position_t node_begin, const position_t node_end) const;
+    // Appends the labels of the k-th key (from 0) under node
+    // in_node_num to key. k must be less than
+    // countKeys(in_node_num, in_node_num + 1).
+    void selectKey(uint64_t k, const position_t in_node_num, std::string& key) const;
+    // Keys in the subtries of the labels [left[i], pos_end) of one level,
+    // as countKeysAt. left[i + 1], ... are where these subtries start
+    // on the levels below, as far as known; the missing ones are
+    // appended. Where they end is appended to right, down to the last
+    // level with children in the range.
+    uint64_t countKeysBetween(std::vector<position_t>& left, size_t i,
+			      position_t pos_end, std::vector<position_t>& right) const;
+    // getFirstLabelPos, or the end of the labels past the last node
+    position_t getNodeStartPos(const position_t node_num) const;
+    // lookupKey that also adds to id the number of keys in louds-sparse
+    // before key
+    bool leafId(const std::string& key, const position_t in_node_num, uint64_t& id,
+		const uint32_t* key_hash = nullptr) const;
+    // Keys in louds-sparse before node node_num of the start level
+    // (node_num may be past that level's nodes)
+    uint64_t countKeysBefore(const position_t node_num) const;
 
     level_t getHeight() const { return height_; };
     level_t getStartLevel() const { return start_level_; };
-    uint64_t serializedSize() const;
+    LoudsEncoding getLoudsEncoding() const { return louds_encoding_; };
+    uint32_t hashKey(const std::string& key) const { return suffixes_->hashKey(key); };
+    SuffixHashType getSuffixHashType() const { return suffixes_->getHashType(); };
+    SuffixType getSuffixType() const { return suffixes_->getType(); };
+    // lookupKey split into one level per call, so that lookups in
+    // several tries can be interleaved. lookupKeyStart returns the first
+    // label position of in_node_num (and prefetches it); then call
+    // lookupKeyStep with level = getStartLevel() until it returns true,
+    // at which point result holds the lookupKey answer.
+    position_t lookupKeyStart(const position_t in_node_num) const;
+    bool lookupKeyStep(const std::string& key, level_t& level, position_t& pos,
+		       bool& result, const uint32_t* key_hash = nullptr) const;
+    // include_luts: see BitvectorRank::serializedSize
+    uint64_t serializedSize(const bool include_luts = true) const;
     uint64_t getMemoryUsage() const;
 
+    void serialize(SerialSink& sink, const bool include_luts = true) const {
+	sink.write(&height_, sizeof(height_));
+	sink.write(&start_level_, sizeof(start_level_));
+	sink.write(&node_count_dense_, sizeof(node_count_dense_));
+	sink.write(&child_count_dense_, sizeof(child_count_dense_));
+	sink.write(&louds_encoding_, sizeof(louds_encoding_));
+	sink.write(level_cuts_, sizeof(position_t) * height_);
+	sink.align();
+	labels_->serialize(sink);
+	child_indicator_bits_->serialize(sink, include_luts);
+	if (louds_encoding_ == kLoudsEliasFano)
+	    louds_ef_->serialize(sink, include_luts);
+	else
+	    louds_bits_->serialize(sink, include_luts);
+	suffixes_->serialize(sink);
+	sink.align();
+    }
+
     void serialize(char*& dst) const {
-	memcpy(dst, &height_, sizeof(height_));
-	dst += sizeof(height_);
-	memcpy(dst, &start_level_, sizeof(start_level_));
-	dst += sizeof(start_level_);
-	memcpy(dst, &node_count_dense_, sizeof(node_count_dense_));
-	dst += sizeof(node_count_dense_);
-	memcpy(dst, &child_count_dense_, sizeof(child_count_dense_));
-	dst += sizeof(child_count_dense_);
-	memcpy(dst, level_cuts_, sizeof(position_t) * height_);
-	dst += (sizeof(position_t) * height_);
-	align(dst);
-	labels_->serialize(dst);
-	child_indicator_bits_->serialize(dst);
-	louds_bits_->serialize(dst);
-	suffixes_->serialize(dst);
-	align(dst);
-    }
-
-    static LoudsSparse* deSerialize(char*& src) {
+	BufferSink sink(dst);
+	serialize(sink);
+	dst = sink.position();
+    }
+
+    // Sections: header (counts, encoding, level cuts), labels, child
+    // indicator bits, louds bits, suffixes. serialize writes them back
+    // to back; sectionSizes reports their sizes in that order.
+    static const int kNumSections = 5;
+    void sectionSizes(uint64_t* sizes, const bool include_luts = true) const;
+
+    // Writes the same bytes as LoudsSparse(builder).serialize(sink, false)
+    // straight from the builder's (possibly spilled) level vectors, so
+    // the sparse trie is never held in memory. kLoudsBitvector only.
+    // Returns false on a spill or sink error.
+    static bool serializeCompact(SerialSink& sink, const SuRFBuilder* builder);
+    // sectionSizes(sizes, false) of that trie
+    static void compactSectionSizes(const SuRFBuilder* builder, uint64_t* sizes);
+
+    // sections[i] points to the start of section i. If alias is true,
+    // the vectors point into the sections (e.g., a SuRF's arena or a
+    // mmap'ed file, whose pages are then faulted in on first access),
+    // which must outlive the object. has_luts must match the
+    // include_luts used by serialize; without LUTs, nothing is aliased,
+    // since rebuilding them reads every bit anyway.
+    static LoudsSparse* deSerialize(char* const* sections, bool alias,
+				    const bool has_luts = true) {
+	if (!has_luts)
+	    alias = false;
+	char* src = sections[0];
 	LoudsSparse* louds_sparse = new LoudsSparse();
+	louds_sparse->louds_bits_ = nullptr;
+	louds_sparse->louds_ef_ = nullptr;
 	memcpy(&(louds_sparse->height_), src, sizeof(louds_sparse->height_));
 	src += sizeof(louds_sparse->height_);
 	memcpy(&(louds_sparse->start_level_), src, sizeof(louds_sparse->start_level_));
@@ -113,36 +224,71 @@ public:
 	src += sizeof(louds_sparse->node_count_dense_);
 	memcpy(&(louds_sparse->child_count_dense_), src, sizeof(louds_sparse->child_count_dense_));
 	src += sizeof(louds_sparse->child_count_dense_);
+	memcpy(&(louds_sparse->louds_encoding_), src, sizeof(louds_sparse->louds_encoding_));
+	src += sizeof(louds_sparse->louds_encoding_);
 	louds_sparse->level_cuts_ = new position_t[louds_sparse->height_];
 	memcpy(louds_sparse->level_cuts_, src,
 	       sizeof(position_t) * (louds_sparse->height_));
-	src += (sizeof(position_t) * (louds_sparse->height_));
-	align(src);
-	louds_sparse->labels_ = LabelVector::deSerialize(src);
-	louds_sparse->child_indicator_bits_ = BitvectorRank::deSerialize(src);
-	louds_sparse->louds_bits_ = BitvectorSelect::deSerialize(src);
-	louds_sparse->suffixes_ = BitvectorSuffix::deSerialize(src);
-	align(src);
+	src = sections[1];
+	louds_sparse->labels_ = LabelVector::deSerialize(src, alias);
+	src = sections[2];
+	louds_sparse->child_indicator_bits_ = BitvectorRank::deSerialize(src, alias, has_luts);
+	src = sections[3];
+	if (louds_sparse->louds_encoding_ == kLoudsEliasFano)
+	    louds_sparse->louds_ef_ = EliasFano::deSerialize(src, alias, has_luts);
+	else
+	    louds_sparse->louds_bits_ = BitvectorSelect::deSerialize(src, alias, has_luts);
+	src = sections[4];
+	louds_sparse->suffixes_ = BitvectorSuffix::deSerialize(src, alias);
 	return louds_sparse;
     }
 
     void destroy() {
 	delete[] level_cuts_;
 	labels_->destroy();
+	delete labels_;
 	child_indicator_bits_->destroy();
-	louds_bits_->destroy();
+	delete child_indicator_bits_;
+	if (louds_encoding_ == kLoudsEliasFano)
+	    louds_ef_->destroy();
+	else
+	    louds_bits_->destroy();
+	delete louds_ef_;
+	delete louds_bits_;
 	suffixes_->destroy();
+	delete suffixes_;
     }
 
 private:
+    // Totals over the sparse levels of builder
+    static void countSparseItems(const SuRFBuilder* builder, position_t& num_items,
+				 position_t& num_nodes, position_t& num_suffix_bits);
+
     position_t getChildNodeNum(const position_t pos) const;
     position_t getFirstLabelPos(const position_t node_num) const;
     position_t getLastLabelPos(const position_t node_num) const;
     position_t getSuffixPos(const position_t pos) const;
     position_t nodeSize(const position_t pos) const;
     bool isEndofNode(const position_t pos) const;
+    // countKeys for the label positions [pos_begin, pos_end) of one level
+    uint64_t countKeysAt(position_t pos_begin, position_t pos_end) const;
+    // Keys of level before label position pos (leaves, terminators included)
+    uint64_t leafRank(const level_t level, const position_t pos) const;
+    // leafRank of level plus that of every level below it, at the first
+    // node under a label from pos on
+    uint64_t countKeysBefore(level_t level, position_t pos) const;
+
+    // louds_bits_ or louds_ef_, depending on louds_encoding_
+    position_t loudsSelect(const position_t rank) const;
+    bool loudsReadBit(const position_t pos) const;
+    position_t loudsDistanceToNextSetBit(const position_t pos) const;
+    position_t loudsNumBits() const;
+    position_t loudsNumOnes() const;
+    uint64_t loudsSerializedSize(const bool include_luts) const;
+    uint64_t loudsSize() const;
 
     void moveToLeftInNextSubtrie(position_t pos, const position_t node_size, 
+				 const position_t node_num,
 				 const label_t label, LoudsSparse::Iter& iter) const;
     // return value indicates potential false positive
     bool compareSuffixGreaterThan(const position_t pos, const std::string& key, 
@@ -158,9 +304,6 @@ private:
 		       const position_t right_in_node_num) const;
 
 private:
-    static const position_t kRankBasicBlockSize = 512;
-    static const position_t kSelectSampleInterval = 64;
-
     level_t height_; // trie height
     level_t start_level_; // louds-sparse encoding starts at this level
     // number of nodes in louds-dense encoding
@@ -171,7 +314,9 @@ private:
 
     LabelVector* labels_;
     BitvectorRank* child_indicator_bits_;
-    BitvectorSelect* louds_bits_;
+    LoudsEncoding louds_encoding_;
+    BitvectorSelect* louds_bits_; // nullptr if louds_encoding_ == kLoudsEliasFano
+    EliasFano* louds_ef_; // nullptr if louds_encoding_ == kLoudsBitvector
     BitvectorSuffix* suffixes_;
 };
 
@@ -207,8 +352,15 @@ LoudsSparse::LoudsSparse(const SuRFBuilder* builder) {
 
     child_indicator_bits_ = new BitvectorRank(kRankBasicBlockSize, builder->getChildIndicatorBits(), 
 					      num_items_per_level, start_level_, height_);
-    louds_bits_ = new BitvectorSelect(kSelectSampleInterval, builder->getLoudsBits(), 
-				      num_items_per_level, start_level_, height_);
+    louds_encoding_ = builder->getLoudsEncoding();
+    louds_bits_ = nullptr;
+    louds_ef_ = nullptr;
+    if (louds_encoding_ == kLoudsEliasFano)
+	louds_ef_ = new EliasFano(builder->getLoudsBits(), num_items_per_level,
+				  start_level_, height_);
+    else
+	louds_bits_ = new BitvectorSelect(kSelectSampleInterval, builder->getLoudsBits(), 
+					  num_items_per_level, start_level_, height_);
 
     if (builder->getSuffixType() == kNone) {
 	suffixes_ = new BitvectorSuffix();
@@ -222,47 +374,114 @@ LoudsSparse::LoudsSparse(const SuRFBuilder* builder) {
 
 	suffixes_ = new BitvectorSuffix(builder->getSuffixType(), hash_suffix_len, real_suffix_len,
                                         builder->getSuffixes(),
-					num_suffix_bits_per_level, start_level_, height_);
+					num_suffix_bits_per_level, start_level_, height_,
+					builder->getSuffixHashType());
     }
 }
 
-bool LoudsSparse::lookupKey(const std::string& key, const position_t in_node_num) const {
+bool LoudsSparse::lookupKey(const std::string& key, const position_t in_node_num,
+			    const uint32_t* key_hash) const {
+    SURF_TRACE_PHASE(kPhaseSparse);
     position_t node_num = in_node_num;
-    position_t pos = getFirstLabelPos(node_num);
+    position_t pos;
+    {
+	SURF_TRACE_PHASE(kPhaseHandoff);
+	pos = getFirstLabelPos(node_num);
+    }
     level_t level = 0;
     for (level = start_level_; level < key.length(); level++) {
+	SURF_STAT_INC(kStatLevels);
 	//child_indicator_bits_->prefetch(pos);
-	if (!labels_->search((label_t)key[level], pos, nodeSize(pos)))
+	if (!labels_->search((label_t)key[level], pos, nodeSize(pos))) {
+	    SURF_STAT_SPARSE_MISS(level);
 	    return false;
+	}
 
 	// if trie branch terminates
-	if (!child_indicator_bits_->readBit(pos))
-	    return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1);
+	if (!child_indicator_bits_->readBit(pos)) {
+	    SURF_STAT_INC(kStatSparseLeaves);
+	    return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1, key_hash);
+	}
 
 	// move to child
 	node_num = getChildNodeNum(pos);
 	pos = getFirstLabelPos(node_num);
     }
-    if ((labels_->read(pos) == kTerminator) && (!child_indicator_bits_->readBit(pos)))
-	return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1);
+    if ((labels_->read(pos) == kTerminator) && (!child_indicator_bits_->readBit(pos))) {
+	SURF_STAT_INC(kStatTerminatorHits);
+	return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1, key_hash);
+    }
+    SURF_STAT_SPARSE_MISS(level);
+    return false;
+}
+
+position_t LoudsSparse::lookupKeyStart(const position_t in_node_num) const {
+    position_t pos = getFirstLabelPos(in_node_num);
+    labels_->prefetch(pos);
+    child_indicator_bits_->prefetch(pos);
+    return pos;
+}
+
+bool LoudsSparse::lookupKeyStep(const std::string& key, level_t& level, position_t& pos,
+				bool& result, const uint32_t* key_hash) const {
+    if (level >= key.length()) {
+	if ((labels_->read(pos) == kTerminator) && (!child_indicator_bits_->readBit(pos))) {
+	    SURF_STAT_INC(kStatTerminatorHits);
+	    result = suffixes_->checkEquality(getSuffixPos(pos), key, level + 1, key_hash);
+	} else {
+	    SURF_STAT_SPARSE_MISS(level);
+	    result = false;
+	}
+	return true;
+    }
+
+    SURF_STAT_INC(kStatLevels);
+    if (!labels_->search((label_t)key[level], pos, nodeSize(pos))) {
+	SURF_STAT_SPARSE_MISS(level);
+	result = false;
+	return true;
+    }
+
+    // if trie branch terminates
+    if (!child_indicator_bits_->readBit(pos)) {
+	SURF_STAT_INC(kStatSparseLeaves);
+	result = suffixes_->checkEquality(getSuffixPos(pos), key, level + 1, key_hash);
+	return true;
+    }
+
+    // move to child
+    pos = lookupKeyStart(getChildNodeNum(pos));
+    level++;
     return false;
 }
 
 bool LoudsSparse::moveToKeyGreaterThan(const std::string& key, 
-				       const bool inclusive, LoudsSparse::Iter& iter) const {
+				       const bool inclusive, LoudsSparse::Iter& iter,
+				       const level_t num_kept) const {
+    SURF_TRACE_PHASE(kPhaseSparse);
     position_t node_num = iter.getStartNodeNum();
-    position_t pos = getFirstLabelPos(node_num);
+    position_t pos;
+    if (num_kept > 0) {
+	iter.truncate(num_kept);
+	node_num = getChildNodeNum(iter.pos_in_trie_[num_kept - 1]);
+	pos = getFirstLabelPos(node_num);
+    } else {
+	SURF_TRACE_PHASE(kPhaseHandoff);
+	pos = getFirstLabelPos(node_num);
+    }
 
     level_t level;
-    for (level = start_level_; level < key.length(); level++) {
+    for (level = start_level_ + num_kept; level < key.length(); level++) {
 	position_t node_size = nodeSize(pos);
+	// search moves pos past a terminator even when it misses
+	position_t node_start_pos = pos;
 	// if no exact match
 	if (!labels_->search((label_t)key[level], pos, node_size)) {
-	    moveToLeftInNextSubtrie(pos, node_size, key[level], iter);
+	    moveToLeftInNextSubtrie(node_start_pos, node_size, node_num, key[level], iter);
 	    return false;
 	}
 
-	iter.append(key[level], pos);
+	iter.append(key[level], pos, node_num);
 
 	// if trie branch terminates
 	if (!child_indicator_bits_->readBit(pos))
@@ -276,7 +495,7 @@ bool LoudsSparse::moveToKeyGreaterThan(const std::string& key,
     if ((labels_->read(pos) == kTerminator)
 	&& (!child_indicator_bits_->readBit(pos))
 	&& !isEndofNode(pos)) {
-	iter.append(kTerminator, pos);
+	iter.append(kTerminator, pos, node_num);
 	iter.is_at_terminator_ = true;
 	if (!inclusive)
 	    iter++;
@@ -356,6 +575,7 @@ uint64_t LoudsSparse::approxCount(const LoudsSparse::Iter* iter_left,
 				  const LoudsSparse::Iter* iter_right,
 				  const position_t in_node_num_left,
 				  const position_t in_node_num_right) const {
+    SURF_TRACE_PHASE(kPhaseSparse);
     if (in_node_num_left == kMaxPos) return 0;
     std::vector<position_t> left_pos_list, right_pos_list;
     for (level_t i = 0; i < iter_left->key_len_; i++)
@@ -397,24 +617,363 @@ uint64_t LoudsSparse::approxCount(const LoudsSparse::Iter* iter_left,
     return count;
 }
 
-uint64_t LoudsSparse::serializedSize() const {
+void LoudsSparse::approxCountBoundary(const LoudsSparse::Iter* iter,
+				      const position_t in_node_num,
+				      LoudsSparse::CountBoundary& boundary) const {
+    SURF_TRACE_PHASE(kPhaseSparse);
+    level_t num_levels = height_ - start_level_;
+    bool has_left = (in_node_num != kMaxPos);
+    level_t ori_len = has_left ? iter->key_len_ : 0;
+    level_t prev_len = num_levels; // no previous path to meet
+    level_t level = 0;
+    if (boundary.path.empty()) {
+	boundary.path.resize(num_levels);
+	boundary.left_pos.resize(num_levels);
+	boundary.left_terms.resize(num_levels);
+	boundary.right_pos.resize(num_levels);
+	boundary.right_terms.resize(num_levels);
+    } else {
+	// as in louds-dense; paths from different start nodes differ at
+	// every level
+	prev_len = boundary.path_len;
+	while ((level + 1 < ori_len) && (level + 1 < prev_len)
+	       && (boundary.path[level] == iter->pos_in_trie_[level]))
+	    level++;
+    }
+    boundary.has_left = has_left;
+    boundary.path_len = ori_len;
+    for (level_t i = level; i < ori_len; i++)
+	boundary.path[i] = iter->pos_in_trie_[i];
+
+    // extend leftmost to the last level (kMaxPos past the last node),
+    // until the path meets the previous one's extension
+    level_t end_level = num_levels;
+    for (level_t i = ori_len; i < num_levels; i++) {
+	position_t pos = kMaxPos;
+	if (i == 0) {
+	    if (has_left)
+		pos = getFirstLabelPos(in_node_num);
+	} else if (boundary.path[i - 1] != kMaxPos) {
+	    position_t node_num = getChildNodeNum(boundary.path[i - 1]);
+	    if (!child_indicator_bits_->readBit(boundary.path[i - 1]))
+		node_num++;
+	    pos = getFirstLabelPos(node_num);
+	}
+	if (pos != kMaxPos && pos > level_cuts_[start_level_ + i])
+	    pos = kMaxPos;
+	if ((i >= prev_len) && (boundary.path[i] == pos)) {
+	    end_level = i;
+	    break;
+	}
+	boundary.path[i] = pos;
+    }
+
+    // num_leafs = right term - left term, as in approxCount(Iter*, ...)
+    for (level_t i = level; i < end_level; i++) {
+	position_t left_pos = boundary.path[i];
+	position_t left_term = 0;
+	if (left_pos != kMaxPos) {
+	    left_term = left_pos - child_indicator_bits_->rank(left_pos);
+	    if (child_indicator_bits_->readBit(left_pos))
+		left_term++;
+	    if (i == ori_len - 1)
+		left_term++;
+	}
+	boundary.left_pos[i] = left_pos;
+	boundary.left_terms[i] = left_term;
+
+	position_t right_pos = boundary.path[i];
+	if (right_pos == kMaxPos)
+	    right_pos = level_cuts_[start_level_ + i] + 1;
+	position_t right_term = right_pos - child_indicator_bits_->rank(right_pos);
+	if (child_indicator_bits_->readBit(right_pos))
+	    right_term++;
+	boundary.right_pos[i] = right_pos;
+	boundary.right_terms[i] = right_term;
+    }
+}
+
+uint64_t LoudsSparse::approxCount(const LoudsSparse::CountBoundary& left,
+				  const LoudsSparse::CountBoundary& right) const {
+    if (!left.has_left) return 0;
+    uint64_t count = 0;
+    for (level_t i = 0; i < left.left_pos.size(); i++) {
+	if (left.left_pos[i] == kMaxPos) break;
+	if (left.left_pos[i] < right.right_pos[i])
+	    count += (position_t)(right.right_terms[i] - left.left_terms[i]);
+    }
+    return count;
+}
+
+uint64_t LoudsSparse::countKeys(const position_t node_begin,
+				const position_t node_end) const {
+    if (node_begin >= node_end)
+	return 0;
+    return countKeysAt(getNodeStartPos(node_begin), getNodeStartPos(node_end));
+}
+
+// Keys end at labels without children (terminators included); the
+// children of a range of labels are a range of nodes at the next level
+uint64_t LoudsSparse::countKeysAt(position_t pos_begin, position_t pos_end) const {
+    uint64_t count = 0;
+    while (pos_begin < pos_end) {
+	position_t child_begin = child_indicator_bits_->rankBefore(pos_begin);
+	position_t child_end = child_indicator_bits_->rankBefore(pos_end);
+	count += (pos_end - pos_begin) - (child_end - child_begin);
+	if (child_begin == child_end)
+	    break;
+	pos_begin = getNodeStartPos(child_begin + 1 + child_count_dense_);
+	pos_end = getNodeStartPos(child_end + 1 + child_count_dense_);
+    }
+    return count;
+}
+
+void LoudsSparse::selectKey(uint64_t k, const position_t in_node_num,
+			    std::string& key) const {
+    // binary search, at each level, for the label whose subtrie holds
+    // the k-th key, k counting from lo. lo_bounds: where the subtries
+    // of the labels from lo on start at lo's level and the ones below,
+    // kept from probe to probe and from level to level
+    std::vector<position_t> lo_bounds(1, getFirstLabelPos(in_node_num));
+    std::vector<position_t> mid_bounds;
+    while (true) {
+	position_t lo = lo_bounds[0];
+	position_t hi = lo + nodeSize(lo) - 1;
+	while (lo < hi) {
+	    position_t mid = lo + (hi - lo) / 2;
+	    mid_bounds.clear();
+	    uint64_t count = countKeysBetween(lo_bounds, 0, mid + 1, mid_bounds);
+	    if (count > k) {
+		hi = mid;
+	    } else {
+		k -= count;
+		lo = mid + 1;
+		lo_bounds.swap(mid_bounds);
+	    }
+	}
+	label_t label = labels_->read(lo);
+	if (!child_indicator_bits_->readBit(lo)) {
+	    // a terminator is not part of the key, as in Iter::getKey
+	    if ((label != kTerminator) || isEndofNode(lo))
+		key.push_back((char)label);
+	    return;
+	}
+	key.push_back((char)label);
+	// lo's subtrie starts with its child node
+	lo_bounds.erase(lo_bounds.begin());
+	if (lo_bounds.empty())
+	    lo_bounds.push_back(getFirstLabelPos(getChildNodeNum(lo)));
+    }
+}
+
+uint64_t LoudsSparse::countKeysBetween(std::vector<position_t>& left, size_t i,
+				       position_t pos_end,
+				       std::vector<position_t>& right) const {
+    uint64_t count = 0;
+    position_t pos_begin = left[i];
+    while (true) {
+	right.push_back(pos_end);
+	position_t child_begin = child_indicator_bits_->rankBefore(pos_begin);
+	position_t child_end = child_indicator_bits_->rankBefore(pos_end);
+	count += (pos_end - pos_begin) - (child_end - child_begin);
+	if (child_begin == child_end)
+	    return count;
+	i++;
+	if (i == left.size())
+	    left.push_back(getNodeStartPos(child_begin + 1 + child_count_dense_));
+	pos_begin = left[i];
+	pos_end = getNodeStartPos(child_end + 1 + child_count_dense_);
+    }
+}
+
+// As LoudsDense::leafId: the leaves before key's path at each level
+bool LoudsSparse::leafId(const std::string& key, const position_t in_node_num,
+			 uint64_t& id, const uint32_t* key_hash) const {
+    position_t pos = getFirstLabelPos(in_node_num);
+    level_t level = 0;
+    for (level = start_level_; level < key.length(); level++) {
+	if (!labels_->search((label_t)key[level], pos, nodeSize(pos)))
+	    return false;
+	if (!child_indicator_bits_->readBit(pos)) {
+	    id += countKeysBefore(level, pos);
+	    return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1, key_hash);
+	}
+	id += leafRank(level, pos);
+	pos = getFirstLabelPos(getChildNodeNum(pos));
+    }
+    if ((labels_->read(pos) == kTerminator) && (!child_indicator_bits_->readBit(pos))) {
+	id += countKeysBefore(level, pos);
+	return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1, key_hash);
+    }
+    return false;
+}
+
+uint64_t LoudsSparse::countKeysBefore(const position_t node_num) const {
+    if (start_level_ >= height_)
+	return 0;
+    return countKeysBefore(start_level_, getNodeStartPos(node_num));
+}
+
+uint64_t LoudsSparse::leafRank(const level_t level, const position_t pos) const {
+    position_t level_begin = (level == start_level_) ? 0 : (level_cuts_[level - 1] + 1);
+    return (pos - level_begin)
+	- (child_indicator_bits_->rankBefore(pos) - child_indicator_bits_->rankBefore(level_begin));
+}
+
+uint64_t LoudsSparse::countKeysBefore(level_t level, position_t pos) const {
+    uint64_t count = leafRank(level, pos);
+    for (level++; level < height_; level++) {
+	// the first child node of a label from pos on
+	pos = getNodeStartPos(child_indicator_bits_->rankBefore(pos) + 1 + child_count_dense_);
+	count += leafRank(level, pos);
+    }
+    return count;
+}
+
+uint64_t LoudsSparse::serializedSize(const bool include_luts) const {
     uint64_t size = sizeof(height_) + sizeof(start_level_)
 	+ sizeof(node_count_dense_) + sizeof(child_count_dense_)
-	+ (sizeof(position_t) * height_);
+	+ sizeof(louds_encoding_) + (sizeof(position_t) * height_);
     sizeAlign(size);
     size += (labels_->serializedSize()
-	     + child_indicator_bits_->serializedSize()
-	     + louds_bits_->serializedSize()
+	     + child_indicator_bits_->serializedSize(include_luts)
+	     + loudsSerializedSize(include_luts)
 	     + suffixes_->serializedSize());
     sizeAlign(size);
     return size;
 }
 
+void LoudsSparse::sectionSizes(uint64_t* sizes, const bool include_luts) const {
+    sizes[0] = sizeof(height_) + sizeof(start_level_)
+	+ sizeof(node_count_dense_) + sizeof(child_count_dense_)
+	+ sizeof(louds_encoding_) + (sizeof(position_t) * height_);
+    sizeAlign(sizes[0]);
+    sizes[1] = labels_->serializedSize();
+    sizes[2] = child_indicator_bits_->serializedSize(include_luts);
+    sizes[3] = loudsSerializedSize(include_luts);
+    sizes[4] = suffixes_->serializedSize();
+}
+
+void LoudsSparse::countSparseItems(const SuRFBuilder* builder, position_t& num_items,
+				   position_t& num_nodes, position_t& num_suffix_bits) {
+    num_items = 0;
+    num_nodes = 0;
+    num_suffix_bits = 0;
+    for (level_t level = builder->getSparseStartLevel(); level < builder->getTreeHeight(); level++) {
+	num_items += builder->getNumItems(level);
+	num_nodes += builder->getNodeCounts()[level];
+	num_suffix_bits += builder->getSuffixCounts()[level] * builder->getSuffixLen();
+    }
+}
+
+bool LoudsSparse::serializeCompact(SerialSink& sink, const SuRFBuilder* builder) {
+    assert(builder->getLoudsEncoding() == kLoudsBitvector);
+    level_t height = builder->getTreeHeight();
+    level_t start_level = builder->getSparseStartLevel();
+    position_t node_count_dense = 0;
+    for (level_t level = 0; level < start_level; level++)
+	node_count_dense += builder->getNodeCounts()[level];
+    position_t child_count_dense = 0;
+    if (start_level > 0)
+	child_count_dense = node_count_dense + builder->getNodeCounts()[start_level] - 1;
+    LoudsEncoding louds_encoding = kLoudsBitvector;
+    std::vector<position_t> level_cuts(height, 0);
+    position_t bit_count = 0;
+    for (level_t level = start_level; level < height; level++) {
+	bit_count += builder->getNumItems(level);
+	level_cuts[level] = bit_count - 1;
+    }
+    position_t num_items, num_nodes, num_suffix_bits;
+    countSparseItems(builder, num_items, num_nodes, num_suffix_bits);
+
+    sink.write(&height, sizeof(height));
+    sink.write(&start_level, sizeof(start_level));
+    sink.write(&node_count_dense, sizeof(node_count_dense));
+    sink.write(&child_count_dense, sizeof(child_count_dense));
+    sink.write(&louds_encoding, sizeof(louds_encoding));
+    sink.write(level_cuts.data(), sizeof(position_t) * height);
+    sink.align();
+
+    // LabelVector: one extra (zero) label at the end
+    position_t num_bytes = num_items + 1;
+    const label_t last_label = 0;
+    sink.write(&num_bytes, sizeof(num_bytes));
+    if (!builder->writeLevels(sink, SuRFBuilder::kLevelLabels, start_level, height))
+	return false;
+    sink.write(&last_label, sizeof(last_label));
+    sink.align();
+
+    // BitvectorRank without LUT
+    sink.write(&num_items, sizeof(num_items));
+    sink.write(&kRankBasicBlockSize, sizeof(kRankBasicBlockSize));
+    if (!builder->writeLevels(sink, SuRFBuilder::kLevelChildIndicatorBits, start_level, height))
+	return false;
+    sink.align();
+
+    // BitvectorSelect without LUT
+    sink.write(&num_items, sizeof(num_items));
+    sink.write(&kSelectSampleInterval, sizeof(kSelectSampleInterval));
+    sink.write(&num_nodes, sizeof(num_nodes));
+    sink.align();
+    if (!builder->writeLevels(sink, SuRFBuilder::kLevelLoudsBits, start_level, height))
+	return false;
+    sink.align();
+
+    // BitvectorSuffix
+    SuffixType suffix_type = builder->getSuffixType();
+    level_t hash_suffix_len = builder->getHashSuffixLen();
+    level_t real_suffix_len = builder->getRealSuffixLen();
+    SuffixHashType hash_type = builder->getSuffixHashType();
+    if (suffix_type == kNone) {
+	// as BitvectorSuffix()
+	num_suffix_bits = 0;
+	hash_suffix_len = 0;
+	real_suffix_len = 0;
+	hash_type = kHashLevelDB;
+    }
+    sink.write(&num_suffix_bits, sizeof(num_suffix_bits));
+    sink.write(&suffix_type, sizeof(suffix_type));
+    sink.write(&hash_suffix_len, sizeof(hash_suffix_len));
+    sink.write(&real_suffix_len, sizeof(real_suffix_len));
+    sink.write(&hash_type, sizeof(hash_type));
+    sink.align();
+    if ((suffix_type != kNone)
+	&& !builder->writeLevels(sink, SuRFBuilder::kLevelSuffixes, start_level, height))
+	return false;
+    sink.align();
+    return sink.ok();
+}
+
+void LoudsSparse::compactSectionSizes(const SuRFBuilder* builder, uint64_t* sizes) {
+    position_t num_items, num_nodes, num_suffix_bits;
+    countSparseItems(builder, num_items, num_nodes, num_suffix_bits);
+    if (builder->getSuffixType() == kNone)
+	num_suffix_bits = 0;
+    uint64_t item_words_size = (num_items + kWordSize - 1) / kWordSize * sizeof(word_t);
+
+    sizes[0] = sizeof(level_t) * 2 + sizeof(position_t) * 2 + sizeof(LoudsEncoding)
+	+ sizeof(position_t) * builder->getTreeHeight();
+    sizeAlign(sizes[0]);
+    sizes[1] = sizeof(position_t) + num_items + 1;
+    sizeAlign(sizes[1]);
+    sizes[2] = sizeof(position_t) * 2 + item_words_size;
+    sizeAlign(sizes[2]);
+    sizes[3] = sizeof(position_t) * 3;
+    sizeAlign(sizes[3]);
+    sizes[3] += item_words_size;
+    sizeAlign(sizes[3]);
+    sizes[4] = sizeof(position_t) + sizeof(SuffixType) + sizeof(level_t) * 2
+	+ sizeof(SuffixHashType);
+    sizeAlign(sizes[4]);
+    sizes[4] += (num_suffix_bits + kWordSize - 1) / kWordSize * sizeof(word_t);
+    sizeAlign(sizes[4]);
+}
+
 uint64_t LoudsSparse::getMemoryUsage() const {
     return (sizeof(this)
 	    + labels_->size()
 	    + child_indicator_bits_->size()
-	    + louds_bits_->size()
+	    + loudsSize()
 	    + suffixes_->size());
 }
 
@@ -423,14 +982,21 @@ position_t LoudsSparse::getChildNodeNum(const position_t pos) const {
 }
 
 position_t LoudsSparse::getFirstLabelPos(const position_t node_num) const {
-    return louds_bits_->select(node_num + 1 - node_count_dense_);
+    return loudsSelect(node_num + 1 - node_count_dense_);
+}
+
+position_t LoudsSparse::getNodeStartPos(const position_t node_num) const {
+    position_t rank = node_num + 1 - node_count_dense_;
+    if (rank > loudsNumOnes())
+	return loudsNumBits();
+    return loudsSelect(rank);
 }
 
 position_t LoudsSparse::getLastLabelPos(const position_t node_num) const {
     position_t next_rank = node_num + 2 - node_count_dense_;
-    if (next_rank > louds_bits_->numOnes())
-	return (louds_bits_->numBits() - 1);
-    return (louds_bits_->select(next_rank) - 1);
+    if (next_rank > loudsNumOnes())
+	return (loudsNumBits() - 1);
+    return (loudsSelect(next_rank) - 1);
 }
 
 position_t LoudsSparse::getSuffixPos(const position_t pos) const {
@@ -438,23 +1004,67 @@ position_t LoudsSparse::getSuffixPos(const position_t pos) const {
 }
 
 position_t LoudsSparse::nodeSize(const position_t pos) const {
-    assert(louds_bits_->readBit(pos));
-    return louds_bits_->distanceToNextSetBit(pos);
+    assert(loudsReadBit(pos));
+    return loudsDistanceToNextSetBit(pos);
 }
 
 bool LoudsSparse::isEndofNode(const position_t pos) const {
-    return ((pos == louds_bits_->numBits() - 1)
-	    || louds_bits_->readBit(pos + 1));
+    return ((pos == loudsNumBits() - 1)
+	    || loudsReadBit(pos + 1));
+}
+
+position_t LoudsSparse::loudsSelect(const position_t rank) const {
+    if (louds_encoding_ == kLoudsEliasFano)
+	return louds_ef_->select(rank);
+    return louds_bits_->select(rank);
+}
+
+bool LoudsSparse::loudsReadBit(const position_t pos) const {
+    if (louds_encoding_ == kLoudsEliasFano)
+	return louds_ef_->readBit(pos);
+    return louds_bits_->readBit(pos);
+}
+
+position_t LoudsSparse::loudsDistanceToNextSetBit(const position_t pos) const {
+    if (louds_encoding_ == kLoudsEliasFano)
+	return louds_ef_->distanceToNextSetBit(pos);
+    return louds_bits_->distanceToNextSetBit(pos);
+}
+
+position_t LoudsSparse::loudsNumBits() const {
+    if (louds_encoding_ == kLoudsEliasFano)
+	return louds_ef_->numBits();
+    return louds_bits_->numBits();
+}
+
+position_t LoudsSparse::loudsNumOnes() const {
+    if (louds_encoding_ == kLoudsEliasFano)
+	return louds_ef_->numOnes();
+    return louds_bits_->numOnes();
+}
+
+uint64_t LoudsSparse::loudsSerializedSize(const bool include_luts) const {
+    if (louds_encoding_ == kLoudsEliasFano)
+	return louds_ef_->serializedSize(include_luts);
+    return louds_bits_->serializedSize(include_luts);
+}
+
+uint64_t LoudsSparse::loudsSize() const {
+    if (louds_encoding_ == kLoudsEliasFano)
+	return louds_ef_->size();
+    return louds_bits_->size();
 }
 
 void LoudsSparse::moveToLeftInNextSubtrie(position_t pos, const position_t node_size, 
+					  const position_t node_num,
 					  const label_t label, LoudsSparse::Iter& iter) const {
+    position_t last_pos = pos + node_size - 1;
     // if no label is greater than key[level] in this node
     if (!labels_->searchGreaterThan(label, pos, node_size)) {
-	iter.append(pos + node_size - 1);
+	iter.append(last_pos, node_num);
 	return iter++;
     } else {
-	iter.append(pos);
+	iter.append(pos, node_num);
 	return iter.moveToLeftMostKey();
     }
 }
@@ -480,6 +1090,23 @@ void LoudsSparse::Iter::clear() {
     is_at_terminator_ = false;
 }
 
+// Every level above the last has a child, so its label is no terminator
+level_t LoudsSparse::Iter::matchedLevels(const std::string& key) const {
+    if (!is_valid_ || key_len_ == 0)
+	return 0;
+    level_t level = 0;
+    while ((level + 1 < key_len_) && (start_level_ + level < key.length())
+	   && (key_[level] == (label_t)key[start_level_ + level]))
+	level++;
+    return level;
+}
+
+void LoudsSparse::Iter::truncate(const level_t key_len) {
+    is_valid_ = false;
+    key_len_ = key_len;
+    is_at_terminator_ = false;
+}
+
 int LoudsSparse::Iter::compare(const std::string& key) const {
     if (is_at_terminator_ && (key_len_ - 1) < (key.length() - start_level_))
 	return -1;
@@ -534,17 +1161,20 @@ std::string LoudsSparse::Iter::getKeyWithSuffix(unsigned* bitlen) const {
     return iter_key;
 }
 
-void LoudsSparse::Iter::append(const position_t pos) {
-    assert(key_len_ < key_.size());
-    key_[key_len_] = trie_->labels_->read(pos);
-    pos_in_trie_[key_len_] = pos;
-    key_len_++;
+void LoudsSparse::Iter::append(const position_t pos, const position_t node_num) {
+    append(trie_->labels_->read(pos), pos, node_num);
 }
 
-void LoudsSparse::Iter::append(const label_t label, const position_t pos) {
+void LoudsSparse::Iter::append(const label_t label, const position_t pos,
+			       const position_t node_num) {
     assert(key_len_ < key_.size());
     key_[key_len_] = label;
     pos_in_trie_[key_len_] = pos;
+    if (!node_bounds_.empty()) {
+	node_bounds_[key_len_].node_num = node_num;
+	node_bounds_[key_len_].start = kMaxPos;
+	node_bounds_[key_len_].end = kMaxPos;
+    }
     key_len_++;
 }
 
@@ -554,6 +1184,30 @@ void LoudsSparse::Iter::set(const level_t level, const position_t pos) {
     pos_in_trie_[level] = pos;
 }
 
+// Under Elias-Fano the bounds come from O(1) selects by node number,
+// once per node; the bitvector reads its louds bits directly
+bool LoudsSparse::Iter::isPastNode(const level_t level, const position_t pos) {
+    if (node_bounds_.empty())
+	return (pos >= trie_->loudsNumBits()) || trie_->louds_bits_->readBit(pos);
+    NodeBounds& bounds = node_bounds_[level];
+    if (bounds.end == kMaxPos)
+	bounds.end = trie_->getNodeStartPos(bounds.node_num + 1);
+    return (pos >= bounds.end);
+}
+
+bool LoudsSparse::Iter::isNodeStart(const level_t level, const position_t pos) {
+    if (node_bounds_.empty())
+	return trie_->louds_bits_->readBit(pos);
+    NodeBounds& bounds = node_bounds_[level];
+    if (bounds.start == kMaxPos)
+	bounds.start = trie_->getFirstLabelPos(bounds.node_num);
+    return (pos == bounds.start);
+}
+
+bool LoudsSparse::Iter::isEndofNode(const level_t level) {
+    return isPastNode(level, pos_in_trie_[level] + 1);
+}
+
 void LoudsSparse::Iter::setToFirstLabelInRoot() {
     assert(start_level_ == 0);
     pos_in_trie_[0] = 0;
@@ -567,10 +1221,11 @@ void LoudsSparse::Iter::setToLastLabelInRoot() {
 }
 
 void LoudsSparse::Iter::moveToLeftMostKey() {
+    SURF_TRACE_PHASE(kPhaseSparse);
     if (key_len_ == 0) {
 	position_t pos = trie_->getFirstLabelPos(start_node_num_);
 	label_t label = trie_->labels_->read(pos);
-	append(label, pos);
+	append(label, pos, start_node_num_);
     }
 
     level_t level = key_len_ - 1;
@@ -579,7 +1234,7 @@ void LoudsSparse::Iter::moveToLeftMostKey() {
 
     if (!trie_->child_indicator_bits_->readBit(pos)) {
 	if ((label == kTerminator)
-	    && !trie_->isEndofNode(pos))
+	    && !isEndofNode(level))
 	    is_at_terminator_ = true;
 	is_valid_ = true;
 	return;
@@ -589,27 +1244,26 @@ void LoudsSparse::Iter::moveToLeftMostKey() {
 	position_t node_num = trie_->getChildNodeNum(pos);
 	pos = trie_->getFirstLabelPos(node_num);
 	label = trie_->labels_->read(pos);
+	append(label, pos, node_num);
 	// if trie branch terminates
 	if (!trie_->child_indicator_bits_->readBit(pos)) {
-	    append(label, pos);
 	    if ((label == kTerminator)
-		&& !trie_->isEndofNode(pos))
+		&& !isEndofNode(key_len_ - 1))
 		is_at_terminator_ = true;
 	    is_valid_ = true;
 	    return;
 	}
-	append(label, pos);
 	level++;
     }
     assert(false); // shouldn't reach here
 }
 
 void LoudsSparse::Iter::moveToRightMostKey() {
+    SURF_TRACE_PHASE(kPhaseSparse);
     if (key_len_ == 0) {
-	position_t pos = trie_->getFirstLabelPos(start_node_num_);
-	pos = trie_->getLastLabelPos(start_node_num_);
+	position_t pos = trie_->getLastLabelPos(start_node_num_);
 	label_t label = trie_->labels_->read(pos);
-	append(label, pos);
+	append(label, pos, start_node_num_);
     }
 
     level_t level = key_len_ - 1;
@@ -618,7 +1272,7 @@ void LoudsSparse::Iter::moveToRightMostKey() {
 
     if (!trie_->child_indicator_bits_->readBit(pos)) {
 	if ((label == kTerminator)
-	    && !trie_->isEndofNode(pos))
+	    && !isEndofNode(level))
 	    is_at_terminator_ = true;
 	is_valid_ = true;
 	return;
@@ -628,16 +1282,15 @@ void LoudsSparse::Iter::moveToRightMostKey() {
 	position_t node_num = trie_->getChildNodeNum(pos);
 	pos = trie_->getLastLabelPos(node_num);
 	label = trie_->labels_->read(pos);
+	append(label, pos, node_num);
 	// if trie branch terminates
 	if (!trie_->child_indicator_bits_->readBit(pos)) {
-	    append(label, pos);
 	    if ((label == kTerminator)
-		&& !trie_->isEndofNode(pos))
+		&& !isEndofNode(key_len_ - 1))
 		is_at_terminator_ = true;
 	    is_valid_ = true;
 	    return;
 	}
-	append(label, pos);
 	level++;
     }
     assert(false); // shouldn't reach here
@@ -648,7 +1301,7 @@ void LoudsSparse::Iter::operator ++(int) {
     is_at_terminator_ = false;
     position_t pos = pos_in_trie_[key_len_ - 1];
     pos++;
-    while (pos >= trie_->louds_bits_->numBits() || trie_->louds_bits_->readBit(pos)) {
+    while (isPastNode(key_len_ - 1, pos)) {
 	key_len_--;
 	if (key_len_ == 0) {
 	    is_valid_ = false;
@@ -669,7 +1322,7 @@ void LoudsSparse::Iter::operator --(int) {
 	is_valid_ = false;
 	return;
     }
-    while (trie_->louds_bits_->readBit(pos)) {
+    while (isNodeStart(key_len_ - 1, pos)) {
 	key_len_--;
 	if (key_len_ == 0) {
 	    is_valid_ = false;
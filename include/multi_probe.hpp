@@ -0,0 +1,171 @@
+#ifndef MULTIPROBE_H_
+#define MULTIPROBE_H_
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+// Probes keys against a list of filters (e.g., one SuRF per LSM level or
+// SST) in one call. Each key is hashed at most once per suffix hash type,
+// and only for filters with hash suffix bits; and the trie descents of up to kProbeWindow (key, filter) pairs are
+// interleaved level by level, so that the cache misses of one descent
+// overlap with the work on the others.
+//
+// Results are bitmaps with one bit per filter, in the same order as the
+// filter list and with the same bit order as Bitvector (MSB first);
+// see isCandidate.
+class MultiProbe {
+public:
+    static const position_t kProbeWindow = 16;
+
+    MultiProbe() {};
+    explicit MultiProbe(const std::vector<SuRF*>& filters) : filters_(filters) {};
+
+    ~MultiProbe() {}
+
+    position_t numFilters() const {
+	return filters_.size();
+    }
+
+    position_t numBitmapWords() const {
+	return (filters_.size() + kWordSize - 1) / kWordSize;
+    }
+
+    static bool isCandidate(const std::vector<word_t>& bitmap, const position_t filter_idx) {
+	return (bitmap[filter_idx / kWordSize] & (kMsbMask >> (filter_idx % kWordSize)));
+    }
+
+    // Sets bit i of candidates iff filters[i]->lookupKey(key) is true
+    void lookupKey(const std::string& key, std::vector<word_t>& candidates) const;
+    // candidates[k] is the lookupKey bitmap of keys[k]
+    void lookupKeys(const std::vector<std::string>& keys,
+		    std::vector<std::vector<word_t> >& candidates) const;
+    // Sets bit i of candidates iff filters[i]->lookupRange(...) is true,
+    // i.e., filter i may contain a key in the range.
+    void lookupRange(const std::string& left_key, const bool left_inclusive,
+		     const std::string& right_key, const bool right_inclusive,
+		     std::vector<word_t>& candidates) const;
+
+private:
+    struct Probe {
+	SuRF::LookupState state;
+	position_t key_idx;
+	position_t filter_idx;
+    };
+
+    // Hash of keys[key_idx] under filter's hash type, computed on first
+    // use; 0 for filters without hash suffix bits, which never check it
+    uint32_t keyHash(const std::vector<std::string>& keys, const position_t key_idx,
+		     const SuRF* filter, std::vector<uint32_t>& key_hashes,
+		     std::vector<bool>& is_hashed) const;
+    void startProbe(const std::vector<std::string>& keys,
+		    std::vector<uint32_t>& key_hashes, std::vector<bool>& is_hashed,
+		    const position_t pair_idx, Probe& probe) const;
+
+    static void setBit(std::vector<word_t>& bitmap, const position_t idx) {
+	bitmap[idx / kWordSize] |= (kMsbMask >> (idx % kWordSize));
+    }
+
+private:
+    static const int kNumHashTypes = 3;
+
+    std::vector<SuRF*> filters_;
+};
+
+void MultiProbe::lookupKey(const std::string& key, std::vector<word_t>& candidates) const {
+    std::vector<std::string> keys(1, key);
+    std::vector<std::vector<word_t> > results;
+    lookupKeys(keys, results);
+    candidates.swap(results[0]);
+}
+
+uint32_t MultiProbe::keyHash(const std::vector<std::string>& keys, const position_t key_idx,
+			     const SuRF* filter, std::vector<uint32_t>& key_hashes,
+			     std::vector<bool>& is_hashed) const {
+    SuffixType suffix_type = filter->getSuffixType();
+    if ((suffix_type != kHash) && (suffix_type != kMixed))
+	return 0;
+    SuffixHashType hash_type = filter->getSuffixHashType();
+    position_t idx = key_idx * kNumHashTypes + hash_type;
+    if (!is_hashed[idx]) {
+	key_hashes[idx] = suffixHash(hash_type, keys[key_idx]);
+	is_hashed[idx] = true;
+    }
+    return key_hashes[idx];
+}
+
+void MultiProbe::startProbe(const std::vector<std::string>& keys,
+			    std::vector<uint32_t>& key_hashes, std::vector<bool>& is_hashed,
+			    const position_t pair_idx, Probe& probe) const {
+    probe.key_idx = pair_idx / filters_.size();
+    probe.filter_idx = pair_idx % filters_.size();
+    const SuRF* filter = filters_[probe.filter_idx];
+    uint32_t key_hash = keyHash(keys, probe.key_idx, filter, key_hashes, is_hashed);
+    filter->startLookup(keys[probe.key_idx], key_hash, probe.state);
+}
+
+void MultiProbe::lookupKeys(const std::vector<std::string>& keys,
+			    std::vector<std::vector<word_t> >& candidates) const {
+    candidates.assign(keys.size(), std::vector<word_t>(numBitmapWords(), 0));
+    if (filters_.empty())
+	return;
+
+    std::vector<uint32_t> key_hashes(keys.size() * kNumHashTypes, 0);
+    std::vector<bool> is_hashed(keys.size() * kNumHashTypes, false);
+
+    // Round-robin over a window of in-flight probes; a finished probe is
+    // replaced by the next (key, filter) pair.
+    position_t num_pairs = keys.size() * filters_.size();
+    position_t next_pair = 0;
+    Probe window[kProbeWindow];
+    position_t num_active = 0;
+    while ((num_active < kProbeWindow) && (next_pair < num_pairs)) {
+	startProbe(keys, key_hashes, is_hashed, next_pair, window[num_active]);
+	next_pair++;
+	num_active++;
+    }
+
+    while (num_active > 0) {
+	position_t i = 0;
+	while (i < num_active) {
+	    Probe& probe = window[i];
+	    if (!filters_[probe.filter_idx]->lookupStep(probe.state)) {
+		i++;
+		continue;
+	    }
+	    if (probe.state.result)
+		setBit(candidates[probe.key_idx], probe.filter_idx);
+	    if (next_pair < num_pairs) {
+		startProbe(keys, key_hashes, is_hashed, next_pair, probe);
+		next_pair++;
+		i++;
+	    } else {
+		num_active--;
+		window[i] = window[num_active];
+	    }
+	}
+    }
+}
+
+// Range lookups move iterators and share no hashing, so they are issued
+// filter by filter, each with a local iterator so that concurrent calls
+// do not share the filters' own iterators.
+void MultiProbe::lookupRange(const std::string& left_key, const bool left_inclusive,
+			     const std::string& right_key, const bool right_inclusive,
+			     std::vector<word_t>& candidates) const {
+    candidates.assign(numBitmapWords(), 0);
+    for (position_t i = 0; i < filters_.size(); i++) {
+	SuRF::Iter iter(filters_[i]);
+	if (filters_[i]->lookupRange(left_key, left_inclusive, right_key, right_inclusive,
+				     iter))
+	    setBit(candidates, i);
+    }
+}
+
+} // namespace surf
+
+#endif // MULTIPROBE_H_
@@ -0,0 +1,51 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf {
+
+// Each extra thread of a bitvector scan gets at least this many words
+static const position_t kParallelMinWords = (1 << 18);
+
+// Threads for a scan over num_words words: one per kParallelMinWords
+// words, up to the number of hardware threads.
+inline unsigned parallelThreads(const position_t num_words) {
+    unsigned num_cores = std::thread::hardware_concurrency();
+    if (num_cores == 0)
+	num_cores = 1;
+    position_t num_threads = num_words / kParallelMinWords;
+    if (num_threads < 1)
+	num_threads = 1;
+    if (num_threads > num_cores)
+	num_threads = num_cores;
+    return (unsigned)num_threads;
+}
+
+// Splits [0, n) into num_threads contiguous ranges (some may be empty)
+// and runs fn(thread_id, begin, end) on each, range 0 on the calling
+// thread. Returns after all ranges are done.
+template <typename Fn>
+void parallelFor(const unsigned num_threads, const position_t n, Fn fn) {
+    position_t range_size = (n + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; t++) {
+	position_t begin = t * range_size;
+	position_t end = begin + range_size;
+	if (begin > n)
+	    begin = n;
+	if (end > n)
+	    end = n;
+	threads.push_back(std::thread(fn, t, begin, end));
+    }
+    fn(0, 0, (range_size < n) ? range_size : n);
+    for (unsigned t = 0; t < threads.size(); t++)
+	threads[t].join();
+}
+
+} // namespace surf
+
+#endif // PARALLEL_H_
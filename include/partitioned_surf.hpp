@@ -0,0 +1,436 @@
+#ifndef PARTITIONEDSURF_H_
+#define PARTITIONEDSURF_H_
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "serial_sink.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+// Filter of one SST made of one SuRF per partition of consecutive keys
+// (e.g., per data block) plus a top-level index of partition fences,
+// as the partitioned filters of LSM engines. Fence i is a short
+// separator with last key of partition i <= fence < first key of
+// partition i + 1, so a key can only be in the first partition whose
+// fence is >= the key. Queries binary-search the fences and probe one
+// partition (range queries at most two); partitions are deserialized
+// on first use, so a filter loaded with open() only faults in the
+// index and the partitions that queries reach.
+//
+// Layout: header (kPartitionedMagic, kPartitionedVersion; uint32_t
+// each, then the number of partitions n and the fence bytes; uint64_t
+// each), n + 1 fence offsets (into the fence bytes), n + 1 partition
+// offsets (from the start; the last one is the total size), the fence
+// bytes, then the serialized SuRF's (kSerializeFull), all 8-byte
+// aligned.
+class PartitionedSuRF {
+public:
+    PartitionedSuRF() : num_partitions_(0), fence_offsets_(nullptr), partition_offsets_(nullptr),
+			fence_data_(nullptr), data_(nullptr), arena_(nullptr),
+			mapped_data_(nullptr), mapped_size_(0), partitions_(nullptr) {};
+
+    //------------------------------------------------------------------
+    // Input keys must be SORTED
+    //------------------------------------------------------------------
+    PartitionedSuRF(const std::vector<std::string>& keys, const uint64_t keys_per_partition,
+		    const bool include_dense, const uint32_t sparse_dense_ratio,
+		    const SuffixType suffix_type,
+		    const level_t hash_suffix_len, const level_t real_suffix_len)
+	: PartitionedSuRF() {
+	create(keys, keys_per_partition, include_dense, sparse_dense_ratio,
+	       suffix_type, hash_suffix_len, real_suffix_len);
+    }
+
+    PartitionedSuRF(const PartitionedSuRF&) = delete;
+    PartitionedSuRF& operator=(const PartitionedSuRF&) = delete;
+
+    ~PartitionedSuRF() {
+	destroy();
+    }
+
+    void create(const std::vector<std::string>& keys, const uint64_t keys_per_partition,
+		const bool include_dense, const uint32_t sparse_dense_ratio,
+		const SuffixType suffix_type,
+		const level_t hash_suffix_len, const level_t real_suffix_len);
+
+    uint64_t numPartitions() const {
+	return num_partitions_;
+    }
+
+    std::string getFence(const uint64_t i) const {
+	return std::string(fence_data_ + fence_offsets_[i],
+			   fence_offsets_[i + 1] - fence_offsets_[i]);
+    }
+
+    // The only partition that may contain key; numPartitions() if key
+    // is greater than every fence
+    uint64_t findPartition(const std::string& key) const;
+
+    bool lookupKey(const std::string& key) const;
+    bool lookupRange(const std::string& left_key, const bool left_inclusive,
+		     const std::string& right_key, const bool right_inclusive) const;
+
+    // Deserializes partition i on first use; nullptr if it is corrupt
+    // (queries then answer true for it)
+    const SuRF* getPartition(const uint64_t i) const;
+    uint64_t numLoadedPartitions() const;
+
+    uint64_t serializedSize() const {
+	return (data_ != nullptr) ? partition_offsets_[num_partitions_] : 0;
+    }
+
+    char* serialize() const {
+	char* data = new char[serializedSize()];
+	memcpy(data, data_, serializedSize());
+	return data;
+    }
+
+    bool serialize(SerialSink& sink) const {
+	sink.write(data_, serializedSize());
+	return sink.ok();
+    }
+
+    // Copies src; src can be freed afterwards. Returns nullptr if src
+    // is not a serialized PartitionedSuRF of this version.
+    static PartitionedSuRF* deSerialize(const char* src);
+    // Same as deSerialize, but partitions point into src, which must
+    // stay valid until destroy()
+    static PartitionedSuRF* deSerializeMapped(char* src);
+    // Maps a file written from serialize() read-only. Returns nullptr
+    // on failure.
+    static PartitionedSuRF* open(const std::string& path);
+
+    // Fence index and the partitions loaded so far
+    uint64_t getMemoryUsage() const;
+
+    // Frees the filter; safe to call more than once
+    void destroy();
+
+private:
+    // Sets the index pointers into src; size bounds the offsets
+    // (UINT64_MAX if unknown). Returns false if src is invalid.
+    bool load(char* src, const uint64_t size);
+    static bool readHeader(const char* src, uint64_t* num_partitions, uint64_t* fence_bytes);
+    // Shortest s with left <= s < right (left < right)
+    static std::string shortestSeparator(const std::string& left, const std::string& right);
+    bool lookupRange(const uint64_t i, const std::string& left_key, const bool left_inclusive,
+		     const std::string& right_key, const bool right_inclusive) const;
+
+    uint64_t num_partitions_;
+    const uint64_t* fence_offsets_;
+    const uint64_t* partition_offsets_;
+    const char* fence_data_;
+    char* data_;
+    // owned copy (create, deSerialize) or mapping (open); nullptr otherwise
+    char* arena_;
+    char* mapped_data_;
+    uint64_t mapped_size_;
+    mutable std::atomic<SuRF*>* partitions_;
+    mutable std::mutex load_mutex_;
+};
+
+void PartitionedSuRF::create(const std::vector<std::string>& keys,
+			     const uint64_t keys_per_partition,
+			     const bool include_dense, const uint32_t sparse_dense_ratio,
+			     const SuffixType suffix_type,
+			     const level_t hash_suffix_len, const level_t real_suffix_len) {
+    assert(keys_per_partition > 0);
+    destroy();
+    uint64_t num_partitions = (keys.size() + keys_per_partition - 1) / keys_per_partition;
+    std::vector<SuRF*> partitions;
+    std::string fences;
+    std::vector<uint64_t> fence_offsets(1, 0);
+    for (uint64_t i = 0; i < num_partitions; i++) {
+	uint64_t begin = i * keys_per_partition;
+	uint64_t end = begin + keys_per_partition;
+	if (end > keys.size())
+	    end = keys.size();
+	std::vector<std::string> partition_keys(keys.begin() + begin, keys.begin() + end);
+	partitions.push_back(new SuRF(partition_keys, include_dense, sparse_dense_ratio,
+				      suffix_type, hash_suffix_len, real_suffix_len));
+	if (end < keys.size())
+	    fences += shortestSeparator(keys[end - 1], keys[end]);
+	else
+	    fences += keys[end - 1];
+	fence_offsets.push_back(fences.size());
+    }
+
+    uint64_t fence_bytes = fences.size();
+    uint64_t offset = kPartitionedHeaderSize + sizeof(uint64_t) * 2 * (num_partitions + 1)
+	+ fence_bytes;
+    sizeAlign(offset);
+    std::vector<uint64_t> partition_offsets;
+    for (uint64_t i = 0; i < num_partitions; i++) {
+	partition_offsets.push_back(offset);
+	offset += partitions[i]->serializedSize();
+	sizeAlign(offset);
+    }
+    partition_offsets.push_back(offset);
+
+    // new[] is at least 8-byte aligned
+    char* arena = new char[offset];
+    BufferSink sink(arena);
+    uint32_t header[2] = {kPartitionedMagic, kPartitionedVersion};
+    sink.write(header, sizeof(header));
+    sink.write(&num_partitions, sizeof(num_partitions));
+    sink.write(&fence_bytes, sizeof(fence_bytes));
+    sink.write(fence_offsets.data(), sizeof(uint64_t) * (num_partitions + 1));
+    sink.write(partition_offsets.data(), sizeof(uint64_t) * (num_partitions + 1));
+    sink.write(fences.data(), fence_bytes);
+    sink.align();
+    for (uint64_t i = 0; i < num_partitions; i++) {
+	partitions[i]->serialize(sink);
+	sink.align();
+	delete partitions[i];
+    }
+    assert(sink.position() - arena == (int64_t)offset);
+
+    load(arena, offset);
+    arena_ = arena;
+}
+
+std::string PartitionedSuRF::shortestSeparator(const std::string& left, const std::string& right) {
+    size_t len = 0;
+    while (len < left.size() && len < right.size() && left[len] == right[len])
+	len++;
+    // left is not a prefix of right and left[len] + 1 < right[len]:
+    // left[0, len] with its last byte incremented is in between
+    if (len < left.size() && len < right.size()) {
+	uint8_t byte = (uint8_t)left[len];
+	if (byte < 0xff && byte + 1 < (uint8_t)right[len]) {
+	    std::string separator = left.substr(0, len + 1);
+	    separator[len] = (char)(byte + 1);
+	    return separator;
+	}
+    }
+    return left;
+}
+
+bool PartitionedSuRF::readHeader(const char* src, uint64_t* num_partitions,
+				 uint64_t* fence_bytes) {
+    uint32_t header[2];
+    memcpy(header, src, sizeof(header));
+    if (header[0] != kPartitionedMagic || header[1] != kPartitionedVersion)
+	return false;
+    memcpy(num_partitions, src + sizeof(header), sizeof(uint64_t));
+    memcpy(fence_bytes, src + sizeof(header) + sizeof(uint64_t), sizeof(uint64_t));
+    return true;
+}
+
+bool PartitionedSuRF::load(char* src, const uint64_t size) {
+    uint64_t num_partitions, fence_bytes;
+    if (!readHeader(src, &num_partitions, &fence_bytes))
+	return false;
+    uint64_t index_size = kPartitionedHeaderSize + sizeof(uint64_t) * 2 * (num_partitions + 1);
+    // index_size + fence_bytes may wrap around
+    if (num_partitions > size / sizeof(uint64_t) || index_size > size
+	|| fence_bytes > size - index_size)
+	return false;
+    const uint64_t* fence_offsets = reinterpret_cast<const uint64_t*>(src + kPartitionedHeaderSize);
+    const uint64_t* partition_offsets = fence_offsets + num_partitions + 1;
+    for (uint64_t i = 0; i < num_partitions; i++) {
+	if (fence_offsets[i] > fence_offsets[i + 1]
+	    || partition_offsets[i] > partition_offsets[i + 1])
+	    return false;
+    }
+    if (fence_offsets[num_partitions] > fence_bytes
+	|| partition_offsets[0] < index_size + fence_bytes
+	|| partition_offsets[num_partitions] > size)
+	return false;
+
+    num_partitions_ = num_partitions;
+    fence_offsets_ = fence_offsets;
+    partition_offsets_ = partition_offsets;
+    fence_data_ = src + index_size;
+    data_ = src;
+    partitions_ = new std::atomic<SuRF*>[num_partitions];
+    for (uint64_t i = 0; i < num_partitions; i++)
+	partitions_[i].store(nullptr, std::memory_order_relaxed);
+    return true;
+}
+
+PartitionedSuRF* PartitionedSuRF::deSerialize(const char* src) {
+    uint64_t num_partitions, fence_bytes;
+    if (!readHeader(src, &num_partitions, &fence_bytes))
+	return nullptr;
+    // the last partition offset
+    uint64_t size;
+    memcpy(&size, src + kPartitionedHeaderSize + sizeof(uint64_t) * (2 * num_partitions + 1),
+	   sizeof(uint64_t));
+    char* arena = new char[size];
+    memcpy(arena, src, size);
+    PartitionedSuRF* filter = new PartitionedSuRF();
+    if (!filter->load(arena, size)) {
+	delete[] arena;
+	delete filter;
+	return nullptr;
+    }
+    filter->arena_ = arena;
+    return filter;
+}
+
+PartitionedSuRF* PartitionedSuRF::deSerializeMapped(char* src) {
+    PartitionedSuRF* filter = new PartitionedSuRF();
+    if (!filter->load(src, UINT64_MAX)) {
+	delete filter;
+	return nullptr;
+    }
+    return filter;
+}
+
+PartitionedSuRF* PartitionedSuRF::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+	return nullptr;
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || ((uint64_t)st.st_size < kPartitionedHeaderSize)) {
+	close(fd);
+	return nullptr;
+    }
+    uint64_t size = st.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+	return nullptr;
+    // the index and a few scattered positions per partition are read
+    madvise(addr, size, MADV_RANDOM);
+
+    char* data = reinterpret_cast<char*>(addr);
+    PartitionedSuRF* filter = new PartitionedSuRF();
+    if (!filter->load(data, size)) {
+	munmap(addr, size);
+	delete filter;
+	return nullptr;
+    }
+    filter->mapped_data_ = data;
+    filter->mapped_size_ = size;
+    return filter;
+}
+
+const SuRF* PartitionedSuRF::getPartition(const uint64_t i) const {
+    SuRF* partition = partitions_[i].load(std::memory_order_acquire);
+    if (partition != nullptr)
+	return partition;
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    partition = partitions_[i].load(std::memory_order_relaxed);
+    if (partition == nullptr) {
+	char* src = data_ + partition_offsets_[i];
+	uint64_t size = partition_offsets_[i + 1] - partition_offsets_[i];
+	SuRF::SectionEntry sections[kNumSerializedSections];
+	if ((size < kSerializedHeaderSize) || !SuRF::readHeader(src, sections)
+	    || !SuRF::sectionsInBounds(sections, size))
+	    return nullptr;
+	partition = SuRF::deSerializeMapped(src);
+	partitions_[i].store(partition, std::memory_order_release);
+    }
+    return partition;
+}
+
+uint64_t PartitionedSuRF::numLoadedPartitions() const {
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < num_partitions_; i++)
+	count += (partitions_[i].load(std::memory_order_relaxed) != nullptr);
+    return count;
+}
+
+uint64_t PartitionedSuRF::findPartition(const std::string& key) const {
+    // first fence >= key
+    uint64_t left = 0, right = num_partitions_;
+    while (left < right) {
+	uint64_t mid = left + (right - left) / 2;
+	const char* fence = fence_data_ + fence_offsets_[mid];
+	uint64_t fence_len = fence_offsets_[mid + 1] - fence_offsets_[mid];
+	int compare = memcmp(fence, key.data(), (fence_len < key.size()) ? fence_len : key.size());
+	if (compare < 0 || (compare == 0 && fence_len < key.size()))
+	    left = mid + 1;
+	else
+	    right = mid;
+    }
+    return left;
+}
+
+bool PartitionedSuRF::lookupKey(const std::string& key) const {
+    uint64_t i = findPartition(key);
+    if (i == num_partitions_)
+	return false;
+    const SuRF* partition = getPartition(i);
+    return (partition == nullptr) || partition->lookupKey(key);
+}
+
+bool PartitionedSuRF::lookupRange(const uint64_t i,
+				  const std::string& left_key, const bool left_inclusive,
+				  const std::string& right_key, const bool right_inclusive) const {
+    const SuRF* partition = getPartition(i);
+    if (partition == nullptr)
+	return true;
+    SuRF::Iter iter(partition);
+    return partition->lookupRange(left_key, left_inclusive, right_key, right_inclusive, iter);
+}
+
+bool PartitionedSuRF::lookupRange(const std::string& left_key, const bool left_inclusive,
+				  const std::string& right_key, const bool right_inclusive) const {
+    uint64_t i = findPartition(left_key);
+    if (i == num_partitions_)
+	return false;
+    if (lookupRange(i, left_key, left_inclusive, right_key, right_inclusive))
+	return true;
+    // the keys of partition i + 1 are greater than fence i: if the
+    // range reaches past the fence, the smallest of them may be in it
+    // (and if it is not, no later key is)
+    if (i + 1 == num_partitions_ || getFence(i).compare(right_key) >= 0)
+	return false;
+    return lookupRange(i + 1, left_key, left_inclusive, right_key, right_inclusive);
+}
+
+uint64_t PartitionedSuRF::getMemoryUsage() const {
+    uint64_t size = sizeof(PartitionedSuRF) + sizeof(std::atomic<SuRF*>) * num_partitions_;
+    if (data_ != nullptr)
+	size += partition_offsets_[0];
+    for (uint64_t i = 0; i < num_partitions_; i++) {
+	SuRF* partition = partitions_[i].load(std::memory_order_relaxed);
+	if (partition != nullptr)
+	    size += partition->getMemoryUsage();
+    }
+    return size;
+}
+
+void PartitionedSuRF::destroy() {
+    if (partitions_ != nullptr) {
+	for (uint64_t i = 0; i < num_partitions_; i++) {
+	    SuRF* partition = partitions_[i].load(std::memory_order_relaxed);
+	    if (partition != nullptr) {
+		partition->destroy();
+		delete partition;
+	    }
+	}
+	delete[] partitions_;
+	partitions_ = nullptr;
+    }
+    num_partitions_ = 0;
+    fence_offsets_ = nullptr;
+    partition_offsets_ = nullptr;
+    fence_data_ = nullptr;
+    data_ = nullptr;
+    delete[] arena_;
+    arena_ = nullptr;
+    if (mapped_data_ != nullptr) {
+	munmap(mapped_data_, mapped_size_);
+	mapped_data_ = nullptr;
+	mapped_size_ = 0;
+    }
+}
+
+} // namespace surf
+
+#endif // PARTITIONEDSURF_H_
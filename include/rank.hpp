@@ -7,6 +7,7 @@
 
 #include <vector>
 
+#include "parallel.hpp"
 #include "popcount.h"
 
 namespace surf {
@@ -39,13 +40,20 @@ public:
 		+ popcountLinear(bits_, block_id * word_per_basic_block, offset + 1));
     }
 
+    // Number of 1's before pos (rank of pos - 1; 0 for pos = 0)
+    position_t rankBefore(const position_t pos) const {
+	return (pos == 0) ? 0 : rank(pos - 1);
+    }
+
     position_t rankLutSize() const {
 	return ((num_bits_ / basic_block_size_ + 1) * sizeof(position_t));
     }
 
-    position_t serializedSize() const {
-	position_t size = sizeof(num_bits_) + sizeof(basic_block_size_) 
-	    + bitsSize() + rankLutSize();
+    // Without include_lut, rank_lut_ is left out and rebuilt on load
+    position_t serializedSize(const bool include_lut = true) const {
+	position_t size = sizeof(num_bits_) + sizeof(basic_block_size_) + bitsSize();
+	if (include_lut)
+	    size += rankLutSize();
 	sizeAlign(size);
 	return size;
     }
@@ -59,58 +67,100 @@ public:
 	__builtin_prefetch(rank_lut_ + (pos / basic_block_size_));
     }
 
+    void serialize(SerialSink& sink, const bool include_lut = true) const {
+	sink.write(&num_bits_, sizeof(num_bits_));
+	sink.write(&basic_block_size_, sizeof(basic_block_size_));
+	sink.write(bits_, bitsSize());
+	if (include_lut)
+	    sink.write(rank_lut_, rankLutSize());
+	sink.align();
+    }
+
     void serialize(char*& dst) const {
-	memcpy(dst, &num_bits_, sizeof(num_bits_));
-	dst += sizeof(num_bits_);
-	memcpy(dst, &basic_block_size_, sizeof(basic_block_size_));
-	dst += sizeof(basic_block_size_);
-	memcpy(dst, bits_, bitsSize());
-	dst += bitsSize();
-	memcpy(dst, rank_lut_, rankLutSize());
-	dst += rankLutSize();
-	align(dst);
+	BufferSink sink(dst);
+	serialize(sink);
+	dst = sink.position();
     }
 
-    static BitvectorRank* deSerialize(char*& src) {
+    // If alias is true, bits_ and rank_lut_ point into src, which must
+    // stay valid (and 8-byte aligned) for the lifetime of the object;
+    // destroy() then leaves them alone. has_lut must match
+    // the include_lut used by serialize; without it, the bits are
+    // copied (alias is ignored) and rank_lut_ is recomputed.
+    static BitvectorRank* deSerialize(char*& src, const bool alias = false,
+				      const bool has_lut = true) {
 	BitvectorRank* bv_rank = new BitvectorRank();
 	memcpy(&(bv_rank->num_bits_), src, sizeof(bv_rank->num_bits_));
 	src += sizeof(bv_rank->num_bits_);
 	memcpy(&(bv_rank->basic_block_size_), src, sizeof(bv_rank->basic_block_size_));
 	src += sizeof(bv_rank->basic_block_size_);
 
-	bv_rank->bits_ = new word_t[bv_rank->numWords()];
-	memcpy(bv_rank->bits_, src, bv_rank->bitsSize());
-	src += bv_rank->bitsSize();
-	bv_rank->rank_lut_ = new position_t[bv_rank->rankLutSize() / sizeof(position_t)];
-	memcpy(bv_rank->rank_lut_, src, bv_rank->rankLutSize());
-	src += bv_rank->rankLutSize();
-	
-	//bv_rank->bits_ = const_cast<word_t*>(reinterpret_cast<const word_t*>(src));
-	//src += bv_rank->bitsSize();
-	//bv_rank->rank_lut_ = const_cast<position_t*>(reinterpret_cast<const position_t*>(src));
-	//src += bv_rank->rankLutSize();
-	
+	if (!has_lut) {
+	    bv_rank->bits_ = new word_t[bv_rank->numWords()];
+	    memcpy(bv_rank->bits_, src, bv_rank->bitsSize());
+	    src += bv_rank->bitsSize();
+	    bv_rank->initRankLut();
+	} else if (alias) {
+	    bv_rank->aliased_ = true;
+	    bv_rank->bits_ = reinterpret_cast<word_t*>(src);
+	    src += bv_rank->bitsSize();
+	    bv_rank->rank_lut_ = reinterpret_cast<position_t*>(src);
+	    src += bv_rank->rankLutSize();
+	} else {
+	    bv_rank->bits_ = new word_t[bv_rank->numWords()];
+	    memcpy(bv_rank->bits_, src, bv_rank->bitsSize());
+	    src += bv_rank->bitsSize();
+	    bv_rank->rank_lut_ = new position_t[bv_rank->rankLutSize() / sizeof(position_t)];
+	    memcpy(bv_rank->rank_lut_, src, bv_rank->rankLutSize());
+	    src += bv_rank->rankLutSize();
+	}
 	align(src);
 	return bv_rank;
     }
 
     void destroy() {
+	if (aliased_)
+	    return;
 	delete[] bits_;
 	delete[] rank_lut_;
     }
 
+    // Fills lut (num_bits / basic_block_size + 1 slots) with the number
+    // of 1's before each basic block of bits. The blocks are split among
+    // num_threads threads: each counts its range, then adds the total
+    // of the ranges before it.
+    static void fillRankLut(const word_t* bits, const position_t num_bits,
+			    const position_t basic_block_size, position_t* lut,
+			    const unsigned num_threads) {
+	position_t word_per_basic_block = basic_block_size / kWordSize;
+	position_t num_full_blocks = num_bits / basic_block_size;
+	std::vector<position_t> range_ones(num_threads + 1, 0);
+	parallelFor(num_threads, num_full_blocks,
+		    [&](const unsigned t, const position_t begin, const position_t end) {
+	    position_t cumu_rank = 0;
+	    for (position_t i = begin; i < end; i++) {
+		lut[i] = cumu_rank;
+		cumu_rank += popcountLinear(const_cast<word_t*>(bits),
+					    i * word_per_basic_block, basic_block_size);
+	    }
+	    range_ones[t + 1] = cumu_rank;
+	});
+	for (unsigned t = 0; t < num_threads; t++)
+	    range_ones[t + 1] += range_ones[t];
+	if (num_threads > 1) {
+	    parallelFor(num_threads, num_full_blocks,
+			[&](const unsigned t, const position_t begin, const position_t end) {
+		for (position_t i = begin; i < end; i++)
+		    lut[i] += range_ones[t];
+	    });
+	}
+	lut[num_full_blocks] = range_ones[num_threads];
+    }
+
 private:
     void initRankLut() {
-        position_t word_per_basic_block = basic_block_size_ / kWordSize;
-        position_t num_blocks = num_bits_ / basic_block_size_ + 1;
-	rank_lut_ = new position_t[num_blocks];
-
-        position_t cumu_rank = 0;
-        for (position_t i = 0; i < num_blocks - 1; i++) {
-            rank_lut_[i] = cumu_rank;
-            cumu_rank += popcountLinear(bits_, i * word_per_basic_block, basic_block_size_);
-        }
-	rank_lut_[num_blocks - 1] = cumu_rank;
+	rank_lut_ = new position_t[num_bits_ / basic_block_size_ + 1];
+	fillRankLut(bits_, num_bits_, basic_block_size_, rank_lut_, parallelThreads(numWords()));
     }
 
     position_t basic_block_size_;
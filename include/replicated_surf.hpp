@@ -0,0 +1,181 @@
+#ifndef REPLICATEDSURF_H_
+#define REPLICATEDSURF_H_
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+// Parses a sysfs cpu list such as "0-3,8,10-11"
+inline std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+	int first = 0, last = 0;
+	int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+	if (n < 1)
+	    continue;
+	if (n == 1)
+	    last = first;
+	for (int cpu = first; cpu <= last; cpu++)
+	    cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Reads the first line of a sysfs file; empty if it cannot be read
+inline std::string readSysfsLine(const std::string& path) {
+    std::ifstream in(path.c_str());
+    std::string line;
+    if (in.good())
+	std::getline(in, line);
+    return line;
+}
+
+// Ids of the online NUMA nodes, from /sys/devices/system/node/online
+// (which may have gaps, e.g., "0,2-3"); empty if the system reports none
+inline std::vector<int> numaNodeIds() {
+    return parseCpuList(readSysfsLine("/sys/devices/system/node/online"));
+}
+
+// CPUs of a NUMA node, from its sysfs cpulist
+inline std::vector<int> numaNodeCpuList(const int node) {
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    return parseCpuList(readSysfsLine(path.str()));
+}
+
+// CPUs of each online NUMA node that has any; one node with every CPU
+// if the system reports none.
+inline std::vector<std::vector<int> > numaNodeCpus() {
+    std::vector<std::vector<int> > nodes;
+    std::vector<int> node_ids = numaNodeIds();
+    for (size_t i = 0; i < node_ids.size(); i++) {
+	std::vector<int> cpus = numaNodeCpuList(node_ids[i]);
+	if (!cpus.empty())
+	    nodes.push_back(cpus);
+    }
+    if (nodes.empty()) {
+	unsigned num_cpus = std::thread::hardware_concurrency();
+	nodes.push_back(std::vector<int>());
+	for (unsigned cpu = 0; cpu < ((num_cpus > 0) ? num_cpus : 1); cpu++)
+	    nodes[0].push_back(cpu);
+    }
+    return nodes;
+}
+
+// Read-only copies of a SuRF, one per NUMA node, each allocated by a
+// thread bound to its node so that the kernel's first-touch policy
+// places its arena in that node's memory. Queries go to the replica of
+// the node the calling thread runs on, so the dependent rank/select
+// misses of a lookup stay in local memory. Threads that may migrate
+// should be pinned (to CPUs of one node) for the routing to be stable.
+class ReplicatedSuRF {
+public:
+    // Copies filter (which can be destroyed afterwards) onto every node
+    explicit ReplicatedSuRF(const SuRF& filter);
+
+    ~ReplicatedSuRF() {
+	for (unsigned i = 0; i < replicas_.size(); i++) {
+	    replicas_[i]->destroy();
+	    delete replicas_[i];
+	}
+    }
+
+    unsigned numReplicas() const {
+	return replicas_.size();
+    }
+
+    const SuRF* getReplica(const unsigned i) const {
+	return replicas_[i];
+    }
+
+    // Replica of the calling thread's node; SuRF::Iter's for range
+    // queries should be made from it (e.g., once per pinned thread)
+    const SuRF* local() const {
+	int cpu = sched_getcpu();
+	if (cpu < 0 || cpu >= (int)cpu_replicas_.size())
+	    return replicas_[0];
+	return replicas_[cpu_replicas_[cpu]];
+    }
+
+    bool lookupKey(const std::string& key) const {
+	return local()->lookupKey(key);
+    }
+
+    bool lookupKey(const std::string& key, const uint32_t key_hash) const {
+	return local()->lookupKey(key, key_hash);
+    }
+
+    bool lookupRange(const std::string& left_key, const bool left_inclusive,
+		     const std::string& right_key, const bool right_inclusive) const {
+	const SuRF* replica = local();
+	SuRF::Iter iter(replica);
+	return replica->lookupRange(left_key, left_inclusive, right_key, right_inclusive, iter);
+    }
+
+    uint64_t approxCount(const std::string& left_key, const std::string& right_key) const {
+	const SuRF* replica = local();
+	SuRF::Iter iter(replica), iter2(replica);
+	return replica->approxCount(left_key, right_key, iter, iter2);
+    }
+
+    // Summed over the replicas
+    uint64_t getMemoryUsage() const {
+	uint64_t size = 0;
+	for (unsigned i = 0; i < replicas_.size(); i++)
+	    size += replicas_[i]->getMemoryUsage();
+	return size;
+    }
+
+    ReplicatedSuRF(const ReplicatedSuRF&) = delete;
+    ReplicatedSuRF& operator=(const ReplicatedSuRF&) = delete;
+
+private:
+    std::vector<SuRF*> replicas_;
+    // replica index by cpu id
+    std::vector<unsigned> cpu_replicas_;
+};
+
+ReplicatedSuRF::ReplicatedSuRF(const SuRF& filter) {
+    std::vector<std::vector<int> > nodes = numaNodeCpus();
+    replicas_.resize(nodes.size(), nullptr);
+    for (unsigned i = 0; i < nodes.size(); i++) {
+	for (unsigned j = 0; j < nodes[i].size(); j++) {
+	    int cpu = nodes[i][j];
+	    if (cpu >= (int)cpu_replicas_.size())
+		cpu_replicas_.resize(cpu + 1, 0);
+	    cpu_replicas_[cpu] = i;
+	}
+	// The copy is made on a CPU of the node. If the thread cannot be
+	// bound there (e.g., the node's CPUs are outside this process's
+	// cpuset), the replica is still made, wherever the thread runs.
+	std::thread builder([&, i] {
+	    cpu_set_t set;
+	    CPU_ZERO(&set);
+	    for (unsigned j = 0; j < nodes[i].size(); j++)
+		if (nodes[i][j] < CPU_SETSIZE)
+		    CPU_SET(nodes[i][j], &set);
+	    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	    char* data = filter.serialize();
+	    replicas_[i] = SuRF::deSerialize(data);
+	    delete[] data;
+	});
+	builder.join();
+    }
+}
+
+} // namespace surf
+
+#endif // REPLICATEDSURF_H_
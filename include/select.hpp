@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "config.hpp"
+#include "parallel.hpp"
 #include "popcount.h"
 
 namespace surf {
@@ -69,9 +70,13 @@ public:
 	return ((num_ones_ / sample_interval_ + 1) * sizeof(position_t));
     }
 
-    position_t serializedSize() const {
-	position_t size = sizeof(num_bits_) + sizeof(sample_interval_) + sizeof(num_ones_)
-	    + bitsSize() + selectLutSize();
+    // Without include_lut, select_lut_ is left out and rebuilt on load
+    position_t serializedSize(const bool include_lut = true) const {
+	position_t size = sizeof(num_bits_) + sizeof(sample_interval_) + sizeof(num_ones_);
+	sizeAlign(size);
+	size += bitsSize();
+	if (include_lut)
+	    size += selectLutSize();
 	sizeAlign(size);
 	return size;
     }
@@ -84,21 +89,26 @@ public:
 	return num_ones_;
     }
 
+    void serialize(SerialSink& sink, const bool include_lut = true) const {
+	sink.write(&num_bits_, sizeof(num_bits_));
+	sink.write(&sample_interval_, sizeof(sample_interval_));
+	sink.write(&num_ones_, sizeof(num_ones_));
+	sink.align();
+	sink.write(bits_, bitsSize());
+	if (include_lut)
+	    sink.write(select_lut_, selectLutSize());
+	sink.align();
+    }
+
     void serialize(char*& dst) const {
-	memcpy(dst, &num_bits_, sizeof(num_bits_));
-	dst += sizeof(num_bits_);
-	memcpy(dst, &sample_interval_, sizeof(sample_interval_));
-	dst += sizeof(sample_interval_);
-	memcpy(dst, &num_ones_, sizeof(num_ones_));
-	dst += sizeof(num_ones_);
-	memcpy(dst, bits_, bitsSize());
-	dst += bitsSize();
-	memcpy(dst, select_lut_, selectLutSize());
-	dst += selectLutSize();
-	align(dst);
+	BufferSink sink(dst);
+	serialize(sink);
+	dst = sink.position();
     }
 
-    static BitvectorSelect* deSerialize(char*& src) {
+    // See BitvectorRank::deSerialize for alias and has_lut.
+    static BitvectorSelect* deSerialize(char*& src, const bool alias = false,
+					const bool has_lut = true) {
 	BitvectorSelect* bv_select = new BitvectorSelect();
 	memcpy(&(bv_select->num_bits_), src, sizeof(bv_select->num_bits_));
 	src += sizeof(bv_select->num_bits_);
@@ -106,55 +116,86 @@ public:
 	src += sizeof(bv_select->sample_interval_);
 	memcpy(&(bv_select->num_ones_), src, sizeof(bv_select->num_ones_));
 	src += sizeof(bv_select->num_ones_);
+	align(src);
 
-	bv_select->bits_ = new word_t[bv_select->numWords()];
-	memcpy(bv_select->bits_, src, bv_select->bitsSize());
-	src += bv_select->bitsSize();
-	bv_select->select_lut_ = new position_t[bv_select->selectLutSize() / sizeof(position_t)];
-	memcpy(bv_select->select_lut_, src, bv_select->selectLutSize());
-	src += bv_select->selectLutSize();
-	
-	//bv_select->bits_ = const_cast<word_t*>(reinterpret_cast<const word_t*>(src));
-	//src += bv_select->bitsSize();
-	//bv_select->select_lut_ = const_cast<position_t*>(reinterpret_cast<const position_t*>(src));
-	//src += bv_select->selectLutSize();
+	if (!has_lut) {
+	    bv_select->bits_ = new word_t[bv_select->numWords()];
+	    memcpy(bv_select->bits_, src, bv_select->bitsSize());
+	    src += bv_select->bitsSize();
+	    bv_select->initSelectLut();
+	} else if (alias) {
+	    bv_select->aliased_ = true;
+	    bv_select->bits_ = reinterpret_cast<word_t*>(src);
+	    src += bv_select->bitsSize();
+	    bv_select->select_lut_ = reinterpret_cast<position_t*>(src);
+	    src += bv_select->selectLutSize();
+	} else {
+	    bv_select->bits_ = new word_t[bv_select->numWords()];
+	    memcpy(bv_select->bits_, src, bv_select->bitsSize());
+	    src += bv_select->bitsSize();
+	    bv_select->select_lut_ = new position_t[bv_select->selectLutSize() / sizeof(position_t)];
+	    memcpy(bv_select->select_lut_, src, bv_select->selectLutSize());
+	    src += bv_select->selectLutSize();
+	}
 	align(src);
 	return bv_select;
     }
 
     void destroy() {
+	if (aliased_)
+	    return;
 	delete[] bits_;
 	delete[] select_lut_;
     }
 
-private:
-    // This function currently assumes that the first bit in the
-    // bitvector is one.
-    void initSelectLut() {
-	position_t num_words = num_bits_ / kWordSize;
-	if (num_bits_ % kWordSize != 0)
+    // Counts the 1's of bits and allocates (new[]) and fills lut with
+    // num_ones / sample_interval + 1 slots: the position of the first 1,
+    // then of every (i * sample_interval)-th 1. The words are split among
+    // num_threads threads: the first pass counts the 1's of each range,
+    // the second samples each range starting from the count before it.
+    // Assumes that the first bit is one. Returns num_ones.
+    static position_t buildSelectLut(const word_t* bits, const position_t num_bits,
+				     const position_t sample_interval, position_t*& lut,
+				     const unsigned num_threads) {
+	position_t num_words = num_bits / kWordSize;
+	if (num_bits % kWordSize != 0)
 	    num_words++;
 
-	std::vector<position_t> select_lut_vector;
-	select_lut_vector.push_back(0); //ASSERT: first bit is 1
-	position_t sampling_ones = sample_interval_;
-	position_t cumu_ones_upto_word = 0;
-	for (position_t i = 0; i < num_words; i++) {
-	    position_t num_ones_in_word = popcount(bits_[i]);
-	    while (sampling_ones <= (cumu_ones_upto_word + num_ones_in_word)) {
-		int diff = sampling_ones - cumu_ones_upto_word;
-		position_t result_pos = i * kWordSize + select64_popcount_search(bits_[i], diff);
-		select_lut_vector.push_back(result_pos);
-		sampling_ones += sample_interval_;
+	std::vector<position_t> range_ones(num_threads + 1, 0);
+	parallelFor(num_threads, num_words,
+		    [&](const unsigned t, const position_t begin, const position_t end) {
+	    if (end > begin)
+		range_ones[t + 1] = popcountLinear(const_cast<word_t*>(bits), begin,
+						   (end - begin) * kWordSize);
+	});
+	for (unsigned t = 0; t < num_threads; t++)
+	    range_ones[t + 1] += range_ones[t];
+	position_t num_ones = range_ones[num_threads];
+
+	lut = new position_t[num_ones / sample_interval + 1];
+	lut[0] = 0; //ASSERT: first bit is 1
+	parallelFor(num_threads, num_words,
+		    [&](const unsigned t, const position_t begin, const position_t end) {
+	    position_t cumu_ones_upto_word = range_ones[t];
+	    position_t sampling_ones = (cumu_ones_upto_word / sample_interval + 1) * sample_interval;
+	    for (position_t i = begin; i < end; i++) {
+		position_t num_ones_in_word = popcount(bits[i]);
+		while (sampling_ones <= (cumu_ones_upto_word + num_ones_in_word)) {
+		    int diff = sampling_ones - cumu_ones_upto_word;
+		    position_t result_pos = i * kWordSize + select64_popcount_search(bits[i], diff);
+		    lut[sampling_ones / sample_interval] = result_pos;
+		    sampling_ones += sample_interval;
+		}
+		cumu_ones_upto_word += num_ones_in_word;
 	    }
-	    cumu_ones_upto_word += popcount(bits_[i]);
-	}
+	});
+	return num_ones;
+    }
 
-	num_ones_ = cumu_ones_upto_word;
-	position_t num_samples = select_lut_vector.size();
-	select_lut_ = new position_t[num_samples];
-	for (position_t i = 0; i < num_samples; i++)
-	    select_lut_[i] = select_lut_vector[i];
+private:
+    void initSelectLut() {
+	num_ones_ = buildSelectLut(bits_, num_bits_, sample_interval_, select_lut_,
+				   parallelThreads(numWords()));
     }
 
 private:
@@ -0,0 +1,162 @@
+#ifndef SERIALSINK_H_
+#define SERIALSINK_H_
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <functional>
+
+#include "config.hpp"
+
+namespace surf {
+
+// Destination of a serialized filter. The serialize functions write
+// through a SerialSink, so the same code fills a buffer (BufferSink)
+// or streams to a file or callback (StreamSink) without staging the
+// whole filter in memory.
+class SerialSink {
+public:
+    virtual ~SerialSink() {}
+
+    void write(const void* src, const uint64_t size) {
+	if (ok_ && (size > 0))
+	    ok_ = append(reinterpret_cast<const char*>(src), size);
+	offset_ += size;
+    }
+
+    // Pads with zeros to the next 8-byte boundary (see align())
+    void align() {
+	static const char kZeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	uint64_t padding = ((offset_ + 7) & ~((uint64_t)7)) - offset_;
+	write(kZeros, padding);
+    }
+
+    uint64_t offset() const { return offset_; }
+    // false once a write failed; later writes are dropped
+    bool ok() const { return ok_; }
+
+protected:
+    explicit SerialSink(const uint64_t start_offset) : offset_(start_offset), ok_(true) {}
+    virtual bool append(const char* src, const uint64_t size) = 0;
+
+protected:
+    uint64_t offset_;
+    bool ok_;
+};
+
+// Writes to a buffer large enough for the serialized object. Padding
+// follows the address of dst, as align() does.
+class BufferSink : public SerialSink {
+public:
+    explicit BufferSink(char* dst) : SerialSink((uint64_t)dst & 7), dst_(dst) {}
+
+    char* position() const { return dst_; }
+
+protected:
+    bool append(const char* src, const uint64_t size) {
+	memcpy(dst_, src, size);
+	dst_ += size;
+	return true;
+    }
+
+private:
+    char* dst_;
+};
+
+// Hands the serialized bytes to writer in chunks of chunk_size bytes
+// (the last one may be shorter) from a staging buffer aligned to
+// kDirectIOAlignment. With direct_io, the last chunk is zero-padded to
+// a multiple of kDirectIOAlignment, so that writer can pass every chunk
+// to a file opened with O_DIRECT. Call finish() after the last write.
+class StreamSink : public SerialSink {
+public:
+    typedef std::function<bool(const char* data, const uint64_t size)> Writer;
+
+    static const uint64_t kDirectIOAlignment = 4096;
+    static const uint64_t kDefaultChunkSize = (1 << 20);
+
+    // chunk_size is rounded up to a multiple of kDirectIOAlignment
+    StreamSink(const Writer& writer, const bool direct_io = false,
+	       const uint64_t chunk_size = kDefaultChunkSize)
+	: SerialSink(0), writer_(writer), direct_io_(direct_io), chunk_(nullptr), chunk_used_(0) {
+	chunk_size_ = (chunk_size + kDirectIOAlignment - 1) & ~(kDirectIOAlignment - 1);
+	if (chunk_size_ == 0)
+	    chunk_size_ = kDirectIOAlignment;
+	void* chunk = nullptr;
+	if (posix_memalign(&chunk, kDirectIOAlignment, chunk_size_) != 0)
+	    ok_ = false;
+	chunk_ = reinterpret_cast<char*>(chunk);
+    }
+
+    ~StreamSink() {
+	free(chunk_);
+    }
+
+    // Writes out the buffered tail; returns ok()
+    bool finish();
+
+    // Writer for a file descriptor; retries partial writes
+    static bool writeToFd(const int fd, const char* data, uint64_t size);
+
+protected:
+    bool append(const char* src, const uint64_t size);
+
+private:
+    Writer writer_;
+    bool direct_io_;
+    char* chunk_;
+    uint64_t chunk_size_;
+    uint64_t chunk_used_;
+};
+
+bool StreamSink::append(const char* src, const uint64_t size) {
+    uint64_t remaining = size;
+    while (remaining > 0) {
+	uint64_t len = chunk_size_ - chunk_used_;
+	if (len > remaining)
+	    len = remaining;
+	memcpy(chunk_ + chunk_used_, src, len);
+	chunk_used_ += len;
+	src += len;
+	remaining -= len;
+	if (chunk_used_ == chunk_size_) {
+	    if (!writer_(chunk_, chunk_size_))
+		return false;
+	    chunk_used_ = 0;
+	}
+    }
+    return true;
+}
+
+bool StreamSink::finish() {
+    if (!ok_ || (chunk_used_ == 0))
+	return ok_;
+    uint64_t len = chunk_used_;
+    if (direct_io_) {
+	len = (len + kDirectIOAlignment - 1) & ~(kDirectIOAlignment - 1);
+	memset(chunk_ + chunk_used_, 0, len - chunk_used_);
+    }
+    ok_ = writer_(chunk_, len);
+    chunk_used_ = 0;
+    return ok_;
+}
+
+bool StreamSink::writeToFd(const int fd, const char* data, uint64_t size) {
+    while (size > 0) {
+	ssize_t len = ::write(fd, data, size);
+	if (len < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return false;
+	}
+	data += len;
+	size -= len;
+    }
+    return true;
+}
+
+} // namespace surf
+
+#endif // SERIALSINK_H_
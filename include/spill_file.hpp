@@ -0,0 +1,127 @@
+#ifndef SPILLFILE_H_
+#define SPILLFILE_H_
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "serial_sink.hpp"
+
+namespace surf {
+
+// An unlinked temporary file holding several append-only byte streams
+// (e.g., one per builder vector and trie level). Appends go to the end
+// of the file; the file offsets of each stream's chunks are kept in
+// memory, so a stream can be read back in order. The file is removed
+// when closed.
+class SpillFile {
+public:
+    typedef std::function<bool(const char* data, const uint64_t size)> Reader;
+
+    static const uint64_t kReadBufferSize = (1 << 20);
+
+    SpillFile() : fd_(-1), size_(0) {};
+
+    ~SpillFile() {
+	close();
+    }
+
+    // Creates the file in directory dir
+    bool open(const std::string& dir);
+    void close();
+
+    bool append(const uint32_t stream, const void* data, const uint64_t size);
+
+    uint64_t streamSize(const uint32_t stream) const {
+	if (stream >= chunks_.size())
+	    return 0;
+	uint64_t size = 0;
+	for (position_t i = 0; i < chunks_[stream].size(); i++)
+	    size += chunks_[stream][i].size;
+	return size;
+    }
+
+    // Passes the stream to reader in pieces of at most kReadBufferSize
+    // bytes; a piece never splits an 8-byte word of a chunk whose size
+    // is a multiple of 8. Returns false on a read error or if reader
+    // returns false.
+    bool read(const uint32_t stream, const Reader& reader) const;
+
+private:
+    struct Chunk {
+	uint64_t offset;
+	uint64_t size;
+    };
+
+    int fd_;
+    uint64_t size_;
+    std::vector<std::vector<Chunk> > chunks_;
+};
+
+bool SpillFile::open(const std::string& dir) {
+    close();
+    std::string path = dir + "/surf_spill_XXXXXX";
+    std::vector<char> path_buf(path.begin(), path.end());
+    path_buf.push_back('\0');
+    fd_ = mkstemp(path_buf.data());
+    if (fd_ < 0)
+	return false;
+    unlink(path_buf.data());
+    return true;
+}
+
+void SpillFile::close() {
+    if (fd_ >= 0)
+	::close(fd_);
+    fd_ = -1;
+    size_ = 0;
+    chunks_.clear();
+}
+
+bool SpillFile::append(const uint32_t stream, const void* data, const uint64_t size) {
+    if (size == 0)
+	return true;
+    if (!StreamSink::writeToFd(fd_, reinterpret_cast<const char*>(data), size))
+	return false;
+    if (stream >= chunks_.size())
+	chunks_.resize(stream + 1);
+    Chunk chunk = {size_, size};
+    chunks_[stream].push_back(chunk);
+    size_ += size;
+    return true;
+}
+
+bool SpillFile::read(const uint32_t stream, const Reader& reader) const {
+    if (stream >= chunks_.size())
+	return true;
+    std::vector<char> buf(kReadBufferSize);
+    for (position_t i = 0; i < chunks_[stream].size(); i++) {
+	uint64_t offset = chunks_[stream][i].offset;
+	uint64_t remaining = chunks_[stream][i].size;
+	while (remaining > 0) {
+	    uint64_t len = (remaining < kReadBufferSize) ? remaining : kReadBufferSize;
+	    uint64_t done = 0;
+	    while (done < len) {
+		ssize_t n = pread(fd_, buf.data() + done, len - done, offset + done);
+		if ((n < 0) && (errno == EINTR))
+		    continue;
+		if (n <= 0)
+		    return false;
+		done += n;
+	    }
+	    if (!reader(buf.data(), len))
+		return false;
+	    offset += len;
+	    remaining -= len;
+	}
+    }
+    return true;
+}
+
+} // namespace surf
+
+#endif // SPILLFILE_H_
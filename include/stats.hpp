@@ -0,0 +1,209 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdio.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "config.hpp"
+
+// Query path counters, compiled in only with -DSURF_STATS (cmake
+// -DSURF_STATS=ON). Every thread counts into its own slot;
+// getQueryStats() sums the slots. Without SURF_STATS the SURF_STAT_*
+// macros expand to nothing and getQueryStats() returns zeros.
+
+namespace surf {
+
+// sparse misses are counted per level; deeper levels share the last counter
+static const level_t kStatsMaxLevel = 64;
+
+enum QueryStat {
+    kStatLookups = 0,        // SuRF::lookupKey and SuRF::startLookup calls
+    kStatLevels,             // trie levels descended by lookups
+    kStatDenseMisses,        // lookup rejected in louds-dense
+    kStatDenseLeaves,        // lookup reached a leaf (or prefix key) in louds-dense
+    kStatSparseLeaves,       // lookup reached a leaf in louds-sparse
+    kStatTerminatorHits,     // key ran out at a terminator label in louds-sparse
+    kStatSuffixChecks,       // BitvectorSuffix::checkEquality calls
+    kStatSuffixMismatches,   // ... that returned false
+    kStatSearchLinear,       // LabelVector::search kernels
+    kStatSearchBinary,
+    kStatSearchSimd,
+    kStatSparseMisses,       // lookup rejected in louds-sparse at level 0, 1, ...
+    kNumQueryStats = kStatSparseMisses + kStatsMaxLevel
+};
+
+struct QueryStats {
+    uint64_t counts[kNumQueryStats];
+
+    QueryStats() {
+	for (int i = 0; i < kNumQueryStats; i++)
+	    counts[i] = 0;
+    }
+
+    uint64_t get(const QueryStat stat) const {
+	return counts[stat];
+    }
+
+    uint64_t sparseMisses(const level_t level) const {
+	return counts[kStatSparseMisses + ((level < kStatsMaxLevel) ? level : (kStatsMaxLevel - 1))];
+    }
+
+    uint64_t totalSparseMisses() const {
+	uint64_t sum = 0;
+	for (level_t level = 0; level < kStatsMaxLevel; level++)
+	    sum += counts[kStatSparseMisses + level];
+	return sum;
+    }
+
+    void print(FILE* out = stdout) const;
+};
+
+// Counters that every thread writes into its own slot (relaxed atomics
+// with a single writer, so no cache line is shared between writers) and
+// that are summed on demand. Tag only keeps different counter sets
+// apart.
+template <typename Tag, int kNumCounters>
+class PerThreadCounters {
+public:
+    class Slot {
+    public:
+	Slot();
+	~Slot();
+
+	void add(const int counter, const uint64_t n) {
+	    // only this thread writes the slot: no read-modify-write needed
+	    counts_[counter].store(counts_[counter].load(std::memory_order_relaxed) + n,
+				   std::memory_order_relaxed);
+	}
+
+	void addTo(uint64_t* sums) const {
+	    for (int i = 0; i < kNumCounters; i++)
+		sums[i] += counts_[i].load(std::memory_order_relaxed);
+	}
+
+    private:
+	std::atomic<uint64_t> counts_[kNumCounters];
+    };
+
+    static Slot& local() {
+	static thread_local Slot slot;
+	return slot;
+    }
+
+    // Counts since the last reset, over all threads (including exited ones)
+    static void snapshot(uint64_t* counts);
+    // Counting continues; later snapshots are relative to this point
+    static void reset();
+
+private:
+    struct Shared {
+	Shared() {
+	    for (int i = 0; i < kNumCounters; i++) {
+		exited[i] = 0;
+		baseline[i] = 0;
+	    }
+	}
+
+	std::mutex mutex;
+	std::vector<Slot*> slots;
+	uint64_t exited[kNumCounters];   // counts of threads that have exited
+	uint64_t baseline[kNumCounters]; // total at the last reset
+    };
+
+    static Shared& shared() {
+	static Shared s;
+	return s;
+    }
+
+    // requires the mutex
+    static void total(uint64_t* counts) {
+	Shared& s = shared();
+	for (int i = 0; i < kNumCounters; i++)
+	    counts[i] = s.exited[i];
+	for (size_t i = 0; i < s.slots.size(); i++)
+	    s.slots[i]->addTo(counts);
+    }
+};
+
+template <typename Tag, int kNumCounters>
+PerThreadCounters<Tag, kNumCounters>::Slot::Slot() {
+    for (int i = 0; i < kNumCounters; i++)
+	counts_[i].store(0, std::memory_order_relaxed);
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.slots.push_back(this);
+}
+
+template <typename Tag, int kNumCounters>
+PerThreadCounters<Tag, kNumCounters>::Slot::~Slot() {
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    addTo(s.exited);
+    for (size_t i = 0; i < s.slots.size(); i++) {
+	if (s.slots[i] == this) {
+	    s.slots.erase(s.slots.begin() + i);
+	    break;
+	}
+    }
+}
+
+template <typename Tag, int kNumCounters>
+void PerThreadCounters<Tag, kNumCounters>::snapshot(uint64_t* counts) {
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    total(counts);
+    for (int i = 0; i < kNumCounters; i++)
+	counts[i] -= s.baseline[i];
+}
+
+template <typename Tag, int kNumCounters>
+void PerThreadCounters<Tag, kNumCounters>::reset() {
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    total(s.baseline);
+}
+
+typedef PerThreadCounters<QueryStats, kNumQueryStats> QueryStatsRegistry;
+
+inline QueryStats getQueryStats() {
+    QueryStats stats;
+    QueryStatsRegistry::snapshot(stats.counts);
+    return stats;
+}
+
+inline void resetQueryStats() {
+    QueryStatsRegistry::reset();
+}
+
+void QueryStats::print(FILE* out) const {
+    static const char* kNames[kStatSparseMisses] = {
+	"lookups", "levels", "dense misses", "dense leaves", "sparse leaves",
+	"terminator hits", "suffix checks", "suffix mismatches",
+	"search linear", "search binary", "search simd"};
+    for (int i = 0; i < kStatSparseMisses; i++)
+	fprintf(out, "%s = %lu\n", kNames[i], counts[i]);
+    fprintf(out, "sparse misses = %lu\n", totalSparseMisses());
+    for (level_t level = 0; level < kStatsMaxLevel; level++)
+	if (counts[kStatSparseMisses + level] > 0)
+	    fprintf(out, "  level %u%s = %lu\n", level,
+		    (level == kStatsMaxLevel - 1) ? "+" : "",
+		    counts[kStatSparseMisses + level]);
+}
+
+} // namespace surf
+
+#ifdef SURF_STATS
+#define SURF_STAT_ADD(stat, n) surf::QueryStatsRegistry::local().add((stat), (n))
+#define SURF_STAT_SPARSE_MISS(level) \
+    SURF_STAT_ADD(surf::kStatSparseMisses \
+		  + (((level) < surf::kStatsMaxLevel) ? (level) : (surf::kStatsMaxLevel - 1)), 1)
+#else
+#define SURF_STAT_ADD(stat, n) ((void)0)
+#define SURF_STAT_SPARSE_MISS(level) ((void)0)
+#endif
+#define SURF_STAT_INC(stat) SURF_STAT_ADD(stat, 1)
+
+#endif // STATS_H_
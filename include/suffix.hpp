@@ -9,6 +9,8 @@
 
 #include "config.hpp"
 #include "hash.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 namespace surf {
 
@@ -18,28 +20,35 @@ namespace surf {
 // to indicate that there is no suffix info associated with the key.
 class BitvectorSuffix : public Bitvector {
 public:
-    BitvectorSuffix() : type_(kNone), hash_suffix_len_(0), real_suffix_len_(0) {};
+    BitvectorSuffix() : type_(kNone), hash_suffix_len_(0), real_suffix_len_(0),
+			hash_type_(kHashLevelDB) {};
 
     BitvectorSuffix(const SuffixType type,
                     const level_t hash_suffix_len, const level_t real_suffix_len,
                     const std::vector<std::vector<word_t> >& bitvector_per_level,
                     const std::vector<position_t>& num_bits_per_level,
                     const level_t start_level = 0,
-                    level_t end_level = 0/* non-inclusive */)
+                    level_t end_level = 0/* non-inclusive */,
+		    const SuffixHashType hash_type = kHashLevelDB)
 	: Bitvector(bitvector_per_level, num_bits_per_level, start_level, end_level) {
 	assert((hash_suffix_len + real_suffix_len) <= kWordSize);
 	type_ = type;
 	hash_suffix_len_ = hash_suffix_len;
         real_suffix_len_ = real_suffix_len;
+	hash_type_ = hash_type;
     }
 
-    static word_t constructHashSuffix(const std::string& key, const level_t len) {
-	word_t suffix = suffixHash(key);
+    static word_t constructHashSuffix(const uint32_t key_hash, const level_t len) {
+	word_t suffix = key_hash;
 	suffix <<= (kWordSize - len - kHashShift);
 	suffix >>= (kWordSize - len);
 	return suffix;
     }
 
+    static word_t constructHashSuffix(const std::string& key, const level_t len) {
+	return constructHashSuffix(suffixHash(key), len);
+    }
+
     static word_t constructRealSuffix(const std::string& key,
 				      const level_t level, const level_t len) {
 	if (key.length() < level || ((key.length() - level) * 8) < len)
@@ -64,9 +73,10 @@ public:
 	return suffix;
     }
 
-    static word_t constructMixedSuffix(const std::string& key, const level_t hash_len,
+    static word_t constructMixedSuffix(const std::string& key, const uint32_t key_hash,
+				       const level_t hash_len,
 				       const level_t real_level, const level_t real_len) {
-        word_t hash_suffix = constructHashSuffix(key, hash_len);
+        word_t hash_suffix = constructHashSuffix(key_hash, hash_len);
         word_t real_suffix = constructRealSuffix(key, real_level, real_len);
         word_t suffix = hash_suffix;
         suffix <<= real_len;
@@ -74,21 +84,31 @@ public:
         return suffix;
     }
 
+    // key_hash is only used by kHash and kMixed suffixes
     static word_t constructSuffix(const SuffixType type, const std::string& key,
-                                  const level_t hash_len,
+				  const uint32_t key_hash, const level_t hash_len,
                                   const level_t real_level, const level_t real_len) {
 	switch (type) {
 	case kHash:
-	    return constructHashSuffix(key, hash_len);
+	    return constructHashSuffix(key_hash, hash_len);
 	case kReal:
 	    return constructRealSuffix(key, real_level, real_len);
         case kMixed:
-            return constructMixedSuffix(key, hash_len, real_level, real_len);
+            return constructMixedSuffix(key, key_hash, hash_len, real_level, real_len);
 	default:
 	    return 0;
         }
     }
 
+    static word_t constructSuffix(const SuffixType type, const std::string& key,
+                                  const level_t hash_len,
+                                  const level_t real_level, const level_t real_len) {
+	uint32_t key_hash = 0;
+	if ((type == kHash) || (type == kMixed))
+	    key_hash = suffixHash(key);
+	return constructSuffix(type, key, key_hash, hash_len, real_level, real_len);
+    }
+
     static word_t extractHashSuffix(const word_t suffix, const level_t real_suffix_len) {
         return (suffix >> real_suffix_len);
     }
@@ -116,9 +136,19 @@ public:
 	return real_suffix_len_;
     }
 
+    SuffixHashType getHashType() const {
+	return hash_type_;
+    }
+
+    uint32_t hashKey(const std::string& key) const {
+	return suffixHash(hash_type_, key);
+    }
+
     position_t serializedSize() const {
 	position_t size = sizeof(num_bits_) + sizeof(type_)
-            + sizeof(hash_suffix_len_) + sizeof(real_suffix_len_) + bitsSize();
+            + sizeof(hash_suffix_len_) + sizeof(real_suffix_len_) + sizeof(hash_type_);
+	sizeAlign(size);
+	size += bitsSize();
 	sizeAlign(size);
 	return size;
     }
@@ -129,29 +159,35 @@ public:
 
     word_t read(const position_t idx) const;
     word_t readReal(const position_t idx) const;
-    bool checkEquality(const position_t idx, const std::string& key, const level_t level) const;
+    // key_hash: hashKey(key) precomputed by the caller; computed here
+    // if nullptr and needed by the suffix type
+    bool checkEquality(const position_t idx, const std::string& key, const level_t level,
+		       const uint32_t* key_hash = nullptr) const;
 
     // Compare stored suffix to querying suffix.
     // kReal suffix type only.
     int compare(const position_t idx, const std::string& key, const level_t level) const;
 
+    void serialize(SerialSink& sink) const {
+	sink.write(&num_bits_, sizeof(num_bits_));
+	sink.write(&type_, sizeof(type_));
+	sink.write(&hash_suffix_len_, sizeof(hash_suffix_len_));
+        sink.write(&real_suffix_len_, sizeof(real_suffix_len_));
+	sink.write(&hash_type_, sizeof(hash_type_));
+	sink.align();
+	if (type_ != kNone)
+	    sink.write(bits_, bitsSize());
+	sink.align();
+    }
+
     void serialize(char*& dst) const {
-	memcpy(dst, &num_bits_, sizeof(num_bits_));
-	dst += sizeof(num_bits_);
-	memcpy(dst, &type_, sizeof(type_));
-	dst += sizeof(type_);
-	memcpy(dst, &hash_suffix_len_, sizeof(hash_suffix_len_));
-	dst += sizeof(hash_suffix_len_);
-        memcpy(dst, &real_suffix_len_, sizeof(real_suffix_len_));
-	dst += sizeof(real_suffix_len_);
-	if (type_ != kNone) {
-	    memcpy(dst, bits_, bitsSize());
-	    dst += bitsSize();
-	}
-	align(dst);
+	BufferSink sink(dst);
+	serialize(sink);
+	dst = sink.position();
     }
 
-    static BitvectorSuffix* deSerialize(char*& src) {
+    // See BitvectorRank::deSerialize for alias.
+    static BitvectorSuffix* deSerialize(char*& src, const bool alias = false) {
 	BitvectorSuffix* sv = new BitvectorSuffix();
 	memcpy(&(sv->num_bits_), src, sizeof(sv->num_bits_));
 	src += sizeof(sv->num_bits_);
@@ -161,20 +197,25 @@ public:
 	src += sizeof(sv->hash_suffix_len_);
         memcpy(&(sv->real_suffix_len_), src, sizeof(sv->real_suffix_len_));
 	src += sizeof(sv->real_suffix_len_);
+	memcpy(&(sv->hash_type_), src, sizeof(sv->hash_type_));
+	src += sizeof(sv->hash_type_);
+	align(src);
 	if (sv->type_ != kNone) {
-	    sv->bits_ = new word_t[sv->numWords()];
-	    memcpy(sv->bits_, src, sv->bitsSize());
+	    if (alias) {
+		sv->aliased_ = true;
+		sv->bits_ = reinterpret_cast<word_t*>(src);
+	    } else {
+		sv->bits_ = new word_t[sv->numWords()];
+		memcpy(sv->bits_, src, sv->bitsSize());
+	    }
 	    src += sv->bitsSize();
-	    
-	    //sv->bits_ = const_cast<word_t*>(reinterpret_cast<const word_t*>(src));
-	    //src += sv->bitsSize();
 	}
 	align(src);
 	return sv;
     }
 
     void destroy() {
-	if (type_ != kNone)
+	if ((type_ != kNone) && !aliased_)
 	    delete[] bits_;
     }
 
@@ -182,6 +223,7 @@ private:
     SuffixType type_;
     level_t hash_suffix_len_; // in bits
     level_t real_suffix_len_; // in bits
+    SuffixHashType hash_type_;
 };
 
 word_t BitvectorSuffix::read(const position_t idx) const {
@@ -206,11 +248,16 @@ word_t BitvectorSuffix::readReal(const position_t idx) const {
 }
 
 bool BitvectorSuffix::checkEquality(const position_t idx, 
-				    const std::string& key, const level_t level) const {
+				    const std::string& key, const level_t level,
+				    const uint32_t* key_hash) const {
+    SURF_STAT_INC(kStatSuffixChecks);
+    SURF_TRACE_PHASE(kPhaseSuffix);
     if (type_ == kNone) 
 	return true;
-    if (idx * getSuffixLen() >= num_bits_) 
+    if (idx * getSuffixLen() >= num_bits_) {
+	SURF_STAT_INC(kStatSuffixMismatches);
 	return false;
+    }
 
     word_t stored_suffix = read(idx);
     if (type_ == kReal) {
@@ -218,12 +265,21 @@ bool BitvectorSuffix::checkEquality(const position_t idx,
 	if (stored_suffix == 0) 
 	    return true;
 	// if the querying key is shorter than the stored key
-	if (key.length() < level || ((key.length() - level) * 8) < real_suffix_len_) 
+	if (key.length() < level || ((key.length() - level) * 8) < real_suffix_len_) {
+	    SURF_STAT_INC(kStatSuffixMismatches);
 	    return false;
+	}
     }
+    uint32_t querying_hash = 0;
+    if (type_ != kReal)
+	querying_hash = key_hash ? *key_hash : hashKey(key);
     word_t querying_suffix 
-	= constructSuffix(type_, key, hash_suffix_len_, level, real_suffix_len_);
-    return (stored_suffix == querying_suffix);
+	= constructSuffix(type_, key, querying_hash, hash_suffix_len_, level, real_suffix_len_);
+    if (stored_suffix != querying_suffix) {
+	SURF_STAT_INC(kStatSuffixMismatches);
+	return false;
+    }
+    return true;
 }
 
 // If no real suffix is stored for the key, compare returns 0.
@@ -248,6 +304,7 @@ bool BitvectorSuffix::checkEquality(const position_t idx,
 
 int BitvectorSuffix::compare(const position_t idx, 
 			     const std::string& key, const level_t level) const {
+    SURF_TRACE_PHASE(kPhaseSuffix);
     if ((idx * getSuffixLen() >= num_bits_) || (type_ == kNone) || (type_ == kHash))
 	return kCouldBePositive;
 
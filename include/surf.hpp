@@ -1,12 +1,22 @@
 #ifndef SURF_H_
 #define SURF_H_
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <string>
 #include <vector>
 
 #include "config.hpp"
+#include "key_file.hpp"
 #include "louds_dense.hpp"
 #include "louds_sparse.hpp"
+#include "serial_sink.hpp"
+#include "spill_file.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 #include "surf_builder.hpp"
 
 namespace surf {
@@ -50,35 +60,114 @@ public:
 	friend class SuRF;
     };
 
+    // Progress of a point lookup executed one trie level at a time
+    // (see startLookup/lookupStep).
+    struct LookupState {
+	const std::string* key;
+	uint32_t key_hash;
+	bool in_sparse;
+	level_t level;
+	position_t pos; // louds-dense: node number; louds-sparse: label position
+	bool result;
+    };
+
+    // Entry of the serialized section directory; offset is from the
+    // start of the serialized buffer.
+    struct SectionEntry {
+	uint64_t offset;
+	uint64_t size;
+    };
+
 public:
-    SuRF() {};
+    SuRF() : louds_dense_(nullptr), louds_sparse_(nullptr), builder_(nullptr),
+	     arena_(nullptr), mapped_data_(nullptr), mapped_size_(0) {};
 
     //------------------------------------------------------------------
     // Input keys must be SORTED
     //------------------------------------------------------------------
-    SuRF(const std::vector<std::string>& keys) {
+    SuRF(const std::vector<std::string>& keys) : SuRF() {
 	create(keys, kIncludeDense, kSparseDenseRatio, kNone, 0, 0);
     }
 
     SuRF(const std::vector<std::string>& keys, const SuffixType suffix_type,
-	 const level_t hash_suffix_len, const level_t real_suffix_len) {
+	 const level_t hash_suffix_len, const level_t real_suffix_len) : SuRF() {
 	create(keys, kIncludeDense, kSparseDenseRatio, suffix_type, hash_suffix_len, real_suffix_len);
     }
     
     SuRF(const std::vector<std::string>& keys,
 	 const bool include_dense, const uint32_t sparse_dense_ratio,
-	 const SuffixType suffix_type, const level_t hash_suffix_len, const level_t real_suffix_len) {
+	 const SuffixType suffix_type, const level_t hash_suffix_len, const level_t real_suffix_len)
+	: SuRF() {
 	create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
     }
 
-    ~SuRF() {}
+    SuRF(const std::vector<std::string>& keys,
+	 const bool include_dense, const uint32_t sparse_dense_ratio,
+	 const SuffixType suffix_type, const level_t hash_suffix_len, const level_t real_suffix_len,
+	 const LoudsEncoding louds_encoding,
+	 const SuffixHashType hash_type = kHashLevelDB) : SuRF() {
+	create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len,
+	       louds_encoding, hash_type);
+    }
+
+    //------------------------------------------------------------------
+    // Picks the suffix type/lengths and the dense cutoff to fit the
+    // serialized filter into bits_per_key * keys.size() bits
+    //------------------------------------------------------------------
+    SuRF(const std::vector<std::string>& keys,
+	 const double bits_per_key, const QueryPriority priority) : SuRF() {
+	createWithBudget(keys, kIncludeDense, kSparseDenseRatio, bits_per_key, priority);
+    }
+
+    // A SuRF owns its memory: moving transfers it, and the destructor
+    // (or an earlier destroy()) frees it.
+    SuRF(SuRF&& other) noexcept : SuRF() {
+	moveFrom(other);
+    }
+
+    SuRF& operator=(SuRF&& other) noexcept {
+	if (this != &other) {
+	    destroy();
+	    moveFrom(other);
+	}
+	return *this;
+    }
+
+    SuRF(const SuRF&) = delete;
+    SuRF& operator=(const SuRF&) = delete;
+
+    ~SuRF() {
+	destroy();
+    }
 
     void create(const std::vector<std::string>& keys,
 		const bool include_dense, const uint32_t sparse_dense_ratio,
 		const SuffixType suffix_type,
-                const level_t hash_suffix_len, const level_t real_suffix_len);
+                const level_t hash_suffix_len, const level_t real_suffix_len,
+		const LoudsEncoding louds_encoding = kLoudsBitvector,
+		const SuffixHashType hash_type = kHashLevelDB);
+
+    void createWithBudget(const std::vector<std::string>& keys,
+			  const bool include_dense, const uint32_t sparse_dense_ratio,
+			  const double bits_per_key, const QueryPriority priority);
 
     bool lookupKey(const std::string& key) const;
+    // Same as above, with key_hash = hashKey(key) computed by the caller
+    // (e.g., once per key when probing several filters built with the
+    // same hash type).
+    bool lookupKey(const std::string& key, const uint32_t key_hash) const;
+    // Hash of key under this filter's suffix hash type
+    uint32_t hashKey(const std::string& key) const;
+    SuffixHashType getSuffixHashType() const;
+    SuffixType getSuffixType() const;
+    // lookupKey(key, key_hash) split into steps of one trie level each,
+    // so that lookups in several filters can be interleaved and overlap
+    // their cache misses. key must outlive the lookup. lookupStep
+    // returns true once the lookup is finished; the answer is then in
+    // state.result.
+    void startLookup(const std::string& key, const uint32_t key_hash,
+		     SuRF::LookupState& state) const;
+    bool lookupStep(SuRF::LookupState& state) const;
     // This function searches in a conservative way: if inclusive is true
     // and the stored key prefix matches key, iter stays at this key prefix.
     SuRF::Iter moveToKeyGreaterThan(const std::string& key, const bool inclusive) const;
@@ -87,36 +176,129 @@ public:
     SuRF::Iter moveToLast() const;
     bool lookupRange(const std::string& left_key, const bool left_inclusive, 
 		     const std::string& right_key, const bool right_inclusive);
+    // Same as above, with the caller's iterator (SuRF::Iter(this)) as
+    // scratch space instead of the filter's, so that several threads
+    // can run range queries on one filter, each with its own iterator
+    bool lookupRange(const std::string& left_key, const bool left_inclusive, 
+		     const std::string& right_key, const bool right_inclusive,
+		     SuRF::Iter& iter) const;
     // Accurate except at the boundaries --> undercount by at most 2
     uint64_t approxCount(const std::string& left_key, const std::string& right_key);
-    uint64_t approxCount(const SuRF::Iter* iter, const SuRF::Iter* iter2);
+    // Thread-safe form, as lookupRange above
+    uint64_t approxCount(const std::string& left_key, const std::string& right_key,
+			 SuRF::Iter& iter, SuRF::Iter& iter2) const;
+    uint64_t approxCount(const SuRF::Iter* iter, const SuRF::Iter* iter2) const;
+    // counts[i] = approxCount(boundaries[i], boundaries[i + 1]) for the
+    // SORTED boundaries, in one sweep: each search resumes below the
+    // levels its path shares with the previous boundary's, which also
+    // keep their rank terms; boundaries past the last key are not searched.
+    void approxCounts(const std::vector<std::string>& boundaries,
+		      std::vector<uint64_t>& counts) const;
+    // Number of keys; exact, from the leaf counts of the trie
+    uint64_t numKeys() const;
+    // Stored prefix of the k-th smallest key (k from 0), found by a
+    // descent that binary-searches each node's labels by the key counts
+    // of their subtries. Exactly k keys sort before it, so it splits
+    // the key set at rank k. Empty if k >= numKeys().
+    std::string selectKey(const uint64_t k) const;
+    // The num_parts - 1 selectKey's at ranks i * numKeys() / num_parts,
+    // which split the keys into num_parts equi-depth parts (e.g., for
+    // parallel range scans); fewer if there are fewer keys than parts
+    void quantiles(const unsigned num_parts, std::vector<std::string>& split_keys) const;
+    // If lookupKey(key), sets id to the ordinal of the matching stored
+    // key in key order (0 to numKeys() - 1; selectKey(id) is its stored
+    // prefix), so that stored keys map one-to-one and in order onto the
+    // slots of an external array. A false positive gets the id of the
+    // stored key it matched.
+    bool leafId(const std::string& key, uint64_t& id) const;
+    // Same as above, with key_hash = hashKey(key) computed by the caller
+    bool leafId(const std::string& key, const uint32_t key_hash, uint64_t& id) const;
 
-    uint64_t serializedSize() const;
+    uint64_t serializedSize(const SerializeFormat format = kSerializeFull) const;
     uint64_t getMemoryUsage() const;
     level_t getHeight() const;
     level_t getSparseStartLevel() const;
 
-    char* serialize() const {
-	uint64_t size = serializedSize();
-	char* data = new char[size];
-	char* cur_data = data;
-	louds_dense_->serialize(cur_data);
-	louds_sparse_->serialize(cur_data);
-	assert(cur_data - data == (int64_t)size);
-	return data;
-    }
+    // Layout: header (kSerializedMagic, kSerializedVersion,
+    // kNumSerializedSections, format; uint32_t each), the section
+    // directory (kNumSerializedSections SectionEntry's), then the
+    // LoudsDense sections followed by the LoudsSparse sections.
+    char* serialize(const SerializeFormat format = kSerializeFull) const;
+    // Streams the serialize() bytes to sink; returns sink.ok()
+    bool serialize(SerialSink& sink, const SerializeFormat format = kSerializeFull) const;
+    // Streams to writer in chunks (see StreamSink), so that no copy of
+    // the whole filter is staged in memory
+    bool serialize(const StreamSink::Writer& writer, const bool direct_io = false,
+		   const SerializeFormat format = kSerializeFull) const;
+    // Writes at the current offset of fd. Use direct_io if fd is opened
+    // with O_DIRECT (at an aligned offset); the zero-padded tail is then
+    // truncated away after writing.
+    bool serialize(const int fd, const bool direct_io = false,
+		   const SerializeFormat format = kSerializeFull) const;
 
+    // Checks magic, version and format and fills sections with the
+    // directory; lets a reader fetch (e.g., pread) only the sections it
+    // needs.
+    static bool readHeader(const char* src, SectionEntry* sections,
+			   SerializeFormat* format = nullptr);
+    // Whether every section of the directory lies within the first size
+    // bytes (size: of the file or buffer the header was read from)
+    static bool sectionsInBounds(const SectionEntry* sections, const uint64_t size);
+
+    // Copies src into the new filter's arena (kSerializeFull) or
+    // rebuilds the vectors from it (kSerializeCompact); src can be freed
+    // afterwards. Returns nullptr if src is not a serialized SuRF of
+    // this version.
     static SuRF* deSerialize(char* src) {
-	SuRF* surf = new SuRF();
-	surf->louds_dense_ = LoudsDense::deSerialize(src);
-	surf->louds_sparse_ = LoudsSparse::deSerialize(src);
-	surf->iter_ = SuRF::Iter(surf);
-	return surf;
+	return deSerialize(src, false);
     }
 
+    // Same as deSerialize, but only the (small) louds-dense part is
+    // copied; the louds-sparse vectors point into src, which must stay
+    // valid until destroy().
+    static SuRF* deSerializeMapped(char* src) {
+	return deSerialize(src, true);
+    }
+
+    // Builds a filter from a sorted key file without holding the keys or
+    // the whole trie in memory: the builder keeps its per-level vectors
+    // under about memory_limit bytes by spilling them to a temporary
+    // file in tmp_dir, and the sparse levels are streamed from there to
+    // out_path (kSerializeCompact format, kLoudsBitvector encoding).
+    // Load the result with open(). Returns false on failure.
+    static bool buildFile(const std::string& key_path, const KeyFileFormat key_format,
+			  const std::string& out_path, const uint64_t memory_limit,
+			  const std::string& tmp_dir,
+			  const bool include_dense, const uint32_t sparse_dense_ratio,
+			  const SuffixType suffix_type,
+			  const level_t hash_suffix_len, const level_t real_suffix_len,
+			  const SuffixHashType hash_type = kHashLevelDB);
+
+    // Maps a file written from serialize() read-only and loads it with
+    // deSerializeMapped, so louds-sparse pages are faulted in on demand
+    // (kSerializeFull only; compact files are loaded in full).
+    // Returns nullptr on failure.
+    static SuRF* open(const std::string& path);
+
+    // Frees the filter; safe to call more than once
     void destroy() {
-	louds_dense_->destroy();
-	louds_sparse_->destroy();
+	if (louds_dense_ != nullptr) {
+	    louds_dense_->destroy();
+	    delete louds_dense_;
+	    louds_dense_ = nullptr;
+	}
+	if (louds_sparse_ != nullptr) {
+	    louds_sparse_->destroy();
+	    delete louds_sparse_;
+	    louds_sparse_ = nullptr;
+	}
+	delete[] arena_;
+	arena_ = nullptr;
+	if (mapped_data_ != nullptr) {
+	    munmap(mapped_data_, mapped_size_);
+	    mapped_data_ = nullptr;
+	    mapped_size_ = 0;
+	}
     }
 
 private:
@@ -125,22 +307,283 @@ private:
     SuRFBuilder* builder_;
     SuRF::Iter iter_;
     SuRF::Iter iter2_;
+    // Buffer holding all vectors in serialized (i.e., query access)
+    // order; the tries point into it. nullptr for compact or mapped
+    // loads, where the vectors are allocated separately or mapped.
+    char* arena_;
+    // set if loaded by open(); unmapped in destroy()
+    char* mapped_data_;
+    uint64_t mapped_size_;
+
+    static SuRF* deSerialize(char* src, const bool mapped);
+    // selectKey without the k < numKeys() check
+    std::string selectKeyAt(uint64_t k) const;
+    // Re-positions iter, keeping the first num_kept levels of its path
+    // (at most matchedLevels(key, iter)); 0 searches from the root
+    void moveToKeyGreaterThan(const std::string& key, const bool inclusive,
+			      const level_t num_kept, SuRF::Iter& iter) const;
+    // Levels of iter's path, dense then sparse, that a search for key
+    // passes through unchanged
+    level_t matchedLevels(const std::string& key, const SuRF::Iter& iter) const;
+    // Writes the header and the section directory
+    static void writeHeader(SerialSink& sink, const uint64_t* section_sizes,
+			    const SerializeFormat format);
+    void load(char* src, const SectionEntry* sections, const bool has_luts,
+	      const bool alias_dense, const bool alias_sparse);
+    void moveToArena();
+    void moveFrom(SuRF& other);
 };
 
 void SuRF::create(const std::vector<std::string>& keys, 
 		  const bool include_dense, const uint32_t sparse_dense_ratio,
 		  const SuffixType suffix_type,
-                  const level_t hash_suffix_len, const level_t real_suffix_len) {
+                  const level_t hash_suffix_len, const level_t real_suffix_len,
+		  const LoudsEncoding louds_encoding,
+		  const SuffixHashType hash_type) {
+    destroy();
     builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio,
-                              suffix_type, hash_suffix_len, real_suffix_len);
+                              suffix_type, hash_suffix_len, real_suffix_len,
+			      louds_encoding, hash_type);
     builder_->build(keys);
     louds_dense_ = new LoudsDense(builder_);
     louds_sparse_ = new LoudsSparse(builder_);
-    iter_ = SuRF::Iter(this);
     delete builder_;
+    builder_ = nullptr;
+    moveToArena();
+}
+
+void SuRF::createWithBudget(const std::vector<std::string>& keys,
+			    const bool include_dense, const uint32_t sparse_dense_ratio,
+			    const double bits_per_key, const QueryPriority priority) {
+    destroy();
+    builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, kNone, 0, 0);
+    builder_->buildWithBudget(keys, bits_per_key, priority);
+    louds_dense_ = new LoudsDense(builder_);
+    louds_sparse_ = new LoudsSparse(builder_);
+    delete builder_;
+    builder_ = nullptr;
+    moveToArena();
+}
+
+// Replaces the separately allocated vectors built from the builder
+// with one arena; costs one extra copy of the filter at build time.
+void SuRF::moveToArena() {
+    char* arena = serialize();
+    SectionEntry sections[kNumSerializedSections];
+    readHeader(arena, sections);
+    destroy();
+    load(arena, sections, true, true, true);
+    arena_ = arena;
+}
+
+void SuRF::moveFrom(SuRF& other) {
+    louds_dense_ = other.louds_dense_;
+    louds_sparse_ = other.louds_sparse_;
+    iter_ = other.iter_;
+    iter2_ = other.iter2_;
+    arena_ = other.arena_;
+    mapped_data_ = other.mapped_data_;
+    mapped_size_ = other.mapped_size_;
+    other.louds_dense_ = nullptr;
+    other.louds_sparse_ = nullptr;
+    other.arena_ = nullptr;
+    other.mapped_data_ = nullptr;
+    other.mapped_size_ = 0;
+}
+
+char* SuRF::serialize(const SerializeFormat format) const {
+    uint64_t size = serializedSize(format);
+    char* data = new char[size];
+    BufferSink sink(data);
+    serialize(sink, format);
+    assert(sink.position() - data == (int64_t)size);
+    return data;
+}
+
+void SuRF::writeHeader(SerialSink& sink, const uint64_t* section_sizes,
+		       const SerializeFormat format) {
+    uint32_t header[4] = {kSerializedMagic, kSerializedVersion, kNumSerializedSections,
+			  (uint32_t)format};
+    sink.write(header, sizeof(header));
+
+    SectionEntry sections[kNumSerializedSections];
+    uint64_t offset = kSerializedHeaderSize;
+    for (uint32_t i = 0; i < kNumSerializedSections; i++) {
+	sections[i].offset = offset;
+	sections[i].size = section_sizes[i];
+	offset += section_sizes[i];
+    }
+    sink.write(sections, sizeof(sections));
+}
+
+bool SuRF::serialize(SerialSink& sink, const SerializeFormat format) const {
+    bool include_luts = (format == kSerializeFull);
+    uint64_t section_sizes[kNumSerializedSections];
+    louds_dense_->sectionSizes(section_sizes, include_luts);
+    louds_sparse_->sectionSizes(section_sizes + LoudsDense::kNumSections, include_luts);
+    writeHeader(sink, section_sizes, format);
+
+    louds_dense_->serialize(sink, include_luts);
+    louds_sparse_->serialize(sink, include_luts);
+    return sink.ok();
+}
+
+bool SuRF::serialize(const StreamSink::Writer& writer, const bool direct_io,
+		     const SerializeFormat format) const {
+    StreamSink sink(writer, direct_io);
+    serialize(sink, format);
+    return sink.finish();
+}
+
+bool SuRF::serialize(const int fd, const bool direct_io,
+		     const SerializeFormat format) const {
+    off_t start = 0;
+    if (direct_io) {
+	start = lseek(fd, 0, SEEK_CUR);
+	if (start < 0)
+	    return false;
+    }
+    StreamSink::Writer writer = [fd](const char* data, const uint64_t size) {
+	return StreamSink::writeToFd(fd, data, size);
+    };
+    if (!serialize(writer, direct_io, format))
+	return false;
+    if (direct_io)
+	return (ftruncate(fd, start + serializedSize(format)) == 0);
+    return true;
+}
+
+bool SuRF::buildFile(const std::string& key_path, const KeyFileFormat key_format,
+		     const std::string& out_path, const uint64_t memory_limit,
+		     const std::string& tmp_dir,
+		     const bool include_dense, const uint32_t sparse_dense_ratio,
+		     const SuffixType suffix_type,
+		     const level_t hash_suffix_len, const level_t real_suffix_len,
+		     const SuffixHashType hash_type) {
+    KeyFile keys;
+    SpillFile spill;
+    if (!keys.open(key_path, key_format) || !spill.open(tmp_dir))
+	return false;
+    SuRFBuilder builder(include_dense, sparse_dense_ratio, suffix_type,
+			hash_suffix_len, real_suffix_len, kLoudsBitvector, hash_type);
+    if (!builder.build(keys, &spill, memory_limit))
+	return false;
+    keys.close();
+
+    int fd = ::open(out_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0)
+	return false;
+    StreamSink::Writer writer = [fd](const char* data, const uint64_t size) {
+	return StreamSink::writeToFd(fd, data, size);
+    };
+    StreamSink sink(writer);
+
+    LoudsDense louds_dense(&builder);
+    uint64_t section_sizes[kNumSerializedSections];
+    louds_dense.sectionSizes(section_sizes, false);
+    LoudsSparse::compactSectionSizes(&builder, section_sizes + LoudsDense::kNumSections);
+    writeHeader(sink, section_sizes, kSerializeCompact);
+    louds_dense.serialize(sink, false);
+    louds_dense.destroy();
+    bool ok = LoudsSparse::serializeCompact(sink, &builder) && sink.finish();
+    return ((close(fd) == 0) && ok);
+}
+
+bool SuRF::readHeader(const char* src, SectionEntry* sections,
+		      SerializeFormat* format) {
+    uint32_t header[4];
+    memcpy(header, src, sizeof(header));
+    if ((header[0] != kSerializedMagic) || (header[1] != kSerializedVersion)
+	|| (header[2] != kNumSerializedSections) || (header[3] > kSerializeCompact))
+	return false;
+    memcpy(sections, src + sizeof(header), sizeof(SectionEntry) * kNumSerializedSections);
+    if (format != nullptr)
+	*format = (SerializeFormat)header[3];
+    return true;
+}
+
+bool SuRF::sectionsInBounds(const SectionEntry* sections, const uint64_t size) {
+    for (uint32_t i = 0; i < kNumSerializedSections; i++) {
+	// offset + size may wrap around
+	if ((sections[i].offset > size) || (sections[i].size > size - sections[i].offset))
+	    return false;
+    }
+    return true;
+}
+
+SuRF* SuRF::deSerialize(char* src, const bool mapped) {
+    SectionEntry sections[kNumSerializedSections];
+    SerializeFormat format;
+    if (!readHeader(src, sections, &format))
+	return nullptr;
+
+    SuRF* surf = new SuRF();
+    if (format == kSerializeCompact) {
+	surf->load(src, sections, false, false, false);
+    } else if (mapped) {
+	surf->load(src, sections, true, false, true);
+    } else {
+	const SectionEntry& last = sections[kNumSerializedSections - 1];
+	uint64_t size = last.offset + last.size;
+	surf->arena_ = new char[size];
+	memcpy(surf->arena_, src, size);
+	surf->load(surf->arena_, sections, true, true, true);
+    }
+    return surf;
+}
+
+void SuRF::load(char* src, const SectionEntry* sections, const bool has_luts,
+		const bool alias_dense, const bool alias_sparse) {
+    char* section_ptrs[kNumSerializedSections];
+    for (uint32_t i = 0; i < kNumSerializedSections; i++)
+	section_ptrs[i] = src + sections[i].offset;
+    louds_dense_ = LoudsDense::deSerialize(section_ptrs, alias_dense, has_luts);
+    louds_sparse_ = LoudsSparse::deSerialize(section_ptrs + LoudsDense::kNumSections,
+					     alias_sparse, has_luts);
+    iter_ = SuRF::Iter(this);
+}
+
+SuRF* SuRF::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+	return nullptr;
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || ((uint64_t)st.st_size < kSerializedHeaderSize)) {
+	close(fd);
+	return nullptr;
+    }
+    uint64_t size = st.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+	return nullptr;
+    char* data = reinterpret_cast<char*>(addr);
+
+    SectionEntry sections[kNumSerializedSections];
+    SerializeFormat format;
+    if (!readHeader(data, sections, &format) || !sectionsInBounds(sections, size)) {
+	munmap(addr, size);
+	return nullptr;
+    }
+    if (format == kSerializeCompact) {
+	// every vector is copied to rebuild its LUT; nothing to keep mapped
+	madvise(addr, size, MADV_SEQUENTIAL);
+	SuRF* surf = deSerialize(data);
+	munmap(addr, size);
+	return surf;
+    }
+    // louds-sparse is probed at a few scattered positions per lookup
+    madvise(addr, size, MADV_RANDOM);
+
+    SuRF* surf = deSerializeMapped(data);
+    surf->mapped_data_ = data;
+    surf->mapped_size_ = size;
+    return surf;
 }
 
 bool SuRF::lookupKey(const std::string& key) const {
+    SURF_STAT_INC(kStatLookups);
+    SURF_TRACE_QUERY();
     position_t connect_node_num = 0;
     if (!louds_dense_->lookupKey(key, connect_node_num))
 	return false;
@@ -149,32 +592,106 @@ bool SuRF::lookupKey(const std::string& key) const {
     return true;
 }
 
+bool SuRF::lookupKey(const std::string& key, const uint32_t key_hash) const {
+    SURF_STAT_INC(kStatLookups);
+    SURF_TRACE_QUERY();
+    position_t connect_node_num = 0;
+    if (!louds_dense_->lookupKey(key, connect_node_num, &key_hash))
+	return false;
+    else if (connect_node_num != 0)
+	return louds_sparse_->lookupKey(key, connect_node_num, &key_hash);
+    return true;
+}
+
+uint32_t SuRF::hashKey(const std::string& key) const {
+    return louds_sparse_->hashKey(key);
+}
+
+SuffixHashType SuRF::getSuffixHashType() const {
+    return louds_sparse_->getSuffixHashType();
+}
+
+SuffixType SuRF::getSuffixType() const {
+    return louds_sparse_->getSuffixType();
+}
+
+void SuRF::startLookup(const std::string& key, const uint32_t key_hash,
+		       SuRF::LookupState& state) const {
+    SURF_STAT_INC(kStatLookups);
+    state.key = &key;
+    state.key_hash = key_hash;
+    state.in_sparse = false;
+    state.level = 0;
+    state.pos = 0;
+    state.result = false;
+}
+
+bool SuRF::lookupStep(SuRF::LookupState& state) const {
+    if (state.in_sparse)
+	return louds_sparse_->lookupKeyStep(*state.key, state.level, state.pos,
+					    state.result, &state.key_hash);
+    if (state.level < louds_dense_->getHeight())
+	return louds_dense_->lookupKeyStep(*state.key, state.level, state.pos,
+					   state.result, &state.key_hash);
+    // louds-dense is done; continue in louds-sparse as lookupKey does
+    if (state.pos == 0) {
+	state.result = true;
+	return true;
+    }
+    state.pos = louds_sparse_->lookupKeyStart(state.pos);
+    state.in_sparse = true;
+    return false;
+}
+
 SuRF::Iter SuRF::moveToKeyGreaterThan(const std::string& key, const bool inclusive) const {
+    SURF_TRACE_QUERY();
     SuRF::Iter iter(this);
-    iter.could_be_fp_ = louds_dense_->moveToKeyGreaterThan(key, inclusive, iter.dense_iter_);
+    moveToKeyGreaterThan(key, inclusive, 0, iter);
+    return iter;
+}
+
+void SuRF::moveToKeyGreaterThan(const std::string& key, const bool inclusive,
+				const level_t num_kept, SuRF::Iter& iter) const {
+    level_t dense_height = louds_dense_->getHeight();
+    level_t dense_kept = num_kept;
+    if (dense_kept > dense_height)
+	dense_kept = dense_height;
+    if (num_kept <= dense_height)
+	iter.sparse_iter_.clear();
+    iter.could_be_fp_ = louds_dense_->moveToKeyGreaterThan(key, inclusive, iter.dense_iter_,
+							  dense_kept);
 
     if (!iter.dense_iter_.isValid())
-	return iter;
+	return;
     if (iter.dense_iter_.isComplete())
-	return iter;
+	return;
 
     if (!iter.dense_iter_.isSearchComplete()) {
 	iter.passToSparse();
-	iter.could_be_fp_ = louds_sparse_->moveToKeyGreaterThan(key, inclusive, iter.sparse_iter_);
+	iter.could_be_fp_ = louds_sparse_->moveToKeyGreaterThan(key, inclusive, iter.sparse_iter_,
+								num_kept - dense_kept);
 	if (!iter.sparse_iter_.isValid())
 	    iter.incrementDenseIter();
-	return iter;
+	return;
     } else if (!iter.dense_iter_.isMoveLeftComplete()) {
 	iter.passToSparse();
 	iter.sparse_iter_.moveToLeftMostKey();
-	return iter;
+	return;
     }
 
     assert(false); // shouldn't reach here
-    return iter;
+}
+
+level_t SuRF::matchedLevels(const std::string& key, const SuRF::Iter& iter) const {
+    level_t num_matched = iter.dense_iter_.matchedLevels(key);
+    // all dense levels match only on a path that continues in louds-sparse
+    if (num_matched == louds_dense_->getHeight())
+	num_matched += iter.sparse_iter_.matchedLevels(key);
+    return num_matched;
 }
 
 SuRF::Iter SuRF::moveToKeyLessThan(const std::string& key, const bool inclusive) const {
+    SURF_TRACE_QUERY();
     SuRF::Iter iter = moveToKeyGreaterThan(key, false);
     if (!iter.isValid()) {
 	iter = moveToLast();
@@ -222,23 +739,30 @@ SuRF::Iter SuRF::moveToLast() const {
 
 bool SuRF::lookupRange(const std::string& left_key, const bool left_inclusive, 
 		       const std::string& right_key, const bool right_inclusive) {
-    iter_.clear();
-    louds_dense_->moveToKeyGreaterThan(left_key, left_inclusive, iter_.dense_iter_);
-    if (!iter_.dense_iter_.isValid()) return false;
-    if (!iter_.dense_iter_.isComplete()) {
-	if (!iter_.dense_iter_.isSearchComplete()) {
-	    iter_.passToSparse();
-	    louds_sparse_->moveToKeyGreaterThan(left_key, left_inclusive, iter_.sparse_iter_);
-	    if (!iter_.sparse_iter_.isValid()) {
-		iter_.incrementDenseIter();
+    return lookupRange(left_key, left_inclusive, right_key, right_inclusive, iter_);
+}
+
+bool SuRF::lookupRange(const std::string& left_key, const bool left_inclusive, 
+		       const std::string& right_key, const bool right_inclusive,
+		       SuRF::Iter& iter) const {
+    SURF_TRACE_QUERY();
+    iter.clear();
+    louds_dense_->moveToKeyGreaterThan(left_key, left_inclusive, iter.dense_iter_);
+    if (!iter.dense_iter_.isValid()) return false;
+    if (!iter.dense_iter_.isComplete()) {
+	if (!iter.dense_iter_.isSearchComplete()) {
+	    iter.passToSparse();
+	    louds_sparse_->moveToKeyGreaterThan(left_key, left_inclusive, iter.sparse_iter_);
+	    if (!iter.sparse_iter_.isValid()) {
+		iter.incrementDenseIter();
 	    }
-	} else if (!iter_.dense_iter_.isMoveLeftComplete()) {
-	    iter_.passToSparse();
-	    iter_.sparse_iter_.moveToLeftMostKey();
+	} else if (!iter.dense_iter_.isMoveLeftComplete()) {
+	    iter.passToSparse();
+	    iter.sparse_iter_.moveToLeftMostKey();
 	}
     }
-    if (!iter_.isValid()) return false;
-    int compare = iter_.compare(right_key);
+    if (!iter.isValid()) return false;
+    int compare = iter.compare(right_key);
     if (compare == kCouldBePositive)
 	return true;
     if (right_inclusive)
@@ -247,7 +771,8 @@ bool SuRF::lookupRange(const std::string& left_key, const bool left_inclusive,
 	return (compare < 0);
 }
 
-uint64_t SuRF::approxCount(const SuRF::Iter* iter, const SuRF::Iter* iter2) {
+uint64_t SuRF::approxCount(const SuRF::Iter* iter, const SuRF::Iter* iter2) const {
+    SURF_TRACE_QUERY();
     if (!iter->isValid() || !iter2->isValid()) return 0;
     position_t out_node_num_left = 0, out_node_num_right = 0;
     uint64_t count = louds_dense_->approxCount(&(iter->dense_iter_),
@@ -263,19 +788,120 @@ uint64_t SuRF::approxCount(const SuRF::Iter* iter, const SuRF::Iter* iter2) {
 
 uint64_t SuRF::approxCount(const std::string& left_key,
 			   const std::string& right_key) {
-    iter_.clear(); iter2_.clear();
-    iter_ = moveToKeyGreaterThan(left_key, true);
-    if (!iter_.isValid()) return 0;
-    iter2_ = moveToKeyGreaterThan(right_key, true);
-    if (!iter2_.isValid())
-	iter2_ = moveToLast();
+    return approxCount(left_key, right_key, iter_, iter2_);
+}
+
+uint64_t SuRF::approxCount(const std::string& left_key, const std::string& right_key,
+			   SuRF::Iter& iter, SuRF::Iter& iter2) const {
+    SURF_TRACE_QUERY();
+    iter.clear(); iter2.clear();
+    iter = moveToKeyGreaterThan(left_key, true);
+    if (!iter.isValid()) return 0;
+    iter2 = moveToKeyGreaterThan(right_key, true);
+    if (!iter2.isValid())
+	iter2 = moveToLast();
+
+    return approxCount(&iter, &iter2);
+}
+
+void SuRF::approxCounts(const std::vector<std::string>& boundaries,
+			std::vector<uint64_t>& counts) const {
+    SURF_TRACE_QUERY();
+    counts.clear();
+    if (boundaries.size() < 2)
+	return;
+    counts.resize(boundaries.size() - 1, 0);
+    // An interval is the difference of its two boundaries' terms. Each
+    // boundary starts as a copy of the previous one and recomputes only
+    // the levels where its path differs
+    LoudsDense::CountBoundary dense_left, dense_right;
+    LoudsSparse::CountBoundary sparse_left, sparse_right;
+    SuRF::Iter iter(this);
+    moveToKeyGreaterThan(boundaries[0], true, 0, iter);
+    if (!iter.isValid())
+	return;
+    louds_dense_->approxCountBoundary(&(iter.dense_iter_), dense_left);
+    louds_sparse_->approxCountBoundary(&(iter.sparse_iter_), dense_left.out_node_num,
+				       sparse_left);
+    for (size_t i = 0; i + 1 < boundaries.size(); i++) {
+	moveToKeyGreaterThan(boundaries[i + 1], true,
+			     matchedLevels(boundaries[i + 1], iter), iter);
+	bool is_valid = iter.isValid();
+	if (!is_valid)
+	    iter = moveToLast();
+	dense_right = dense_left;
+	sparse_right = sparse_left;
+	louds_dense_->approxCountBoundary(&(iter.dense_iter_), dense_right);
+	louds_sparse_->approxCountBoundary(&(iter.sparse_iter_), dense_right.out_node_num,
+					   sparse_right);
+	counts[i] = louds_dense_->approxCount(dense_left, dense_right)
+	    + louds_sparse_->approxCount(sparse_left, sparse_right);
+	// boundaries[i + 1] and all later ones are past the last key
+	if (!is_valid)
+	    return;
+	std::swap(dense_left, dense_right);
+	std::swap(sparse_left, sparse_right);
+    }
+}
+
+uint64_t SuRF::numKeys() const {
+    return louds_dense_->countKeys(0, 0, 1, louds_sparse_);
+}
+
+std::string SuRF::selectKey(const uint64_t k) const {
+    if (k >= numKeys())
+	return std::string();
+    return selectKeyAt(k);
+}
+
+std::string SuRF::selectKeyAt(uint64_t k) const {
+    std::string key;
+    position_t node_num = 0;
+    if (!louds_dense_->selectKey(k, key, node_num, louds_sparse_))
+	louds_sparse_->selectKey(k, node_num, key);
+    return key;
+}
 
-    return approxCount(&iter_, &iter2_);
+void SuRF::quantiles(const unsigned num_parts, std::vector<std::string>& split_keys) const {
+    split_keys.clear();
+    uint64_t num_keys = numKeys();
+    uint64_t last_k = 0;
+    for (unsigned i = 1; i < num_parts; i++) {
+	uint64_t k = i * num_keys / num_parts;
+	// no empty parts
+	if (k == last_k)
+	    continue;
+	last_k = k;
+	split_keys.push_back(selectKeyAt(k));
+    }
+}
+
+bool SuRF::leafId(const std::string& key, uint64_t& id) const {
+    SURF_TRACE_QUERY();
+    id = 0;
+    position_t connect_node_num = 0;
+    if (!louds_dense_->leafId(key, connect_node_num, id, louds_sparse_))
+	return false;
+    else if (connect_node_num != 0)
+	return louds_sparse_->leafId(key, connect_node_num, id);
+    return true;
+}
+
+bool SuRF::leafId(const std::string& key, const uint32_t key_hash, uint64_t& id) const {
+    SURF_TRACE_QUERY();
+    id = 0;
+    position_t connect_node_num = 0;
+    if (!louds_dense_->leafId(key, connect_node_num, id, louds_sparse_, &key_hash))
+	return false;
+    else if (connect_node_num != 0)
+	return louds_sparse_->leafId(key, connect_node_num, id, &key_hash);
+    return true;
 }
 
-uint64_t SuRF::serializedSize() const {
-    return (louds_dense_->serializedSize()
-	    + louds_sparse_->serializedSize());
+uint64_t SuRF::serializedSize(const SerializeFormat format) const {
+    bool include_luts = (format == kSerializeFull);
+    return (kSerializedHeaderSize + louds_dense_->serializedSize(include_luts)
+	    + louds_sparse_->serializedSize(include_luts));
 }
 
 uint64_t SuRF::getMemoryUsage() const {
@@ -315,6 +941,8 @@ int SuRF::Iter::compare(const std::string& key) const {
 }
 
 std::string SuRF::Iter::getKey() const {
+    SURF_TRACE_QUERY();
+    SURF_TRACE_PHASE(kPhaseIterKey);
     if (!isValid())
 	return std::string();
     if (dense_iter_.isComplete())
@@ -331,6 +959,8 @@ int SuRF::Iter::getSuffix(word_t* suffix) const {
 }
 
 std::string SuRF::Iter::getKeyWithSuffix(unsigned* bitlen) const {
+    SURF_TRACE_QUERY();
+    SURF_TRACE_PHASE(kPhaseIterKey);
     *bitlen = 0;
     if (!isValid())
 	return std::string();
@@ -340,6 +970,7 @@ std::string SuRF::Iter::getKeyWithSuffix(unsigned* bitlen) const {
 }
 
 void SuRF::Iter::passToSparse() {
+    SURF_TRACE_PHASE(kPhaseHandoff);
     sparse_iter_.setStartNodeNum(dense_iter_.getSendOutNodeNum());
 }
 
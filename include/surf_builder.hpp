@@ -7,19 +7,29 @@
 #include <vector>
 
 #include "config.hpp"
+#include "elias_fano.hpp"
 #include "hash.hpp"
+#include "key_file.hpp"
+#include "serial_sink.hpp"
+#include "spill_file.hpp"
 #include "suffix.hpp"
 
 namespace surf {
 
 class SuRFBuilder {
 public: 
-    SuRFBuilder() : sparse_start_level_(0), suffix_type_(kNone) {};
+    SuRFBuilder() : sparse_start_level_(0), louds_encoding_(kLoudsBitvector),
+		    suffix_type_(kNone), hash_type_(kHashLevelDB),
+		    record_suffix_levels_(false), spill_(nullptr), memory_limit_(0) {};
     explicit SuRFBuilder(bool include_dense, uint32_t sparse_dense_ratio,
-			 SuffixType suffix_type, level_t hash_suffix_len, level_t real_suffix_len)
+			 SuffixType suffix_type, level_t hash_suffix_len, level_t real_suffix_len,
+			 LoudsEncoding louds_encoding = kLoudsBitvector,
+			 SuffixHashType hash_type = kHashLevelDB)
 	: include_dense_(include_dense), sparse_dense_ratio_(sparse_dense_ratio),
-	  sparse_start_level_(0), suffix_type_(suffix_type),
-          hash_suffix_len_(hash_suffix_len), real_suffix_len_(real_suffix_len) {};
+	  sparse_start_level_(0), louds_encoding_(louds_encoding), suffix_type_(suffix_type),
+          hash_suffix_len_(hash_suffix_len), real_suffix_len_(real_suffix_len),
+	  hash_type_(hash_type), record_suffix_levels_(false),
+	  spill_(nullptr), memory_limit_(0) {};
 
     ~SuRFBuilder() {};
 
@@ -29,6 +39,46 @@ public:
     // REQUIRED: provided key list must be sorted.
     void build(const std::vector<std::string>& keys);
 
+    // Same as build, but ignores the suffix configuration passed to the
+    // constructor. The trie is built first; the dense cutoff and the
+    // suffix type/lengths are then chosen so that the serialized filter
+    // uses as much of (bits_per_key * keys.size()) bits as possible
+    // without exceeding it. If even the suffix-less, all-sparse trie
+    // exceeds the budget, the filter is built without suffixes.
+    // REQUIRED: provided key list must be sorted.
+    void buildWithBudget(const std::vector<std::string>& keys,
+			 const double bits_per_key, const QueryPriority priority);
+
+    // Same as build, but reads the keys from a sorted key file and moves
+    // the filled part of the LOUDS-Sparse vectors to spill whenever they
+    // take more than about memory_limit bytes. Only the dense levels are
+    // read back (for buildDense); write the sparse levels out with
+    // writeLevels. Returns false on a spill error or an empty file.
+    // REQUIRED: keys in the file must be sorted.
+    bool build(KeyFile& keys, SpillFile* spill, const uint64_t memory_limit);
+
+    // Per-level vectors, for writeLevels
+    enum LevelVector {
+	kLevelLabels = 0,
+	kLevelChildIndicatorBits,
+	kLevelLoudsBits,
+	kLevelSuffixes,
+	kNumLevelVectors
+    };
+
+    // Writes vector for levels [start_level, end_level) to sink, spilled
+    // parts included: the labels byte by byte, the bit vectors
+    // concatenated bit by bit (as in Bitvector) and zero-padded to a
+    // whole word. Returns false on a spill or sink error.
+    bool writeLevels(SerialSink& sink, const LevelVector vector,
+		     const level_t start_level, const level_t end_level) const;
+
+    // Serialized filter size in bytes if the LOUDS-Dense encoding stops
+    // at cutoff_level and every key stores a suffix_len-bit suffix.
+    // Valid after the sparse vectors are built.
+    uint64_t estimateSerializedSize(const level_t cutoff_level,
+				    const level_t suffix_len) const;
+
     static bool readBit(const std::vector<word_t>& bits, const position_t pos) {
 	assert(pos < (bits.size() * kWordSize));
 	position_t word_id = pos / kWordSize;
@@ -47,6 +97,10 @@ public:
 	return labels_.size();
     }
 
+    position_t getNumItems(const level_t level) const {
+	return spilled_items_[level] + labels_[level].size();
+    }
+
     // const accessors
     const std::vector<std::vector<word_t> >& getBitmapLabels() const {
 	return bitmap_labels_;
@@ -78,6 +132,9 @@ public:
     level_t getSparseStartLevel() const {
 	return sparse_start_level_;
     }
+    LoudsEncoding getLoudsEncoding() const {
+	return louds_encoding_;
+    }
     SuffixType getSuffixType() const {
 	return suffix_type_;
     }
@@ -90,15 +147,32 @@ public:
     level_t getRealSuffixLen() const {
 	return real_suffix_len_;
     }
+    SuffixHashType getSuffixHashType() const {
+	return hash_type_;
+    }
 
 private:
     static bool isSameKey(const std::string& a, const std::string& b) {
 	return a.compare(b) == 0;
     }
 
+    static level_t commonPrefixLen(const std::string& a, const std::string& b) {
+	level_t len = (a.length() < b.length()) ? a.length() : b.length();
+	level_t i = 0;
+	while ((i < len) && (a[i] == b[i]))
+	    i++;
+	return i;
+    }
+
+    // Counts the items and suffixes every level will hold (a key fills
+    // levels [lcp with prev, max(lcp with prev, lcp with next)]) so
+    // that addLevel allocates the per-level vectors at their final size.
+    void countLevelItems(const std::vector<std::string>& keys);
+
     // Fill in the LOUDS-Sparse vectors through a single scan
     // of the sorted key list.
     void buildSparse(const std::vector<std::string>& keys);
+    bool buildSparse(KeyFile& keys);
 
     // Walks down the current partially-filled trie by comparing key to
     // its previous key in the list until their prefixes do not match.
@@ -118,6 +192,33 @@ private:
     // Fills in the suffix byte for key
     inline void insertSuffix(const std::string& key, const level_t level);
 
+    // Splits suffix_len bits between hash and real suffixes
+    // according to the query type being optimized.
+    void chooseSuffixConfig(const level_t suffix_len, const QueryPriority priority);
+
+    // Refills the suffix vectors using the suffix levels recorded
+    // during buildSparse (keys must be the same list).
+    void rebuildSuffixes(const std::vector<std::string>& keys);
+
+    // Position of the last item of level in the in-memory vectors
+    position_t lastItemSlot(const level_t level) const {
+	return labels_[level].size() - 1;
+    }
+
+    uint32_t spillStream(const level_t level, const LevelVector vector) const {
+	return level * kNumLevelVectors + vector;
+    }
+
+    // Bytes allocated for the LOUDS-Sparse and suffix vectors
+    uint64_t levelVectorsMemory() const;
+    // Moves every complete word of the per-level vectors to spill_,
+    // except the ones that later keys can still modify
+    bool spillLevels();
+    // Reads the spilled part of level back in front of its vectors
+    bool loadSpilledLevel(const level_t level);
+    bool loadSpilledWords(const level_t level, const LevelVector vector,
+			  std::vector<word_t>& words) const;
+
     inline bool isCharCommonPrefix(const label_t c, const level_t level) const;
     inline bool isLevelEmpty(const level_t level) const;
     inline void moveToNextItemSlot(const level_t level);
@@ -140,7 +241,6 @@ private:
     void initDenseVectors(const level_t level);
     void setLabelAndChildIndicatorBitmap(const level_t level, const position_t node_num, const position_t pos);
 
-    position_t getNumItems(const level_t level) const;
     void addLevel();
     bool isStartOfNode(const level_t level, const position_t pos) const;
     bool isTerminator(const level_t level, const position_t pos) const;
@@ -151,6 +251,7 @@ private:
     bool include_dense_;
     uint32_t sparse_dense_ratio_;
     level_t sparse_start_level_;
+    LoudsEncoding louds_encoding_;
 
     // LOUDS-Sparse bit/byte vectors
     std::vector<std::vector<label_t> > labels_;
@@ -165,12 +266,28 @@ private:
     SuffixType suffix_type_;
     level_t hash_suffix_len_;
     level_t real_suffix_len_;
+    SuffixHashType hash_type_;
     std::vector<std::vector<word_t> > suffixes_;
     std::vector<position_t> suffix_counts_;
 
+    // suffix level of each unique key; only kept by buildWithBudget
+    bool record_suffix_levels_;
+    std::vector<level_t> suffix_levels_;
+
     // auxiliary per level bookkeeping vectors
     std::vector<position_t> node_counts_;
     std::vector<bool> is_last_item_terminator_;
+
+    // per level sizes from countLevelItems
+    std::vector<position_t> level_item_counts_;
+    std::vector<position_t> level_suffix_counts_;
+
+    // set by build(KeyFile&, ...); the per-level vectors hold the items
+    // (suffix words) after the first spilled_items_ (spilled_suffix_words_)
+    SpillFile* spill_;
+    uint64_t memory_limit_;
+    std::vector<position_t> spilled_items_;
+    std::vector<position_t> spilled_suffix_words_;
 };
 
 void SuRFBuilder::build(const std::vector<std::string>& keys) {
@@ -182,7 +299,57 @@ void SuRFBuilder::build(const std::vector<std::string>& keys) {
     }
 }
 
+bool SuRFBuilder::build(KeyFile& keys, SpillFile* spill, const uint64_t memory_limit) {
+    spill_ = spill;
+    memory_limit_ = memory_limit;
+    if (!buildSparse(keys))
+	return false;
+    if (include_dense_) {
+	determineCutoffLevel();
+	for (level_t level = 0; level < sparse_start_level_; level++) {
+	    if (!loadSpilledLevel(level))
+		return false;
+	}
+	buildDense();
+    }
+    return true;
+}
+
+void SuRFBuilder::buildWithBudget(const std::vector<std::string>& keys,
+				  const double bits_per_key, const QueryPriority priority) {
+    assert(keys.size() > 0);
+    suffix_type_ = kNone;
+    hash_suffix_len_ = 0;
+    real_suffix_len_ = 0;
+    record_suffix_levels_ = true;
+    buildSparse(keys);
+    record_suffix_levels_ = false;
+
+    uint64_t budget_bits = (uint64_t)(bits_per_key * keys.size());
+    if (include_dense_) {
+	determineCutoffLevel();
+	// give up lookup speed before giving up suffix bits
+	while ((sparse_start_level_ > 0)
+	       && (estimateSerializedSize(sparse_start_level_, 0) * 8 > budget_bits))
+	    sparse_start_level_--;
+    }
+
+    level_t suffix_len = kWordSize;
+    while ((suffix_len > 0)
+	   && (estimateSerializedSize(sparse_start_level_, suffix_len) * 8 > budget_bits))
+	suffix_len--;
+
+    chooseSuffixConfig(suffix_len, priority);
+    if (suffix_type_ != kNone)
+	rebuildSuffixes(keys);
+    std::vector<level_t>().swap(suffix_levels_);
+
+    if (include_dense_)
+	buildDense();
+}
+
 void SuRFBuilder::buildSparse(const std::vector<std::string>& keys) {
+    countLevelItems(keys);
     for (position_t i = 0; i < keys.size(); i++) {
 	level_t level = skipCommonPrefix(keys[i]);	
 	position_t curpos = i;
@@ -196,10 +363,66 @@ void SuRFBuilder::buildSparse(const std::vector<std::string>& keys) {
     }
 }
 
+bool SuRFBuilder::buildSparse(KeyFile& keys) {
+    static const position_t kSpillCheckInterval = 1024;
+    std::string key;
+    std::string next_key;
+    bool has_next = keys.next(next_key);
+    if (!has_next)
+	return false;
+    position_t num_keys = 0;
+    while (has_next) {
+	key.swap(next_key);
+	while ((has_next = keys.next(next_key)) && isSameKey(key, next_key)) {}
+	level_t level = skipCommonPrefix(key);
+	if (has_next)
+	    level = insertKeyBytesToTrieUntilUnique(key, next_key, level);
+	else
+	    level = insertKeyBytesToTrieUntilUnique(key, std::string(), level);
+	insertSuffix(key, level);
+
+	num_keys++;
+	if ((num_keys % kSpillCheckInterval == 0) && (levelVectorsMemory() > memory_limit_)) {
+	    if (!spillLevels())
+		return false;
+	}
+    }
+    return true;
+}
+
+void SuRFBuilder::countLevelItems(const std::vector<std::string>& keys) {
+    level_item_counts_.clear();
+    level_suffix_counts_.clear();
+    position_t num_unique_keys = 0;
+    level_t prev_common_len = 0;
+    for (position_t i = 0; i < keys.size(); i++) {
+	position_t curpos = i;
+	while ((i + 1 < keys.size()) && isSameKey(keys[curpos], keys[i+1]))
+	    i++;
+	level_t next_common_len = 0;
+	if (i < keys.size() - 1)
+	    next_common_len = commonPrefixLen(keys[curpos], keys[i+1]);
+	level_t last_level = prev_common_len;
+	if (next_common_len > last_level)
+	    last_level = next_common_len;
+	if (last_level >= level_item_counts_.size()) {
+	    level_item_counts_.resize(last_level + 1, 0);
+	    level_suffix_counts_.resize(last_level + 1, 0);
+	}
+	for (level_t level = prev_common_len; level <= last_level; level++)
+	    level_item_counts_[level]++;
+	level_suffix_counts_[last_level]++;
+	prev_common_len = next_common_len;
+	num_unique_keys++;
+    }
+    if (record_suffix_levels_)
+	suffix_levels_.reserve(num_unique_keys);
+}
+
 level_t SuRFBuilder::skipCommonPrefix(const std::string& key) {
     level_t level = 0;
     while (level < key.length() && isCharCommonPrefix((label_t)key[level], level)) {
-	setBit(child_indicator_bits_[level], getNumItems(level) - 1);
+	setBit(child_indicator_bits_[level], lastItemSlot(level));
 	level++;
     }
     return level;
@@ -220,7 +443,7 @@ level_t SuRFBuilder::insertKeyBytesToTrieUntilUnique(const std::string& key, con
     insertKeyByte(key[level], level, is_start_of_node, is_term);
     level++;
     if (level > next_key.length()
-	|| !isSameKey(key.substr(0, level), next_key.substr(0, level)))
+	|| (key.compare(0, level, next_key, 0, level) != 0))
 	return level;
 
     // All the following bytes inserted must be the start of a
@@ -247,9 +470,52 @@ inline void SuRFBuilder::insertSuffix(const std::string& key, const level_t leve
     if (level >= getTreeHeight())
 	addLevel();
     assert(level - 1 < suffixes_.size());
-    word_t suffix_word = BitvectorSuffix::constructSuffix(suffix_type_, key, hash_suffix_len_,
-                                                          level, real_suffix_len_);
+    uint32_t key_hash = 0;
+    if ((suffix_type_ == kHash) || (suffix_type_ == kMixed))
+	key_hash = suffixHash(hash_type_, key);
+    word_t suffix_word = BitvectorSuffix::constructSuffix(suffix_type_, key, key_hash,
+							  hash_suffix_len_, level, real_suffix_len_);
     storeSuffix(level, suffix_word);
+    if (record_suffix_levels_)
+	suffix_levels_.push_back(level);
+}
+
+void SuRFBuilder::chooseSuffixConfig(const level_t suffix_len, const QueryPriority priority) {
+    if (suffix_len == 0) {
+	suffix_type_ = kNone;
+	hash_suffix_len_ = 0;
+	real_suffix_len_ = 0;
+    } else if (priority == kRangeQueries) {
+	// real suffix bits also help point queries
+	suffix_type_ = kReal;
+	hash_suffix_len_ = 0;
+	real_suffix_len_ = suffix_len;
+    } else if (suffix_len <= kMaxHashSuffixLen) {
+	suffix_type_ = kHash;
+	hash_suffix_len_ = suffix_len;
+	real_suffix_len_ = 0;
+    } else {
+	// hash bits beyond kMaxHashSuffixLen carry no information
+	suffix_type_ = kMixed;
+	hash_suffix_len_ = kMaxHashSuffixLen;
+	real_suffix_len_ = suffix_len - kMaxHashSuffixLen;
+    }
+}
+
+void SuRFBuilder::rebuildSuffixes(const std::vector<std::string>& keys) {
+    for (level_t level = 0; level < getTreeHeight(); level++) {
+	suffixes_[level].clear();
+	suffix_counts_[level] = 0;
+    }
+    position_t suffix_idx = 0;
+    for (position_t i = 0; i < keys.size(); i++) {
+	position_t curpos = i;
+	while ((i + 1 < keys.size()) && isSameKey(keys[curpos], keys[i+1]))
+	    i++;
+	assert(suffix_idx < suffix_levels_.size());
+	insertSuffix(keys[curpos], suffix_levels_[suffix_idx]);
+	suffix_idx++;
+    }
 }
 
 inline bool SuRFBuilder::isCharCommonPrefix(const label_t c, const level_t level) const {
@@ -259,7 +525,7 @@ inline bool SuRFBuilder::isCharCommonPrefix(const label_t c, const level_t level
 }
 
 inline bool SuRFBuilder::isLevelEmpty(const level_t level) const {
-    return (level >= getTreeHeight()) || (labels_[level].size() == 0);
+    return (level >= getTreeHeight()) || (getNumItems(level) == 0);
 }
 
 inline void SuRFBuilder::moveToNextItemSlot(const level_t level) {
@@ -280,11 +546,11 @@ void SuRFBuilder::insertKeyByte(const char c, const level_t level, const bool is
 
     // sets parent node's child indicator
     if (level > 0)
-	setBit(child_indicator_bits_[level-1], getNumItems(level-1) - 1);
+	setBit(child_indicator_bits_[level-1], lastItemSlot(level-1));
 
     labels_[level].push_back(c);
     if (is_start_of_node) {
-	setBit(louds_bits_[level], getNumItems(level) - 1);
+	setBit(louds_bits_[level], lastItemSlot(level));
 	node_counts_[level]++;
     }
     is_last_item_terminator_[level] = is_term;
@@ -295,7 +561,8 @@ void SuRFBuilder::insertKeyByte(const char c, const level_t level, const bool is
 
 inline void SuRFBuilder::storeSuffix(const level_t level, const word_t suffix) {
     level_t suffix_len = getSuffixLen();
-    position_t pos = suffix_counts_[level-1] * suffix_len;
+    position_t pos = suffix_counts_[level-1] * suffix_len
+	- spilled_suffix_words_[level-1] * kWordSize;
     assert(pos <= (suffixes_[level-1].size() * kWordSize));
     if (pos == (suffixes_[level-1].size() * kWordSize))
 	suffixes_[level-1].push_back(0);
@@ -343,13 +610,96 @@ inline uint64_t SuRFBuilder::computeDenseMem(const level_t downto_level) const {
 inline uint64_t SuRFBuilder::computeSparseMem(const level_t start_level) const {
     uint64_t mem = 0;
     for (level_t level = start_level; level < getTreeHeight(); level++) {
-	position_t num_items = labels_[level].size();
+	position_t num_items = getNumItems(level);
 	mem += (num_items + 2 * num_items / 8 + 1);
 	mem += (suffix_counts_[level] * getSuffixLen() / 8);
     }
     return mem;
 }
 
+static uint64_t rankVectorSize(const uint64_t num_bits) {
+    uint64_t num_words = (num_bits + kWordSize - 1) / kWordSize;
+    uint64_t size = sizeof(position_t) * 2 + num_words * (kWordSize / 8)
+	+ (num_bits / kRankBasicBlockSize + 1) * sizeof(position_t);
+    sizeAlign(size);
+    return size;
+}
+
+static uint64_t selectVectorSize(const uint64_t num_bits, const uint64_t num_ones) {
+    uint64_t num_words = (num_bits + kWordSize - 1) / kWordSize;
+    uint64_t size = sizeof(position_t) * 3;
+    sizeAlign(size);
+    size += num_words * (kWordSize / 8)
+	+ (num_ones / kSelectSampleInterval + 1) * sizeof(position_t);
+    sizeAlign(size);
+    return size;
+}
+
+static uint64_t eliasFanoSize(const uint64_t num_bits, const uint64_t num_ones) {
+    level_t low_len = EliasFano::computeLowLen(num_bits, num_ones);
+    uint64_t num_zeros = (num_bits >> low_len) + 1;
+    uint64_t size = sizeof(position_t) * 4 + sizeof(level_t);
+    sizeAlign(size);
+    size += ((num_ones * low_len) / kWordSize + 1) * (kWordSize / 8)
+	+ (num_zeros / kSelectSampleInterval + 1) * sizeof(position_t);
+    sizeAlign(size);
+    return size + selectVectorSize(num_ones + num_zeros, num_ones);
+}
+
+static uint64_t suffixVectorSize(const uint64_t num_bits) {
+    uint64_t num_words = (num_bits + kWordSize - 1) / kWordSize;
+    uint64_t size = sizeof(position_t) + sizeof(SuffixType) + sizeof(level_t) * 2
+	+ sizeof(SuffixHashType);
+    sizeAlign(size);
+    size += num_words * (kWordSize / 8);
+    sizeAlign(size);
+    return size;
+}
+
+uint64_t SuRFBuilder::estimateSerializedSize(const level_t cutoff_level,
+					     const level_t suffix_len) const {
+    assert(cutoff_level <= getTreeHeight());
+    uint64_t dense_node_count = 0;
+    uint64_t dense_suffix_count = 0;
+    for (level_t level = 0; level < cutoff_level; level++) {
+	dense_node_count += node_counts_[level];
+	dense_suffix_count += suffix_counts_[level];
+    }
+    uint64_t sparse_item_count = 0;
+    uint64_t sparse_node_count = 0;
+    uint64_t sparse_suffix_count = 0;
+    for (level_t level = cutoff_level; level < getTreeHeight(); level++) {
+	sparse_item_count += getNumItems(level);
+	sparse_node_count += node_counts_[level];
+	sparse_suffix_count += suffix_counts_[level];
+    }
+
+    // LoudsDense: header, label bitmaps, child indicator bitmaps,
+    // prefix key indicator bits, suffixes
+    uint64_t dense_size = sizeof(level_t) + sizeof(position_t) * cutoff_level;
+    sizeAlign(dense_size);
+    dense_size += 2 * rankVectorSize(dense_node_count * kFanout)
+	+ rankVectorSize(dense_node_count)
+	+ suffixVectorSize(dense_suffix_count * suffix_len);
+
+    // LoudsSparse: header, labels, child indicator bits, louds bits, suffixes
+    uint64_t sparse_size = sizeof(level_t) * 2 + sizeof(position_t) * 2
+	+ sizeof(LoudsEncoding) + sizeof(position_t) * getTreeHeight();
+    sizeAlign(sparse_size);
+    uint64_t label_size = sizeof(position_t) + sparse_item_count + 1;
+    sizeAlign(label_size);
+    sparse_size += label_size
+	+ rankVectorSize(sparse_item_count)
+	+ suffixVectorSize(sparse_suffix_count * suffix_len);
+
+    if (louds_encoding_ == kLoudsEliasFano)
+	sparse_size += eliasFanoSize(sparse_item_count, sparse_node_count);
+    else
+	sparse_size += selectVectorSize(sparse_item_count, sparse_node_count);
+
+    return kSerializedHeaderSize + dense_size + sparse_size;
+}
+
 void SuRFBuilder::buildDense() {
     for (level_t level = 0; level < sparse_start_level_; level++) {
 	initDenseVectors(level);
@@ -374,18 +724,12 @@ void SuRFBuilder::buildDense() {
 }
 
 void SuRFBuilder::initDenseVectors(const level_t level) {
-    bitmap_labels_.push_back(std::vector<word_t>());
-    bitmap_child_indicator_bits_.push_back(std::vector<word_t>());
-    prefixkey_indicator_bits_.push_back(std::vector<word_t>());
-
-    for (position_t nc = 0; nc < node_counts_[level]; nc++) {
-	for (int i = 0; i < (int)kFanout; i += kWordSize) {
-	    bitmap_labels_[level].push_back(0);
-	    bitmap_child_indicator_bits_[level].push_back(0);
-	}
-	if (nc % kWordSize == 0)
-	    prefixkey_indicator_bits_[level].push_back(0);
-    }
+    position_t num_nodes = node_counts_[level];
+    position_t num_bitmap_words = num_nodes * (kFanout / kWordSize);
+    position_t num_prefixkey_words = (num_nodes + kWordSize - 1) / kWordSize;
+    bitmap_labels_.push_back(std::vector<word_t>(num_bitmap_words, 0));
+    bitmap_child_indicator_bits_.push_back(std::vector<word_t>(num_bitmap_words, 0));
+    prefixkey_indicator_bits_.push_back(std::vector<word_t>(num_prefixkey_words, 0));
 }
 
 void SuRFBuilder::setLabelAndChildIndicatorBitmap(const level_t level, 
@@ -405,13 +749,179 @@ void SuRFBuilder::addLevel() {
 
     node_counts_.push_back(0);
     is_last_item_terminator_.push_back(false);
+    spilled_items_.push_back(0);
+    spilled_suffix_words_.push_back(0);
+
+    level_t level = getTreeHeight() - 1;
+    if (level < level_item_counts_.size()) {
+	position_t num_items = level_item_counts_[level];
+	position_t num_words = num_items / kWordSize + 1;
+	labels_[level].reserve(num_items);
+	child_indicator_bits_[level].reserve(num_words);
+	louds_bits_[level].reserve(num_words);
+	position_t num_suffix_bits = level_suffix_counts_[level] * getSuffixLen();
+	suffixes_[level].reserve(num_suffix_bits / kWordSize + 1);
+    }
+
+    child_indicator_bits_[level].push_back(0);
+    louds_bits_[level].push_back(0);
+}
+
+uint64_t SuRFBuilder::levelVectorsMemory() const {
+    uint64_t mem = 0;
+    for (level_t level = 0; level < getTreeHeight(); level++) {
+	mem += labels_[level].capacity();
+	mem += (child_indicator_bits_[level].capacity() + louds_bits_[level].capacity()
+		+ suffixes_[level].capacity()) * sizeof(word_t);
+    }
+    return mem;
+}
+
+bool SuRFBuilder::spillLevels() {
+    for (level_t level = 0; level < getTreeHeight(); level++) {
+	// the word holding the last item can still have bits set
+	position_t num_words = 0;
+	if (labels_[level].size() > 0)
+	    num_words = lastItemSlot(level) / kWordSize;
+	if (num_words > 0) {
+	    position_t num_items = num_words * kWordSize;
+	    if (!spill_->append(spillStream(level, kLevelLabels),
+				labels_[level].data(), num_items)
+		|| !spill_->append(spillStream(level, kLevelChildIndicatorBits),
+				   child_indicator_bits_[level].data(), num_words * sizeof(word_t))
+		|| !spill_->append(spillStream(level, kLevelLoudsBits),
+				   louds_bits_[level].data(), num_words * sizeof(word_t)))
+		return false;
+	    std::vector<label_t>(labels_[level].begin() + num_items,
+				 labels_[level].end()).swap(labels_[level]);
+	    std::vector<word_t>(child_indicator_bits_[level].begin() + num_words,
+				child_indicator_bits_[level].end()).swap(child_indicator_bits_[level]);
+	    std::vector<word_t>(louds_bits_[level].begin() + num_words,
+				louds_bits_[level].end()).swap(louds_bits_[level]);
+	    spilled_items_[level] += num_items;
+	}
+
+	// the word the next suffix goes into can still change
+	position_t suffix_pos = suffix_counts_[level] * getSuffixLen()
+	    - spilled_suffix_words_[level] * kWordSize;
+	position_t num_suffix_words = suffix_pos / kWordSize;
+	if (num_suffix_words > 0) {
+	    if (!spill_->append(spillStream(level, kLevelSuffixes),
+				suffixes_[level].data(), num_suffix_words * sizeof(word_t)))
+		return false;
+	    std::vector<word_t>(suffixes_[level].begin() + num_suffix_words,
+				suffixes_[level].end()).swap(suffixes_[level]);
+	    spilled_suffix_words_[level] += num_suffix_words;
+	}
+    }
+    return true;
+}
 
-    child_indicator_bits_[getTreeHeight() - 1].push_back(0);
-    louds_bits_[getTreeHeight() - 1].push_back(0);
+bool SuRFBuilder::loadSpilledLevel(const level_t level) {
+    if (spilled_items_[level] > 0) {
+	std::vector<label_t> labels;
+	labels.reserve(getNumItems(level));
+	SpillFile::Reader reader = [&labels](const char* data, const uint64_t size) {
+	    labels.insert(labels.end(), data, data + size);
+	    return true;
+	};
+	if (!spill_->read(spillStream(level, kLevelLabels), reader))
+	    return false;
+	labels.insert(labels.end(), labels_[level].begin(), labels_[level].end());
+	labels_[level].swap(labels);
+	if (!loadSpilledWords(level, kLevelChildIndicatorBits, child_indicator_bits_[level])
+	    || !loadSpilledWords(level, kLevelLoudsBits, louds_bits_[level]))
+	    return false;
+	spilled_items_[level] = 0;
+    }
+    if (spilled_suffix_words_[level] > 0) {
+	if (!loadSpilledWords(level, kLevelSuffixes, suffixes_[level]))
+	    return false;
+	spilled_suffix_words_[level] = 0;
+    }
+    return true;
 }
 
-position_t SuRFBuilder::getNumItems(const level_t level) const {
-    return labels_[level].size();
+bool SuRFBuilder::loadSpilledWords(const level_t level, const LevelVector vector,
+				   std::vector<word_t>& words) const {
+    std::vector<word_t> all_words;
+    all_words.reserve(spill_->streamSize(spillStream(level, vector)) / sizeof(word_t)
+		      + words.size());
+    SpillFile::Reader reader = [&all_words](const char* data, const uint64_t size) {
+	const word_t* src = reinterpret_cast<const word_t*>(data);
+	all_words.insert(all_words.end(), src, src + size / sizeof(word_t));
+	return true;
+    };
+    if (!spill_->read(spillStream(level, vector), reader))
+	return false;
+    all_words.insert(all_words.end(), words.begin(), words.end());
+    words.swap(all_words);
+    return true;
+}
+
+bool SuRFBuilder::writeLevels(SerialSink& sink, const LevelVector vector,
+			      const level_t start_level, const level_t end_level) const {
+    if (vector == kLevelLabels) {
+	SpillFile::Reader reader = [&sink](const char* data, const uint64_t size) {
+	    sink.write(data, size);
+	    return sink.ok();
+	};
+	for (level_t level = start_level; level < end_level; level++) {
+	    if ((spilled_items_[level] > 0)
+		&& !spill_->read(spillStream(level, vector), reader))
+		return false;
+	    sink.write(labels_[level].data(), labels_[level].size());
+	}
+	return sink.ok();
+    }
+
+    // the bits of each level follow right after the previous level's;
+    // pending holds the bit_shift bits not yet written
+    word_t pending = 0;
+    position_t bit_shift = 0;
+    auto appendWord = [&sink, &pending, &bit_shift](const word_t word, const position_t num_bits) {
+	pending |= (word >> bit_shift);
+	if (bit_shift + num_bits < kWordSize) {
+	    bit_shift += num_bits;
+	    return;
+	}
+	sink.write(&pending, sizeof(pending));
+	pending = (bit_shift > 0) ? (word << (kWordSize - bit_shift)) : 0;
+	bit_shift = bit_shift + num_bits - kWordSize;
+    };
+    SpillFile::Reader reader = [&sink, &appendWord](const char* data, const uint64_t size) {
+	const word_t* words = reinterpret_cast<const word_t*>(data);
+	for (uint64_t i = 0; i < size / sizeof(word_t); i++)
+	    appendWord(words[i], kWordSize);
+	return sink.ok();
+    };
+    for (level_t level = start_level; level < end_level; level++) {
+	const std::vector<word_t>* words;
+	position_t num_bits;
+	position_t num_spilled_words;
+	if (vector == kLevelSuffixes) {
+	    words = &suffixes_[level];
+	    num_bits = suffix_counts_[level] * getSuffixLen();
+	    num_spilled_words = spilled_suffix_words_[level];
+	} else {
+	    words = (vector == kLevelChildIndicatorBits)
+		? &child_indicator_bits_[level] : &louds_bits_[level];
+	    num_bits = getNumItems(level);
+	    num_spilled_words = spilled_items_[level] / kWordSize;
+	}
+	if ((num_spilled_words > 0)
+	    && !spill_->read(spillStream(level, vector), reader))
+	    return false;
+	num_bits -= num_spilled_words * kWordSize;
+	for (position_t i = 0; num_bits > 0; i++) {
+	    position_t len = (num_bits < kWordSize) ? num_bits : kWordSize;
+	    appendWord((*words)[i], len);
+	    num_bits -= len;
+	}
+    }
+    if (bit_shift > 0)
+	sink.write(&pending, sizeof(pending));
+    return sink.ok();
 }
 
 bool SuRFBuilder::isStartOfNode(const level_t level, const position_t pos) const {
@@ -0,0 +1,205 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdio.h>
+#include <x86intrin.h>
+
+#include <atomic>
+
+#include "config.hpp"
+#include "stats.hpp"
+
+// Phase tracer for queries, compiled in only with -DSURF_TRACE (cmake
+// -DSURF_TRACE=ON). One in every getTraceSampleInterval() queries of a
+// thread is traced: rdtsc is read at every phase boundary and the
+// cycles in between are charged to the innermost open phase (time in
+// a suffix check inside the louds-sparse descent counts as suffix
+// time, not as sparse time). Cycles of a traced query outside any
+// phase go to kPhaseOther. Without SURF_TRACE the SURF_TRACE_* macros
+// expand to nothing.
+
+namespace surf {
+
+static const uint32_t kDefaultTraceSampleInterval = 64;
+
+enum TracePhase {
+    kPhaseDense = 0, // louds-dense descent
+    kPhaseHandoff,   // locating the louds-sparse start node (passToSparse)
+    kPhaseSparse,    // louds-sparse descent
+    kPhaseSuffix,    // suffix construction and comparison
+    kPhaseIterKey,   // SuRF::Iter key materialization
+    kPhaseOther,
+    kNumTracePhases
+};
+
+enum {
+    kTraceQueries = kNumTracePhases, // counter of traced queries
+    kNumTraceCounters
+};
+
+struct PhaseTrace {
+    uint64_t counts[kNumTraceCounters];
+
+    PhaseTrace() {
+	for (int i = 0; i < kNumTraceCounters; i++)
+	    counts[i] = 0;
+    }
+
+    uint64_t cycles(const TracePhase phase) const {
+	return counts[phase];
+    }
+
+    uint64_t numQueries() const {
+	return counts[kTraceQueries];
+    }
+
+    void print(FILE* out = stdout) const;
+};
+
+typedef PerThreadCounters<PhaseTrace, kNumTraceCounters> PhaseTraceRegistry;
+
+inline std::atomic<uint32_t>& traceSampleIntervalRef() {
+    static std::atomic<uint32_t> interval(kDefaultTraceSampleInterval);
+    return interval;
+}
+
+// 0 turns tracing off
+inline void setTraceSampleInterval(const uint32_t interval) {
+    traceSampleIntervalRef().store(interval, std::memory_order_relaxed);
+}
+
+inline uint32_t getTraceSampleInterval() {
+    return traceSampleIntervalRef().load(std::memory_order_relaxed);
+}
+
+inline PhaseTrace getPhaseTrace() {
+    PhaseTrace trace;
+    PhaseTraceRegistry::snapshot(trace.counts);
+    return trace;
+}
+
+inline void resetPhaseTrace() {
+    PhaseTraceRegistry::reset();
+}
+
+// Per-thread tracing state
+class PhaseTracer {
+public:
+    PhaseTracer() : num_queries_(0), depth_(0), sampling_(false),
+		    phase_(kPhaseOther), last_tsc_(0) {};
+
+    static PhaseTracer& local() {
+	static thread_local PhaseTracer tracer;
+	return tracer;
+    }
+
+    bool sampling() const {
+	return sampling_;
+    }
+
+    // Nested queries (e.g., moveToKeyLessThan calling lookupKey) are
+    // traced as part of the outermost one
+    void beginQuery() {
+	if (depth_++ > 0)
+	    return;
+	uint32_t interval = getTraceSampleInterval();
+	if ((interval == 0) || (++num_queries_ % interval != 0))
+	    return;
+	sampling_ = true;
+	phase_ = kPhaseOther;
+	last_tsc_ = __rdtsc();
+    }
+
+    void endQuery() {
+	if (--depth_ > 0 || !sampling_)
+	    return;
+	charge(__rdtsc());
+	PhaseTraceRegistry::local().add(kTraceQueries, 1);
+	sampling_ = false;
+    }
+
+    // Returns the phase to restore on exit
+    TracePhase enter(const TracePhase phase) {
+	charge(__rdtsc());
+	TracePhase prev = phase_;
+	phase_ = phase;
+	return prev;
+    }
+
+    void exit(const TracePhase prev) {
+	charge(__rdtsc());
+	phase_ = prev;
+    }
+
+private:
+    void charge(const uint64_t now) {
+	PhaseTraceRegistry::local().add(phase_, now - last_tsc_);
+	last_tsc_ = now;
+    }
+
+    uint64_t num_queries_;
+    int depth_;
+    bool sampling_;
+    TracePhase phase_;
+    uint64_t last_tsc_;
+};
+
+class TraceQueryScope {
+public:
+    TraceQueryScope() {
+	PhaseTracer::local().beginQuery();
+    }
+
+    ~TraceQueryScope() {
+	PhaseTracer::local().endQuery();
+    }
+};
+
+class TracePhaseScope {
+public:
+    TracePhaseScope(const TracePhase phase)
+	: tracer_(PhaseTracer::local()), active_(tracer_.sampling()), prev_(kPhaseOther) {
+	if (active_)
+	    prev_ = tracer_.enter(phase);
+    }
+
+    ~TracePhaseScope() {
+	if (active_)
+	    tracer_.exit(prev_);
+    }
+
+private:
+    PhaseTracer& tracer_;
+    bool active_;
+    TracePhase prev_;
+};
+
+void PhaseTrace::print(FILE* out) const {
+    static const char* kNames[kNumTracePhases] = {
+	"dense", "handoff", "sparse", "suffix", "iter key", "other"};
+    uint64_t total = 0;
+    for (int i = 0; i < kNumTracePhases; i++)
+	total += counts[i];
+    fprintf(out, "traced queries = %lu\n", numQueries());
+    if (numQueries() == 0 || total == 0)
+	return;
+    for (int i = 0; i < kNumTracePhases; i++)
+	fprintf(out, "%-9s %10.1f cycles/query %5.1f%%\n", kNames[i],
+		(double)counts[i] / numQueries(), counts[i] * 100.0 / total);
+}
+
+} // namespace surf
+
+#ifdef SURF_TRACE
+#define SURF_TRACE_CONCAT_(a, b) a##b
+#define SURF_TRACE_CONCAT(a, b) SURF_TRACE_CONCAT_(a, b)
+#define SURF_TRACE_QUERY() \
+    surf::TraceQueryScope SURF_TRACE_CONCAT(surf_trace_query_, __LINE__)
+#define SURF_TRACE_PHASE(phase) \
+    surf::TracePhaseScope SURF_TRACE_CONCAT(surf_trace_phase_, __LINE__)(phase)
+#else
+#define SURF_TRACE_QUERY() ((void)0)
+#define SURF_TRACE_PHASE(phase) ((void)0)
+#endif
+
+#endif // TRACE_H_
@@ -0,0 +1,204 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "elias_fano.hpp"
+#include "select.hpp"
+#include "surf_builder.hpp"
+
+namespace surf {
+
+namespace eliasfanotest {
+
+static const std::string kFilePath = "../../../test/words.txt";
+static const int kTestSize = 234369;
+static std::vector<std::string> words;
+
+class EliasFanoUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	bool include_dense = false;
+	uint32_t sparse_dense_ratio = 0;
+	level_t suffix_len = 8;
+	builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, kReal, 0, suffix_len);
+	data_ = nullptr;
+	num_items_ = 0;
+    }
+    virtual void TearDown () {
+	delete builder_;
+	if (data_)
+	    delete[] data_;
+    }
+
+    void setupWordsTest();
+    void setupSparseTest();
+    void testSerialize(const bool include_luts = true);
+    void testReadBit();
+    void testSelect();
+    void testDistanceToNextSetBit();
+    void destroy();
+
+    static const position_t kSelectSampleInterval = 64;
+
+    SuRFBuilder* builder_;
+    EliasFano* ef_;
+    BitvectorSelect* bv_; // reference encoding of the same bits
+    std::vector<position_t> num_items_per_level_;
+    position_t num_items_;
+    char* data_;
+};
+
+void EliasFanoUnitTest::setupWordsTest() {
+    builder_->build(words);
+    for (level_t level = 0; level < builder_->getTreeHeight(); level++)
+	num_items_per_level_.push_back(builder_->getLabels()[level].size());
+    for (level_t level = 0; level < num_items_per_level_.size(); level++)
+	num_items_ += num_items_per_level_[level];
+    ef_ = new EliasFano(builder_->getLoudsBits(), num_items_per_level_);
+    bv_ = new BitvectorSelect(kSelectSampleInterval, builder_->getLoudsBits(), num_items_per_level_);
+}
+
+// Few 1's spread over many bits, so that the low parts are non-empty
+// and the 1's span multiple words.
+void EliasFanoUnitTest::setupSparseTest() {
+    std::vector<std::vector<word_t> > bits_per_level;
+    position_t num_bits_per_level[3] = {1000, 3333, 70000};
+    for (level_t level = 0; level < 3; level++) {
+	position_t num_bits = num_bits_per_level[level];
+	num_items_per_level_.push_back(num_bits);
+	num_items_ += num_bits;
+	std::vector<word_t> bits(num_bits / kWordSize + 1, 0);
+	for (position_t pos = 0; pos < num_bits; pos += (pos % 7) * (level + 1) * 37 + 1)
+	    SuRFBuilder::setBit(bits, pos);
+	bits_per_level.push_back(bits);
+    }
+    ef_ = new EliasFano(bits_per_level, num_items_per_level_);
+    bv_ = new BitvectorSelect(kSelectSampleInterval, bits_per_level, num_items_per_level_);
+}
+
+void EliasFanoUnitTest::testSerialize(const bool include_luts) {
+    uint64_t size = ef_->serializedSize(include_luts);
+    data_ = new char[size];
+    EliasFano* ori_ef = ef_;
+    BufferSink sink(data_);
+    ori_ef->serialize(sink, include_luts);
+    ASSERT_EQ(size, sink.offset());
+    char* data = data_;
+    ef_ = EliasFano::deSerialize(data, false, include_luts);
+    ASSERT_EQ(size, (uint64_t)(data - data_));
+
+    ASSERT_EQ(ori_ef->numBits(), ef_->numBits());
+    ASSERT_EQ(ori_ef->numOnes(), ef_->numOnes());
+    ASSERT_EQ(ori_ef->lowBitsSize(), ef_->lowBitsSize());
+    ASSERT_EQ(ori_ef->zeroLutSize(), ef_->zeroLutSize());
+
+    ori_ef->destroy();
+    delete ori_ef;
+}
+
+void EliasFanoUnitTest::testReadBit() {
+    ASSERT_EQ(num_items_, ef_->numBits());
+    ASSERT_EQ(bv_->numOnes(), ef_->numOnes());
+    for (position_t pos = 0; pos < num_items_; pos++)
+	ASSERT_EQ(bv_->readBit(pos), ef_->readBit(pos));
+}
+
+void EliasFanoUnitTest::testSelect() {
+    for (position_t rank = 1; rank <= bv_->numOnes(); rank++)
+	ASSERT_EQ(bv_->select(rank), ef_->select(rank));
+    ASSERT_EQ(num_items_, ef_->select(bv_->numOnes() + 1));
+}
+
+void EliasFanoUnitTest::testDistanceToNextSetBit() {
+    for (position_t pos = 0; pos < num_items_; pos++)
+	ASSERT_EQ(bv_->distanceToNextSetBit(pos), ef_->distanceToNextSetBit(pos));
+}
+
+void EliasFanoUnitTest::destroy() {
+    ef_->destroy();
+    delete ef_;
+    bv_->destroy();
+    delete bv_;
+}
+
+TEST_F (EliasFanoUnitTest, readBitTest) {
+    setupWordsTest();
+    testReadBit();
+    destroy();
+}
+
+TEST_F (EliasFanoUnitTest, selectTest) {
+    setupWordsTest();
+    testSelect();
+    destroy();
+}
+
+TEST_F (EliasFanoUnitTest, distanceToNextSetBitTest) {
+    setupWordsTest();
+    testDistanceToNextSetBit();
+    destroy();
+}
+
+TEST_F (EliasFanoUnitTest, serializeTest) {
+    setupWordsTest();
+    testSerialize();
+    testReadBit();
+    testSelect();
+    destroy();
+}
+
+TEST_F (EliasFanoUnitTest, serializeWithoutLutsTest) {
+    setupWordsTest();
+    ASSERT_TRUE(ef_->serializedSize(false) < ef_->serializedSize());
+    testSerialize(false);
+    testReadBit();
+    testSelect();
+    testDistanceToNextSetBit();
+    destroy();
+}
+
+TEST_F (EliasFanoUnitTest, sparseBitsWithoutLutsTest) {
+    setupSparseTest();
+    testSerialize(false);
+    testReadBit();
+    testSelect();
+    testDistanceToNextSetBit();
+    destroy();
+}
+
+TEST_F (EliasFanoUnitTest, sparseBitsTest) {
+    setupSparseTest();
+    testReadBit();
+    testSelect();
+    testDistanceToNextSetBit();
+    testSerialize();
+    testReadBit();
+    testSelect();
+    destroy();
+}
+
+void loadWordList() {
+    std::ifstream infile(kFilePath);
+    std::string key;
+    int count = 0;
+    while (infile.good() && count < kTestSize) {
+	infile >> key;
+	words.push_back(key);
+	count++;
+    }
+}
+
+} // namespace eliasfanotest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    surf::eliasfanotest::loadWordList();
+    return RUN_ALL_TESTS();
+}
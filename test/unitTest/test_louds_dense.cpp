@@ -113,8 +113,16 @@ void DenseUnitTest::testSerialize() {
     LoudsDense* ori_louds_dense = louds_dense_;
     char* data = data_;
     ori_louds_dense->serialize(data);
+    // the sections are written back to back
+    uint64_t section_sizes[LoudsDense::kNumSections];
+    ori_louds_dense->sectionSizes(section_sizes);
+    char* sections[LoudsDense::kNumSections];
     data = data_;
-    louds_dense_ = LoudsDense::deSerialize(data);
+    for (int i = 0; i < LoudsDense::kNumSections; i++) {
+	sections[i] = data;
+	data += section_sizes[i];
+    }
+    louds_dense_ = LoudsDense::deSerialize(sections, false);
 
     ASSERT_EQ(ori_louds_dense->getHeight(), louds_dense_->getHeight());
 
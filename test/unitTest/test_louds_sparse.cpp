@@ -113,8 +113,16 @@ void SparseUnitTest::testSerialize() {
     LoudsSparse* ori_louds_sparse = louds_sparse_;
     char* data = data_;
     ori_louds_sparse->serialize(data);
+    // the sections are written back to back
+    uint64_t section_sizes[LoudsSparse::kNumSections];
+    ori_louds_sparse->sectionSizes(section_sizes);
+    char* sections[LoudsSparse::kNumSections];
     data = data_;
-    louds_sparse_ = LoudsSparse::deSerialize(data);
+    for (int i = 0; i < LoudsSparse::kNumSections; i++) {
+	sections[i] = data;
+	data += section_sizes[i];
+    }
+    louds_sparse_ = LoudsSparse::deSerialize(sections, false);
 
     ASSERT_EQ(ori_louds_sparse->getHeight(), louds_sparse_->getHeight());
     ASSERT_EQ(ori_louds_sparse->getStartLevel(), louds_sparse_->getStartLevel());
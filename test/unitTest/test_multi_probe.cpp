@@ -0,0 +1,147 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "multi_probe.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+namespace multiprobetest {
+
+static const std::string kFilePath = "../../../test/words.txt";
+static const int kWordTestSize = 234369;
+static const int kNumFilters = 70; // more than one bitmap word
+static std::vector<std::string> words;
+
+class MultiProbeUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	// filter i stores every kNumFilters-th word, starting from word i;
+	// suffix and hash types vary across filters
+	const SuffixType suffix_type_list[4] = {kNone, kHash, kReal, kMixed};
+	const SuffixHashType hash_type_list[3] = {kHashLevelDB, kHashCRC32C, kHashMultiply};
+	for (int i = 0; i < kNumFilters; i++) {
+	    std::vector<std::string> keys;
+	    for (unsigned j = i; j < words.size(); j += kNumFilters)
+		keys.push_back(words[j]);
+	    filters_.push_back(new SuRF(keys, kIncludeDense, kSparseDenseRatio,
+					suffix_type_list[i % 4], 4, 4,
+					kLoudsBitvector, hash_type_list[i % 3]));
+	}
+	probe_ = new MultiProbe(filters_);
+    }
+    virtual void TearDown () {
+	for (int i = 0; i < kNumFilters; i++) {
+	    filters_[i]->destroy();
+	    delete filters_[i];
+	}
+	delete probe_;
+    }
+
+    void checkBitmap(const std::string& key, const std::vector<word_t>& candidates);
+
+    std::vector<SuRF*> filters_;
+    MultiProbe* probe_;
+};
+
+void MultiProbeUnitTest::checkBitmap(const std::string& key,
+				     const std::vector<word_t>& candidates) {
+    ASSERT_EQ(probe_->numBitmapWords(), candidates.size());
+    for (int i = 0; i < kNumFilters; i++)
+	ASSERT_EQ(filters_[i]->lookupKey(key), MultiProbe::isCandidate(candidates, i));
+}
+
+TEST_F (MultiProbeUnitTest, lookupKeyTest) {
+    std::vector<word_t> candidates;
+    for (unsigned i = 0; i < words.size(); i += 7) {
+	probe_->lookupKey(words[i], candidates);
+	ASSERT_TRUE(MultiProbe::isCandidate(candidates, i % kNumFilters));
+	checkBitmap(words[i], candidates);
+
+	std::string key = words[i];
+	key[key.length() - 1] ^= 0x20;
+	probe_->lookupKey(key, candidates);
+	checkBitmap(key, candidates);
+    }
+}
+
+TEST_F (MultiProbeUnitTest, lookupKeysTest) {
+    std::vector<std::string> keys;
+    for (unsigned i = 0; i < words.size(); i += 101) {
+	keys.push_back(words[i]);
+	keys.push_back(words[i].substr(0, words[i].length() / 2));
+	keys.push_back(words[i] + "a");
+    }
+    std::vector<std::vector<word_t> > candidates;
+    probe_->lookupKeys(keys, candidates);
+    ASSERT_EQ(keys.size(), candidates.size());
+    for (unsigned k = 0; k < keys.size(); k++)
+	checkBitmap(keys[k], candidates[k]);
+}
+
+TEST_F (MultiProbeUnitTest, lookupRangeTest) {
+    std::vector<word_t> candidates;
+    for (unsigned i = 0; i + 3 < words.size(); i += 997) {
+	probe_->lookupRange(words[i], true, words[i + 3], false, candidates);
+	ASSERT_EQ(probe_->numBitmapWords(), candidates.size());
+	for (int f = 0; f < kNumFilters; f++) {
+	    bool expected = filters_[f]->lookupRange(words[i], true, words[i + 3], false);
+	    ASSERT_EQ(expected, MultiProbe::isCandidate(candidates, f));
+	}
+	ASSERT_TRUE(MultiProbe::isCandidate(candidates, i % kNumFilters));
+    }
+}
+
+TEST_F (MultiProbeUnitTest, lookupRangeThreadsTest) {
+    static const int kNumThreads = 4;
+    std::vector<std::vector<word_t> > expected;
+    for (unsigned i = 0; i + 3 < words.size(); i += 997) {
+	std::vector<word_t> candidates;
+	probe_->lookupRange(words[i], true, words[i + 3], false, candidates);
+	expected.push_back(candidates);
+    }
+    std::vector<int> num_errors(kNumThreads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+	threads.push_back(std::thread([&, t] {
+	    std::vector<word_t> candidates;
+	    for (unsigned i = 0, k = 0; i + 3 < words.size(); i += 997, k++) {
+		probe_->lookupRange(words[i], true, words[i + 3], false, candidates);
+		if (candidates != expected[k])
+		    num_errors[t]++;
+	    }
+	}));
+    }
+    for (int t = 0; t < kNumThreads; t++) {
+	threads[t].join();
+	ASSERT_EQ(0, num_errors[t]);
+    }
+}
+
+void loadWordList() {
+    std::ifstream infile(kFilePath);
+    std::string key;
+    int count = 0;
+    while (infile.good() && count < kWordTestSize) {
+	infile >> key;
+	words.push_back(key);
+	count++;
+    }
+}
+
+} // namespace multiprobetest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    surf::multiprobetest::loadWordList();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,171 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "partitioned_surf.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+namespace partitionedsurftest {
+
+static const SuffixType kSuffixType = kReal;
+static const level_t kSuffixLen = 8;
+static const uint64_t kNumKeys = 20000;
+static const uint64_t kKeysPerPartition = 256;
+static const uint64_t kKeySkip = 10;
+
+class PartitionedSuRFTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	for (uint64_t i = 0; i < kNumKeys; i++)
+	    keys_.push_back(uint64ToString(i * kKeySkip));
+	// string keys with shared prefixes
+	words_.push_back(std::string("f"));
+	words_.push_back(std::string("far"));
+	words_.push_back(std::string("fas"));
+	words_.push_back(std::string("fast"));
+	words_.push_back(std::string("fat"));
+	words_.push_back(std::string("s"));
+	words_.push_back(std::string("top"));
+	words_.push_back(std::string("toy"));
+	words_.push_back(std::string("trie"));
+	words_.push_back(std::string("trip"));
+	words_.push_back(std::string("try"));
+	filter_ = new PartitionedSuRF(keys_, kKeysPerPartition, kIncludeDense, kSparseDenseRatio,
+				      kSuffixType, 0, kSuffixLen);
+    }
+    virtual void TearDown () {
+	delete filter_;
+    }
+
+    void testLookup(const PartitionedSuRF* filter) {
+	for (uint64_t i = 0; i < keys_.size(); i++)
+	    ASSERT_TRUE(filter->lookupKey(keys_[i]));
+	ASSERT_FALSE(filter->lookupKey(uint64ToString(kNumKeys * kKeySkip)));
+    }
+
+    std::vector<std::string> keys_;
+    std::vector<std::string> words_;
+    PartitionedSuRF* filter_;
+};
+
+TEST_F (PartitionedSuRFTest, FenceTest) {
+    uint64_t num_partitions = (kNumKeys + kKeysPerPartition - 1) / kKeysPerPartition;
+    ASSERT_EQ(num_partitions, filter_->numPartitions());
+    for (uint64_t i = 0; i < keys_.size(); i++)
+	ASSERT_EQ(i / kKeysPerPartition, filter_->findPartition(keys_[i]));
+    for (uint64_t i = 0; i + 1 < num_partitions; i++) {
+	std::string fence = filter_->getFence(i);
+	ASSERT_TRUE(fence.compare(keys_[(i + 1) * kKeysPerPartition - 1]) >= 0);
+	ASSERT_TRUE(fence.compare(keys_[(i + 1) * kKeysPerPartition]) < 0);
+    }
+    ASSERT_EQ(keys_.back(), filter_->getFence(num_partitions - 1));
+    ASSERT_EQ(num_partitions, filter_->findPartition(uint64ToString(kNumKeys * kKeySkip)));
+
+    PartitionedSuRF words_filter(words_, 2, kIncludeDense, kSparseDenseRatio, kSuffixType, 0, kSuffixLen);
+    ASSERT_EQ(6u, words_filter.numPartitions());
+    for (uint64_t i = 0; i < words_.size(); i++) {
+	ASSERT_EQ(i / 2, words_filter.findPartition(words_[i]));
+	ASSERT_TRUE(words_filter.lookupKey(words_[i]));
+    }
+    // no shorter separator between "fast" and "fat"
+    ASSERT_EQ(std::string("fast"), words_filter.getFence(1));
+    // between "toy" and "trie"
+    ASSERT_EQ(std::string("tp"), words_filter.getFence(3));
+}
+
+TEST_F (PartitionedSuRFTest, LookupTest) {
+    testLookup(filter_);
+    ASSERT_EQ(filter_->numPartitions(), filter_->numLoadedPartitions());
+}
+
+TEST_F (PartitionedSuRFTest, LookupRangeTest) {
+    for (uint64_t i = 0; i + 1 < keys_.size(); i++) {
+	ASSERT_TRUE(filter_->lookupRange(keys_[i], true, keys_[i], true));
+	// every range that holds a key, including ones across a partition boundary
+	ASSERT_TRUE(filter_->lookupRange(uint64ToString(i * kKeySkip + 1), true,
+					 keys_[i + 1], true));
+	ASSERT_TRUE(filter_->lookupRange(keys_[i], true, uint64ToString(i * kKeySkip + 1), false));
+    }
+    ASSERT_FALSE(filter_->lookupRange(uint64ToString(kNumKeys * kKeySkip), true,
+				      uint64ToString(kNumKeys * kKeySkip * 2), true));
+}
+
+TEST_F (PartitionedSuRFTest, SerializeTest) {
+    uint64_t size = filter_->serializedSize();
+    char* data = filter_->serialize();
+    PartitionedSuRF* filter = PartitionedSuRF::deSerialize(data);
+    delete[] data;
+    ASSERT_TRUE(filter != nullptr);
+    ASSERT_EQ(size, filter->serializedSize());
+    ASSERT_EQ(0u, filter->numLoadedPartitions());
+    ASSERT_TRUE(filter->lookupKey(keys_[kKeysPerPartition * 3]));
+    ASSERT_EQ(1u, filter->numLoadedPartitions());
+    testLookup(filter);
+    delete filter;
+
+    std::vector<std::string> no_keys;
+    PartitionedSuRF empty(no_keys, kKeysPerPartition, kIncludeDense, kSparseDenseRatio,
+			  kSuffixType, 0, kSuffixLen);
+    ASSERT_EQ(0u, empty.numPartitions());
+    data = empty.serialize();
+    filter = PartitionedSuRF::deSerialize(data);
+    delete[] data;
+    ASSERT_TRUE(filter != nullptr);
+    ASSERT_FALSE(filter->lookupKey(keys_[0]));
+    ASSERT_FALSE(filter->lookupRange(keys_[0], true, keys_[1], true));
+    delete filter;
+
+    char bad[kPartitionedHeaderSize] = {0};
+    ASSERT_TRUE(PartitionedSuRF::deSerialize(bad) == nullptr);
+}
+
+TEST_F (PartitionedSuRFTest, OpenTest) {
+    const std::string path = "partitioned_surf_open_test.tmp";
+    uint64_t size = filter_->serializedSize();
+    char* data = filter_->serialize();
+    std::ofstream outfile(path, std::ios::binary);
+    outfile.write(data, size);
+    outfile.close();
+    delete[] data;
+
+    PartitionedSuRF* filter = PartitionedSuRF::open(path);
+    ASSERT_TRUE(filter != nullptr);
+    ASSERT_EQ(0u, filter->numLoadedPartitions());
+    uint64_t index_memory = filter->getMemoryUsage();
+    for (uint64_t i = 0; i < kKeysPerPartition; i++)
+	ASSERT_TRUE(filter->lookupKey(keys_[i]));
+    ASSERT_EQ(1u, filter->numLoadedPartitions());
+    ASSERT_TRUE(filter->lookupRange(keys_[kKeysPerPartition - 1], false,
+				    keys_[kKeysPerPartition], true));
+    ASSERT_TRUE(filter->numLoadedPartitions() <= 2u);
+    ASSERT_TRUE(filter->getMemoryUsage() > index_memory);
+    testLookup(filter);
+    delete filter;
+
+    // truncated: the partition offsets point past the end
+    std::ofstream truncated(path, std::ios::binary | std::ios::trunc);
+    data = filter_->serialize();
+    truncated.write(data, size / 2);
+    truncated.close();
+    delete[] data;
+    ASSERT_TRUE(PartitionedSuRF::open(path) == nullptr);
+    remove(path.c_str());
+    ASSERT_TRUE(PartitionedSuRF::open(path) == nullptr);
+}
+
+} // namespace partitionedsurftest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
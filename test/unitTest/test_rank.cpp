@@ -38,7 +38,7 @@ public:
     }
 
     void setupWordsTest();
-    void testSerialize();
+    void testSerialize(const bool include_lut = true);
     void testRank();
 
     static const position_t kRankBasicBlockSize = 512;
@@ -62,15 +62,16 @@ void RankUnitTest::setupWordsTest() {
     bv2_ = new BitvectorRank(kRankBasicBlockSize, builder_->getLoudsBits(), num_items_per_level_);
 }
 
-void RankUnitTest::testSerialize() {
-    uint64_t size = bv_->serializedSize();
+void RankUnitTest::testSerialize(const bool include_lut) {
+    uint64_t size = bv_->serializedSize(include_lut);
     ASSERT_TRUE((bv_->size() - size) >= 0);
     data_ = new char[size];
     BitvectorRank* ori_bv = bv_;
+    BufferSink sink(data_);
+    ori_bv->serialize(sink, include_lut);
+    ASSERT_EQ(size, sink.offset());
     char* data = data_;
-    ori_bv->serialize(data);
-    data = data_;
-    bv_ = BitvectorRank::deSerialize(data);
+    bv_ = BitvectorRank::deSerialize(data, false, include_lut);
 
     ASSERT_EQ(ori_bv->bitsSize(), bv_->bitsSize());
     ASSERT_EQ(ori_bv->rankLutSize(), bv_->rankLutSize());
@@ -78,13 +79,13 @@ void RankUnitTest::testSerialize() {
     ori_bv->destroy();
     delete ori_bv;
 
-    size = bv2_->serializedSize();
+    size = bv2_->serializedSize(include_lut);
     data2_ = new char[size];
     BitvectorRank* ori_bv2 = bv2_;
+    BufferSink sink2(data2_);
+    ori_bv2->serialize(sink2, include_lut);
     char* data2 = data2_;
-    ori_bv2->serialize(data2);
-    data2 = data2_;
-    bv2_ = BitvectorRank::deSerialize(data2);
+    bv2_ = BitvectorRank::deSerialize(data2, false, include_lut);
 
     ASSERT_EQ(ori_bv2->bitsSize(), bv2_->bitsSize());
     ASSERT_EQ(ori_bv2->rankLutSize(), bv2_->rankLutSize());
@@ -144,6 +145,35 @@ TEST_F (RankUnitTest, serializeTest) {
     testRank();
 }
 
+TEST_F (RankUnitTest, serializeWithoutLutTest) {
+    setupWordsTest();
+    ASSERT_TRUE(bv_->serializedSize(false) < bv_->serializedSize());
+    testSerialize(false);
+    testRank();
+}
+
+TEST_F (RankUnitTest, parallelLutTest) {
+    setupWordsTest();
+    const unsigned thread_list[4] = {2, 3, 8, 1000};
+    position_t num_blocks = bv_->numBits() / kRankBasicBlockSize + 1;
+    std::vector<position_t> lut(num_blocks);
+    BitvectorRank::fillRankLut(bv_->getBits(), bv_->numBits(), kRankBasicBlockSize,
+			       lut.data(), 1);
+    ASSERT_EQ(0, lut[0]);
+    for (position_t i = 1; i < num_blocks; i++)
+	ASSERT_EQ(bv_->rank(i * kRankBasicBlockSize - 1), lut[i]);
+    for (int t = 0; t < 4; t++) {
+	std::vector<position_t> parallel_lut(num_blocks);
+	BitvectorRank::fillRankLut(bv_->getBits(), bv_->numBits(), kRankBasicBlockSize,
+				   parallel_lut.data(), thread_list[t]);
+	ASSERT_TRUE(lut == parallel_lut);
+    }
+    bv_->destroy();
+    delete bv_;
+    bv2_->destroy();
+    delete bv2_;
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "replicated_surf.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+namespace replicatedsurftest {
+
+static const SuffixType kSuffixType = kReal;
+static const level_t kSuffixLen = 8;
+
+class ReplicatedSuRFTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	keys_.push_back(std::string("f"));
+	keys_.push_back(std::string("far"));
+	keys_.push_back(std::string("fas"));
+	keys_.push_back(std::string("fast"));
+	keys_.push_back(std::string("fat"));
+	keys_.push_back(std::string("s"));
+	keys_.push_back(std::string("top"));
+	keys_.push_back(std::string("toy"));
+	keys_.push_back(std::string("trie"));
+	keys_.push_back(std::string("trip"));
+	keys_.push_back(std::string("try"));
+	queries_ = keys_;
+	queries_.push_back(std::string("fa"));
+	queries_.push_back(std::string("fastest"));
+	queries_.push_back(std::string("toz"));
+	queries_.push_back(std::string("x"));
+	surf_ = new SuRF(keys_, kIncludeDense, kSparseDenseRatio, kSuffixType, 0, kSuffixLen);
+    }
+    virtual void TearDown () {
+	delete surf_;
+    }
+
+    std::vector<std::string> keys_;
+    std::vector<std::string> queries_;
+    SuRF* surf_;
+};
+
+TEST_F (ReplicatedSuRFTest, ParseCpuListTest) {
+    std::vector<int> cpus = parseCpuList(std::string("0-3,8,10-11\n"));
+    int expected[] = {0, 1, 2, 3, 8, 10, 11};
+    ASSERT_EQ(7u, cpus.size());
+    for (unsigned i = 0; i < cpus.size(); i++)
+	ASSERT_EQ(expected[i], cpus[i]);
+    ASSERT_TRUE(parseCpuList(std::string("")).empty());
+    ASSERT_FALSE(numaNodeCpus().empty());
+    // one node per online node id that has CPUs, gaps in the ids included
+    std::vector<int> node_ids = numaNodeIds();
+    unsigned num_nodes = 0;
+    for (unsigned i = 0; i < node_ids.size(); i++)
+	num_nodes += numaNodeCpuList(node_ids[i]).empty() ? 0 : 1;
+    if (num_nodes > 0) {
+	ASSERT_EQ(num_nodes, numaNodeCpus().size());
+    }
+}
+
+TEST_F (ReplicatedSuRFTest, LookupTest) {
+    ReplicatedSuRF replicated(*surf_);
+    ASSERT_EQ(numaNodeCpus().size(), replicated.numReplicas());
+    for (unsigned i = 0; i < replicated.numReplicas(); i++) {
+	ASSERT_TRUE(replicated.getReplica(i) != surf_);
+	ASSERT_EQ(surf_->getMemoryUsage(), replicated.getReplica(i)->getMemoryUsage());
+    }
+
+    std::vector<bool> results;
+    std::vector<bool> range_results;
+    std::vector<uint64_t> counts;
+    for (unsigned i = 0; i < queries_.size(); i++) {
+	results.push_back(surf_->lookupKey(queries_[i]));
+	range_results.push_back(surf_->lookupRange(queries_[i], true, std::string("tz"), false));
+	counts.push_back(surf_->approxCount(queries_[i], std::string("trip")));
+    }
+    // the replicas do not depend on the original
+    surf_->destroy();
+    for (unsigned i = 0; i < queries_.size(); i++) {
+	ASSERT_EQ(results[i], replicated.lookupKey(queries_[i]));
+	ASSERT_EQ(range_results[i],
+		  replicated.lookupRange(queries_[i], true, std::string("tz"), false));
+	ASSERT_EQ(counts[i], replicated.approxCount(queries_[i], std::string("trip")));
+    }
+}
+
+TEST_F (ReplicatedSuRFTest, ThreadsTest) {
+    static const int kNumThreads = 4;
+    static const int kNumLookups = 1000;
+    ReplicatedSuRF replicated(*surf_);
+    std::vector<int> num_errors(kNumThreads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+	threads.push_back(std::thread([&, t] {
+	    for (int i = 0; i < kNumLookups; i++) {
+		const std::string& key = keys_[i % keys_.size()];
+		if (!replicated.lookupKey(key, replicated.local()->hashKey(key)))
+		    num_errors[t]++;
+	    }
+	}));
+    }
+    for (int t = 0; t < kNumThreads; t++) {
+	threads[t].join();
+	ASSERT_EQ(0, num_errors[t]);
+    }
+}
+
+} // namespace replicatedsurftest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
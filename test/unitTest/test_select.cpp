@@ -35,7 +35,7 @@ public:
     }
 
     void setupWordsTest();
-    void testSerialize();
+    void testSerialize(const bool include_lut = true);
     void testSelect();
 
     static const position_t kSelectSampleInterval = 64;
@@ -56,15 +56,16 @@ void SelectUnitTest::setupWordsTest() {
     bv_ = new BitvectorSelect(kSelectSampleInterval, builder_->getLoudsBits(), num_items_per_level_);
 }
 
-void SelectUnitTest::testSerialize() {
-    uint64_t size = bv_->serializedSize();
+void SelectUnitTest::testSerialize(const bool include_lut) {
+    uint64_t size = bv_->serializedSize(include_lut);
     ASSERT_TRUE((bv_->size() - size) >= 0);
     data_ = new char[size];
     BitvectorSelect* ori_bv = bv_;
+    BufferSink sink(data_);
+    ori_bv->serialize(sink, include_lut);
+    ASSERT_EQ(size, sink.offset());
     char* data = data_;
-    ori_bv->serialize(data);
-    data = data_;
-    bv_ = BitvectorSelect::deSerialize(data);
+    bv_ = BitvectorSelect::deSerialize(data, false, include_lut);
 
     ASSERT_EQ(ori_bv->bitsSize(), bv_->bitsSize());
     ASSERT_EQ(ori_bv->selectLutSize(), bv_->selectLutSize());
@@ -110,6 +111,37 @@ TEST_F (SelectUnitTest, serializeTest) {
     testSelect();
 }
 
+TEST_F (SelectUnitTest, serializeWithoutLutTest) {
+    setupWordsTest();
+    ASSERT_TRUE(bv_->serializedSize(false) < bv_->serializedSize());
+    testSerialize(false);
+    testSelect();
+}
+
+TEST_F (SelectUnitTest, parallelLutTest) {
+    setupWordsTest();
+    const unsigned thread_list[4] = {2, 3, 8, 1000};
+    position_t* lut = nullptr;
+    position_t num_ones = BitvectorSelect::buildSelectLut(bv_->getBits(), bv_->numBits(),
+							  kSelectSampleInterval, lut, 1);
+    ASSERT_EQ(bv_->numOnes(), num_ones);
+    position_t num_samples = num_ones / kSelectSampleInterval + 1;
+    ASSERT_EQ(0, lut[0]);
+    for (position_t i = 1; i < num_samples; i++)
+	ASSERT_EQ(bv_->select(i * kSelectSampleInterval), lut[i]);
+    for (int t = 0; t < 4; t++) {
+	position_t* parallel_lut = nullptr;
+	ASSERT_EQ(num_ones, BitvectorSelect::buildSelectLut(bv_->getBits(), bv_->numBits(),
+							    kSelectSampleInterval, parallel_lut,
+							    thread_list[t]));
+	ASSERT_EQ(0, memcmp(lut, parallel_lut, num_samples * sizeof(position_t)));
+	delete[] parallel_lut;
+    }
+    delete[] lut;
+    bv_->destroy();
+    delete bv_;
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
@@ -0,0 +1,146 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "stats.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+namespace statstest {
+
+static const SuffixType kSuffixType = kReal;
+static const level_t kSuffixLen = 8;
+// only level 0 is in louds-dense
+static const uint32_t kSparseOnlyRatio = 1000000;
+
+class StatsTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	keys_.push_back(std::string("f"));
+	keys_.push_back(std::string("far"));
+	keys_.push_back(std::string("fas"));
+	keys_.push_back(std::string("fast"));
+	keys_.push_back(std::string("fat"));
+	keys_.push_back(std::string("s"));
+	keys_.push_back(std::string("top"));
+	keys_.push_back(std::string("toy"));
+	keys_.push_back(std::string("trie"));
+	keys_.push_back(std::string("trip"));
+	keys_.push_back(std::string("try"));
+	surf_ = new SuRF(keys_, kIncludeDense, kSparseOnlyRatio, kSuffixType, 0, kSuffixLen);
+	ASSERT_EQ(1u, surf_->getSparseStartLevel());
+	resetQueryStats();
+    }
+    virtual void TearDown () {
+	delete surf_;
+    }
+
+    std::vector<std::string> keys_;
+    SuRF* surf_;
+};
+
+TEST_F (StatsTest, LookupPathsTest) {
+    ASSERT_FALSE(surf_->lookupKey(std::string("x"))); // dense miss
+    ASSERT_TRUE(surf_->lookupKey(std::string("s"))); // dense leaf
+    ASSERT_TRUE(surf_->lookupKey(std::string("far"))); // sparse leaf at level 2
+    ASSERT_TRUE(surf_->lookupKey(std::string("f"))); // terminator at level 1
+    ASSERT_FALSE(surf_->lookupKey(std::string("toz"))); // no 'z' at level 2
+    ASSERT_FALSE(surf_->lookupKey(std::string("fa"))); // no terminator at level 2
+
+    QueryStats stats = getQueryStats();
+#ifdef SURF_STATS
+    ASSERT_EQ(6u, stats.get(kStatLookups));
+    ASSERT_EQ(11u, stats.get(kStatLevels));
+    ASSERT_EQ(1u, stats.get(kStatDenseMisses));
+    ASSERT_EQ(1u, stats.get(kStatDenseLeaves));
+    ASSERT_EQ(1u, stats.get(kStatSparseLeaves));
+    ASSERT_EQ(1u, stats.get(kStatTerminatorHits));
+    ASSERT_EQ(3u, stats.get(kStatSuffixChecks));
+    ASSERT_EQ(0u, stats.get(kStatSuffixMismatches));
+    ASSERT_EQ(4u, stats.get(kStatSearchLinear));
+    ASSERT_EQ(1u, stats.get(kStatSearchBinary));
+    ASSERT_EQ(0u, stats.get(kStatSearchSimd));
+    ASSERT_EQ(0u, stats.sparseMisses(1));
+    ASSERT_EQ(2u, stats.sparseMisses(2));
+    ASSERT_EQ(2u, stats.totalSparseMisses());
+#else
+    for (int i = 0; i < kNumQueryStats; i++)
+	ASSERT_EQ(0u, stats.counts[i]);
+#endif
+}
+
+#ifdef SURF_STATS
+TEST_F (StatsTest, SuffixMismatchTest) {
+    std::vector<std::string> keys;
+    keys.push_back(std::string("apple"));
+    keys.push_back(std::string("apricot"));
+    keys.push_back(std::string("banana"));
+    SuRF* surf = new SuRF(keys, kIncludeDense, kSparseOnlyRatio, kSuffixType, 0, kSuffixLen);
+    resetQueryStats();
+    ASSERT_TRUE(surf->lookupKey(std::string("apple")));
+    ASSERT_FALSE(surf->lookupKey(std::string("appxx")));
+    QueryStats stats = getQueryStats();
+    ASSERT_EQ(2u, stats.get(kStatSparseLeaves));
+    ASSERT_EQ(2u, stats.get(kStatSuffixChecks));
+    ASSERT_EQ(1u, stats.get(kStatSuffixMismatches));
+    delete surf;
+}
+
+TEST_F (StatsTest, LookupStepTest) {
+    std::vector<std::string> queries = keys_;
+    queries.push_back(std::string("x"));
+    queries.push_back(std::string("fa"));
+    queries.push_back(std::string("toz"));
+    queries.push_back(std::string("trips"));
+    for (unsigned i = 0; i < queries.size(); i++)
+	surf_->lookupKey(queries[i]);
+    QueryStats stats = getQueryStats();
+
+    resetQueryStats();
+    for (unsigned i = 0; i < queries.size(); i++) {
+	SuRF::LookupState state;
+	surf_->startLookup(queries[i], surf_->hashKey(queries[i]), state);
+	while (!surf_->lookupStep(state));
+    }
+    QueryStats step_stats = getQueryStats();
+    for (int i = 0; i < kNumQueryStats; i++)
+	ASSERT_EQ(stats.counts[i], step_stats.counts[i]);
+}
+
+TEST_F (StatsTest, ThreadsTest) {
+    static const int kNumThreads = 4;
+    static const int kNumLookups = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+	threads.push_back(std::thread([this] {
+	    for (int i = 0; i < kNumLookups; i++)
+		surf_->lookupKey(keys_[i % keys_.size()]);
+	}));
+    }
+    for (int t = 0; t < kNumThreads; t++)
+	threads[t].join();
+    surf_->lookupKey(keys_[0]);
+    // the counts of exited threads are kept
+    ASSERT_EQ((uint64_t)(kNumThreads * kNumLookups + 1), getQueryStats().get(kStatLookups));
+
+    resetQueryStats();
+    ASSERT_EQ(0u, getQueryStats().get(kStatLookups));
+    surf_->lookupKey(keys_[0]);
+    ASSERT_EQ(1u, getQueryStats().get(kStatLookups));
+}
+#endif
+
+} // namespace statstest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -253,6 +253,53 @@ TEST_F (SuffixUnitTest, serializeTest) {
     }
 }
 
+TEST_F (SuffixUnitTest, suffixHashTest) {
+    // CRC32C check value
+    ASSERT_EQ(0xE3069283, CRC32CHash("123456789", 9, 0));
+    // the fallback for CPUs without the crc32 instruction
+    ASSERT_EQ(0xE3069283, ~crc32cSoftware("123456789", 9, ~0U));
+    ASSERT_EQ(suffixHash(words[0]), suffixHash(kHashLevelDB, words[0]));
+
+    bool include_dense = false;
+    uint32_t sparse_dense_ratio = 0;
+    level_t suffix_len = 8;
+    SuffixHashType hash_type_array[3] = {kHashLevelDB, kHashCRC32C, kHashMultiply};
+    for (int i = 0; i < 3; i++) {
+	SuffixHashType hash_type = hash_type_array[i];
+	builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, kMixed,
+				   suffix_len, suffix_len, kLoudsBitvector, hash_type);
+	builder_->build(words);
+
+	level_t height = builder_->getLabels().size();
+	std::vector<position_t> num_suffix_bits_per_level;
+	for (level_t level = 0; level < height; level++)
+	    num_suffix_bits_per_level.push_back(builder_->getSuffixCounts()[level] * suffix_len * 2);
+	suffixes_ = new BitvectorSuffix(kMixed, suffix_len, suffix_len, builder_->getSuffixes(),
+					num_suffix_bits_per_level, 0, height, hash_type);
+	testSerialize();
+	ASSERT_EQ(hash_type, suffixes_->getHashType());
+
+	for (level_t level = 0; level < words_by_suffix_start_level_.size(); level++) {
+	    for (unsigned k = 0; k < words_by_suffix_start_level_[level].size(); k++) {
+		const std::string& word = words_by_suffix_start_level_[level][k];
+		uint32_t key_hash = suffixHash(hash_type, word);
+		ASSERT_EQ(key_hash, suffixes_->hashKey(word));
+		word_t expected_suffix = BitvectorSuffix::constructSuffix(kMixed, word, key_hash,
+									  suffix_len, level + 1,
+									  suffix_len);
+		ASSERT_EQ(expected_suffix,
+			  BitvectorSuffix::constructMixedSuffix(word, key_hash, suffix_len,
+								level + 1, suffix_len));
+	    }
+	}
+	delete builder_;
+	suffixes_->destroy();
+	delete suffixes_;
+	delete[] data_;
+	data_ = nullptr;
+    }
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
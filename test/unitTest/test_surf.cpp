@@ -2,8 +2,10 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <fstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "config.hpp"
@@ -611,6 +613,637 @@ TEST_F (SuRFUnitTest, approxCountIntTest) {
     delete surf_;
 }
 
+TEST_F (SuRFUnitTest, approxCountsTest) {
+    newSuRFWords(kReal, 8);
+    std::vector<std::string> boundaries;
+    boundaries.push_back(std::string("\1"));
+    for (int i = 0; i < kWordTestSize; i += 997) {
+	boundaries.push_back(words[i]);
+	// between two keys
+	std::string key = words[i];
+	key.push_back('\1');
+	boundaries.push_back(key);
+    }
+    boundaries.push_back(std::string("zzzzzzzz"));
+    boundaries.push_back(std::string("zzzzzzzzz"));
+    std::vector<uint64_t> counts;
+    surf_->approxCounts(boundaries, counts);
+    ASSERT_EQ(boundaries.size() - 1, counts.size());
+    uint64_t total = 0;
+    for (unsigned i = 0; i + 1 < boundaries.size(); i++) {
+	ASSERT_EQ(surf_->approxCount(boundaries[i], boundaries[i + 1]), counts[i]);
+	total += counts[i];
+    }
+    // at most 2 short per interval
+    ASSERT_TRUE(total + 2 * counts.size() >= (uint64_t)kWordTestSize);
+
+    // close boundaries: searches resume deep in the previous path
+    boundaries.clear();
+    for (int i = 0; i < kWordTestSize; i += 7) {
+	if (words[i].length() > 1) {
+	    boundaries.push_back(words[i].substr(0, words[i].length() - 1));
+	}
+	boundaries.push_back(words[i]);
+	boundaries.push_back(words[i] + '\1');
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    surf_->approxCounts(boundaries, counts);
+    for (unsigned i = 0; i + 1 < boundaries.size(); i++)
+	ASSERT_EQ(surf_->approxCount(boundaries[i], boundaries[i + 1]), counts[i]);
+
+    boundaries.resize(1);
+    surf_->approxCounts(boundaries, counts);
+    ASSERT_TRUE(counts.empty());
+    surf_->destroy();
+    delete surf_;
+
+    surf_ = new SuRF(ints_, kIncludeDense, 256, kReal, 0, 8);
+    boundaries.clear();
+    for (int i = 0; i < kIntTestBound + 10000; i += 9973)
+	boundaries.push_back(uint64ToString(i));
+    for (int i = 0; i < 20000; i += 3)
+	boundaries.push_back(uint64ToString(i));
+    std::sort(boundaries.begin(), boundaries.end());
+    surf_->approxCounts(boundaries, counts);
+    for (unsigned i = 0; i + 1 < boundaries.size(); i++)
+	ASSERT_EQ(surf_->approxCount(boundaries[i], boundaries[i + 1]), counts[i]);
+    surf_->destroy();
+    delete surf_;
+
+    // more dense levels
+    surf_ = new SuRF(ints_, kIncludeDense, 1, kReal, 0, 8);
+    surf_->approxCounts(boundaries, counts);
+    for (unsigned i = 0; i + 1 < boundaries.size(); i++)
+	ASSERT_EQ(surf_->approxCount(boundaries[i], boundaries[i + 1]), counts[i]);
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, selectKeyTest) {
+    newSuRFWords(kReal, 8);
+    ASSERT_EQ((uint64_t)kWordTestSize, surf_->numKeys());
+    for (int k = 0; k < kWordTestSize; k += 101) {
+	std::string key = surf_->selectKey(k);
+	// a prefix of the k-th key, and after all keys before it
+	ASSERT_EQ(0, words[k].compare(0, key.length(), key));
+	if (k > 0) {
+	    ASSERT_TRUE(words[k - 1] < key);
+	}
+    }
+    ASSERT_TRUE(surf_->selectKey(kWordTestSize).empty());
+
+    std::vector<std::string> split_keys;
+    const unsigned kNumParts = 7;
+    surf_->quantiles(kNumParts, split_keys);
+    ASSERT_EQ(kNumParts - 1, split_keys.size());
+    for (unsigned i = 0; i + 1 < kNumParts; i++) {
+	uint64_t rank = std::lower_bound(words.begin(), words.end(), split_keys[i]) - words.begin();
+	ASSERT_EQ((i + 1) * (uint64_t)kWordTestSize / kNumParts, rank);
+    }
+    surf_->quantiles(1, split_keys);
+    ASSERT_TRUE(split_keys.empty());
+    surf_->destroy();
+    delete surf_;
+
+    surf_ = new SuRF(ints_, kIncludeDense, 256, kReal, 0, 8);
+    ASSERT_EQ(ints_.size(), surf_->numKeys());
+    for (unsigned k = 0; k < ints_.size(); k += 997) {
+	std::string key = surf_->selectKey(k);
+	ASSERT_EQ(0, ints_[k].compare(0, key.length(), key));
+	if (k > 0) {
+	    ASSERT_TRUE(ints_[k - 1] < key);
+	}
+    }
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, leafIdTest) {
+    newSuRFWords(kReal, 8);
+    uint64_t id = 0;
+    for (int k = 0; k < kWordTestSize; k++) {
+	ASSERT_TRUE(surf_->leafId(words[k], id));
+	ASSERT_EQ((uint64_t)k, id);
+    }
+    for (int k = 0; k < kWordTestSize; k += 7) {
+	std::string key = words[k];
+	key.push_back('\1');
+	ASSERT_EQ(surf_->lookupKey(key), surf_->leafId(key, id));
+    }
+    surf_->destroy();
+    delete surf_;
+
+    surf_ = new SuRF(ints_, kIncludeDense, 256, kMixed, 4, 4);
+    uint64_t hash_id = 0;
+    for (unsigned k = 0; k < ints_.size(); k++) {
+	ASSERT_TRUE(surf_->leafId(ints_[k], id));
+	ASSERT_EQ((uint64_t)k, id);
+	ASSERT_TRUE(surf_->leafId(ints_[k], surf_->hashKey(ints_[k]), hash_id));
+	ASSERT_EQ(id, hash_id);
+    }
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, concurrentRangeQueryTest) {
+    newSuRFWords(kReal, 8);
+    static const int kNumThreads = 4;
+    static const int kNumQueries = 1000;
+    std::vector<bool> ranges;
+    std::vector<uint64_t> counts;
+    for (int i = 0; i < kNumQueries; i++) {
+	ranges.push_back(surf_->lookupRange(words[i], false, words[i + 10], false));
+	counts.push_back(surf_->approxCount(words[i], words[i + 10]));
+    }
+    // each thread queries the shared filter with its own iterators
+    std::vector<int> num_errors(kNumThreads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+	threads.push_back(std::thread([&, t] {
+	    SuRF::Iter iter(surf_), iter2(surf_);
+	    for (int i = 0; i < kNumQueries; i++) {
+		if (surf_->lookupRange(words[i], false, words[i + 10], false, iter) != ranges[i])
+		    num_errors[t]++;
+		if (surf_->approxCount(words[i], words[i + 10], iter, iter2) != counts[i])
+		    num_errors[t]++;
+	    }
+	}));
+    }
+    for (int t = 0; t < kNumThreads; t++) {
+	threads[t].join();
+	ASSERT_EQ(0, num_errors[t]);
+    }
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, estimateSerializedSizeTest) {
+    for (int t = 0; t < kNumSuffixType; t++) {
+	for (int k = 1; k < kNumSuffixLen; k += 4) {
+	    level_t hash_suffix_len = 0, real_suffix_len = 0;
+	    if (kSuffixTypeList[t] == kHash || kSuffixTypeList[t] == kMixed)
+		hash_suffix_len = kSuffixLenList[k];
+	    if (kSuffixTypeList[t] == kReal || kSuffixTypeList[t] == kMixed)
+		real_suffix_len = kSuffixLenList[k];
+	    SuRFBuilder builder(kIncludeDense, kSparseDenseRatio, kSuffixTypeList[t],
+				hash_suffix_len, real_suffix_len);
+	    builder.build(words);
+	    surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kSuffixTypeList[t],
+			     hash_suffix_len, real_suffix_len);
+	    uint64_t estimate = builder.estimateSerializedSize(builder.getSparseStartLevel(),
+							       builder.getSuffixLen());
+	    ASSERT_EQ(surf_->serializedSize(), estimate);
+	    surf_->destroy();
+	    delete surf_;
+	}
+    }
+}
+
+TEST_F (SuRFUnitTest, eliasFanoLoudsTest) {
+    SuRF* ref_surf = new SuRF(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+    surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8, kLoudsEliasFano);
+    testSerialize();
+    testLookupWord(kReal);
+
+    SuRFBuilder builder(kIncludeDense, kSparseDenseRatio, kReal, 0, 8, kLoudsEliasFano);
+    builder.build(words);
+    ASSERT_EQ(surf_->serializedSize(),
+	      builder.estimateSerializedSize(builder.getSparseStartLevel(), 8));
+
+    // both encodings must produce identical iterator walks
+    SuRF::Iter iter = surf_->moveToFirst();
+    SuRF::Iter ref_iter = ref_surf->moveToFirst();
+    for (unsigned i = 0; i < words.size(); i++) {
+	ASSERT_TRUE(iter.isValid());
+	ASSERT_EQ(ref_iter.getKey(), iter.getKey());
+	iter++;
+	ref_iter++;
+    }
+    ASSERT_FALSE(iter.isValid());
+
+    iter = surf_->moveToLast();
+    ref_iter = ref_surf->moveToLast();
+    for (unsigned i = 0; i < words.size(); i++) {
+	ASSERT_TRUE(iter.isValid());
+	ASSERT_EQ(ref_iter.getKey(), iter.getKey());
+	iter--;
+	ref_iter--;
+    }
+    ASSERT_FALSE(iter.isValid());
+
+    for (unsigned i = 0; i < words.size(); i += 97) {
+	std::string key = words[i];
+	key[key.length() - 1]++;
+	iter = surf_->moveToKeyGreaterThan(key, true);
+	ref_iter = ref_surf->moveToKeyGreaterThan(key, true);
+	ASSERT_EQ(ref_iter.isValid(), iter.isValid());
+	if (iter.isValid()) {
+	    ASSERT_EQ(ref_iter.getKey(), iter.getKey());
+	}
+	// steps from a seek position
+	SuRF::Iter next_iter = iter;
+	SuRF::Iter ref_next_iter = ref_iter;
+	for (int j = 0; j < 3 && next_iter.isValid(); j++) {
+	    next_iter++;
+	    ref_next_iter++;
+	    ASSERT_EQ(ref_next_iter.isValid(), next_iter.isValid());
+	    if (next_iter.isValid()) {
+		ASSERT_EQ(ref_next_iter.getKey(), next_iter.getKey());
+	    }
+	}
+	for (int j = 0; j < 3 && iter.isValid(); j++) {
+	    iter--;
+	    ref_iter--;
+	    ASSERT_EQ(ref_iter.isValid(), iter.isValid());
+	    if (iter.isValid()) {
+		ASSERT_EQ(ref_iter.getKey(), iter.getKey());
+	    }
+	}
+	ASSERT_EQ(ref_surf->approxCount(words[0], words[i]),
+		  surf_->approxCount(words[0], words[i]));
+    }
+
+    ref_surf->destroy();
+    delete ref_surf;
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, suffixHashTypeTest) {
+    const SuffixHashType hash_type_list[3] = {kHashLevelDB, kHashCRC32C, kHashMultiply};
+    // reference values for kSuffixHashSeed, computed independently of hash.hpp
+    const int kNumRefKeys = 4;
+    const char* ref_keys[kNumRefKeys] = {"a", "surf", "123456789", "succinct range filter"};
+    const uint32_t ref_hashes[3][kNumRefKeys] = {
+	{0x286e9db0, 0xe169da98, 0x73dddd2a, 0xbeafe823},
+	{0x36150283, 0xe7e3c59d, 0xbd471170, 0x2e02e52d},
+	{0xc5f4d991, 0xa5c90cb9, 0xd17eaaa4, 0x420fb291}};
+    for (int h = 0; h < 3; h++) {
+	surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kHash, 8, 0,
+			 kLoudsBitvector, hash_type_list[h]);
+	testSerialize();
+	testLookupWord(kHash);
+	for (int i = 0; i < kNumRefKeys; i++)
+	    ASSERT_EQ(ref_hashes[h][i], surf_->hashKey(std::string(ref_keys[i])));
+	for (unsigned i = 0; i < words.size(); i++) {
+	    uint32_t key_hash = surf_->hashKey(words[i]);
+	    ASSERT_TRUE(surf_->lookupKey(words[i], key_hash));
+	    std::string key = words[i];
+	    key[key.length() - 1] ^= 0x20;
+	    ASSERT_EQ(surf_->lookupKey(key), surf_->lookupKey(key, surf_->hashKey(key)));
+	}
+	surf_->destroy();
+	delete surf_;
+	delete[] data_;
+	data_ = nullptr;
+    }
+}
+
+TEST_F (SuRFUnitTest, bitsPerKeyBudgetTest) {
+    surf_ = new SuRF(words);
+    double base_bits_per_key = surf_->serializedSize() * 8.0 / words.size();
+    surf_->destroy();
+    delete surf_;
+
+    const int num_budgets = 4;
+    const double extra_bits[num_budgets] = {0.5, 4, 12, 40};
+    const QueryPriority priority_list[2] = {kPointQueries, kRangeQueries};
+    for (int p = 0; p < 2; p++) {
+	uint64_t prev_size = 0;
+	for (int b = 0; b < num_budgets; b++) {
+	    double bits_per_key = base_bits_per_key + extra_bits[b];
+	    surf_ = new SuRF(words, bits_per_key, priority_list[p]);
+	    uint64_t size = surf_->serializedSize();
+	    ASSERT_TRUE(size * 8 <= (uint64_t)(bits_per_key * words.size()));
+	    ASSERT_TRUE(size >= prev_size);
+	    prev_size = size;
+	    for (unsigned i = 0; i < words.size(); i++)
+		ASSERT_TRUE(surf_->lookupKey(words[i]));
+	    surf_->destroy();
+	    delete surf_;
+	}
+    }
+
+    // A budget below the bare trie size falls back to no suffixes
+    surf_ = new SuRF(words, 1.0, kPointQueries);
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_TRUE(surf_->lookupKey(words[i]));
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, openMappedTest) {
+    const LoudsEncoding encoding_list[2] = {kLoudsBitvector, kLoudsEliasFano};
+    const std::string path = "surf_open_test.tmp";
+    for (int e = 0; e < 2; e++) {
+	SuRF* ref_surf = new SuRF(words, kIncludeDense, kSparseDenseRatio, kMixed, 4, 4,
+				  encoding_list[e]);
+	uint64_t size = ref_surf->serializedSize();
+	char* data = ref_surf->serialize();
+	std::ofstream outfile(path, std::ios::binary);
+	outfile.write(data, size);
+	outfile.close();
+
+	SuRF::SectionEntry sections[kNumSerializedSections];
+	ASSERT_TRUE(SuRF::readHeader(data, sections));
+	ASSERT_EQ(kSerializedHeaderSize, sections[0].offset);
+	for (uint32_t i = 1; i < kNumSerializedSections; i++)
+	    ASSERT_EQ(sections[i - 1].offset + sections[i - 1].size, sections[i].offset);
+	ASSERT_EQ(size, sections[kNumSerializedSections - 1].offset
+		  + sections[kNumSerializedSections - 1].size);
+	ASSERT_TRUE(SuRF::sectionsInBounds(sections, size));
+	ASSERT_FALSE(SuRF::sectionsInBounds(sections, size - 1));
+
+	// an offset for which offset + size wraps around to within the file
+	const uint64_t kDirectoryEntry1 = sizeof(uint32_t) * 4 + sizeof(SuRF::SectionEntry);
+	SuRF::SectionEntry bad_entry = sections[1];
+	bad_entry.offset = ~0ULL - bad_entry.size + 2;
+	memcpy(data + kDirectoryEntry1, &bad_entry, sizeof(bad_entry));
+	std::ofstream badfile(path, std::ios::binary);
+	badfile.write(data, size);
+	badfile.close();
+	ASSERT_TRUE(SuRF::open(path) == nullptr);
+	std::ofstream outfile2(path, std::ios::binary);
+	memcpy(data + kDirectoryEntry1, &sections[1], sizeof(sections[1]));
+	outfile2.write(data, size);
+	outfile2.close();
+	delete[] data;
+
+	surf_ = SuRF::open(path);
+	ASSERT_TRUE(surf_ != nullptr);
+	testLookupWord(kMixed);
+	for (unsigned i = 0; i < words.size(); i += 13) {
+	    std::string key = words[i];
+	    key[key.length() - 1] ^= 0x20;
+	    ASSERT_EQ(ref_surf->lookupKey(key), surf_->lookupKey(key));
+	}
+	SuRF::Iter iter = surf_->moveToFirst();
+	SuRF::Iter ref_iter = ref_surf->moveToFirst();
+	for (unsigned i = 0; i < words.size(); i++) {
+	    ASSERT_TRUE(iter.isValid());
+	    ASSERT_EQ(ref_iter.getKey(), iter.getKey());
+	    iter++;
+	    ref_iter++;
+	}
+	ASSERT_FALSE(iter.isValid());
+
+	surf_->destroy();
+	delete surf_;
+	ref_surf->destroy();
+	delete ref_surf;
+    }
+    remove(path.c_str());
+    ASSERT_TRUE(SuRF::open(path) == nullptr);
+}
+
+TEST_F (SuRFUnitTest, deSerializeBadHeaderTest) {
+    surf_ = new SuRF(words);
+    char* data = surf_->serialize();
+    surf_->destroy();
+    delete surf_;
+
+    data[0] ^= 0x1; // magic
+    ASSERT_TRUE(SuRF::deSerialize(data) == nullptr);
+    data[0] ^= 0x1;
+    data[sizeof(uint32_t)] ^= 0x1; // version
+    ASSERT_TRUE(SuRF::deSerialize(data) == nullptr);
+    data[sizeof(uint32_t)] ^= 0x1;
+    surf_ = SuRF::deSerialize(data);
+    ASSERT_TRUE(surf_ != nullptr);
+    testLookupWord(kNone);
+    surf_->destroy();
+    delete surf_;
+    delete[] data;
+}
+
+TEST_F (SuRFUnitTest, compactSerializeTest) {
+    const LoudsEncoding encoding_list[2] = {kLoudsBitvector, kLoudsEliasFano};
+    const std::string path = "surf_compact_test.tmp";
+    for (int e = 0; e < 2; e++) {
+	SuRF* ref_surf = new SuRF(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8,
+				  encoding_list[e]);
+	uint64_t size = ref_surf->serializedSize(kSerializeCompact);
+	ASSERT_TRUE(size < ref_surf->serializedSize());
+	char* data = ref_surf->serialize(kSerializeCompact);
+	SuRF::SectionEntry sections[kNumSerializedSections];
+	SerializeFormat format;
+	ASSERT_TRUE(SuRF::readHeader(data, sections, &format));
+	ASSERT_EQ(kSerializeCompact, format);
+	ASSERT_EQ(size, sections[kNumSerializedSections - 1].offset
+		  + sections[kNumSerializedSections - 1].size);
+
+	surf_ = SuRF::deSerialize(data);
+	testLookupWord(kReal);
+	// the rebuilt LUTs produce the same walks
+	SuRF::Iter iter = surf_->moveToFirst();
+	SuRF::Iter ref_iter = ref_surf->moveToFirst();
+	for (unsigned i = 0; i < words.size(); i++) {
+	    ASSERT_TRUE(iter.isValid());
+	    ASSERT_EQ(ref_iter.getKey(), iter.getKey());
+	    iter++;
+	    ref_iter++;
+	}
+	ASSERT_FALSE(iter.isValid());
+	// reserializing in full gives the original bytes
+	char* full_data = surf_->serialize();
+	char* ref_full_data = ref_surf->serialize();
+	ASSERT_EQ(0, memcmp(ref_full_data, full_data, ref_surf->serializedSize()));
+	delete[] full_data;
+	delete[] ref_full_data;
+	surf_->destroy();
+	delete surf_;
+
+	int fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	ASSERT_TRUE(fd >= 0);
+	ASSERT_TRUE(ref_surf->serialize(fd, false, kSerializeCompact));
+	close(fd);
+	surf_ = SuRF::open(path);
+	ASSERT_TRUE(surf_ != nullptr);
+	testLookupWord(kReal);
+	surf_->destroy();
+	delete surf_;
+
+	delete[] data;
+	ref_surf->destroy();
+	delete ref_surf;
+    }
+    remove(path.c_str());
+}
+
+TEST_F (SuRFUnitTest, moveTest) {
+    std::vector<SuRF> filters;
+    for (int t = 0; t < kNumSuffixType; t++)
+	filters.push_back(SuRF(words, kSuffixTypeList[t], 4, 4));
+    SuRF filter = std::move(filters[1]);
+    filters[1] = SuRF(words);
+    filters[0] = std::move(filter);
+    filter.destroy(); // no-op on a moved-from filter
+
+    for (unsigned i = 0; i < words.size(); i += 7) {
+	for (int t = 0; t < kNumSuffixType; t++)
+	    ASSERT_TRUE(filters[t].lookupKey(words[i]));
+    }
+    SuRF::Iter iter = filters[0].moveToFirst();
+    for (unsigned i = 0; i < words.size(); i++) {
+	ASSERT_TRUE(iter.isValid());
+	iter++;
+    }
+    ASSERT_FALSE(iter.isValid());
+}
+
+TEST_F (SuRFUnitTest, streamSerializeTest) {
+    surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kMixed, 4, 4);
+    uint64_t size = surf_->serializedSize();
+    char* data = surf_->serialize();
+
+    // small chunks: many full chunks plus a partial one
+    std::string stream;
+    uint64_t num_chunks = 0;
+    StreamSink sink([&](const char* chunk, const uint64_t len) {
+	    stream.append(chunk, len);
+	    num_chunks++;
+	    return true;
+	}, false, StreamSink::kDirectIOAlignment);
+    ASSERT_TRUE(surf_->serialize(sink));
+    ASSERT_TRUE(sink.finish());
+    ASSERT_EQ(size, stream.size());
+    ASSERT_EQ((size + StreamSink::kDirectIOAlignment - 1) / StreamSink::kDirectIOAlignment,
+	      num_chunks);
+    ASSERT_EQ(0, memcmp(data, stream.data(), size));
+
+    // direct_io pads the last chunk
+    stream.clear();
+    ASSERT_TRUE(surf_->serialize([&](const char* chunk, const uint64_t len) {
+		stream.append(chunk, len);
+		return ((uint64_t)chunk % StreamSink::kDirectIOAlignment == 0)
+		    && (len % StreamSink::kDirectIOAlignment == 0);
+	    }, true));
+    ASSERT_EQ(0, (int)(stream.size() % StreamSink::kDirectIOAlignment));
+    ASSERT_EQ(0, memcmp(data, stream.data(), size));
+
+    // write errors are reported
+    ASSERT_FALSE(surf_->serialize([](const char*, const uint64_t) { return false; }));
+
+    const std::string path = "surf_stream_test.tmp";
+    for (int d = 0; d < 2; d++) {
+	int fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	ASSERT_TRUE(fd >= 0);
+	ASSERT_TRUE(surf_->serialize(fd, d == 1));
+	close(fd);
+	SuRF* surf_file = SuRF::open(path);
+	ASSERT_TRUE(surf_file != nullptr);
+	for (unsigned i = 0; i < words.size(); i++)
+	    ASSERT_TRUE(surf_file->lookupKey(words[i]));
+	surf_file->destroy();
+	delete surf_file;
+
+	std::ifstream infile(path, std::ios::binary);
+	std::string file_data((std::istreambuf_iterator<char>(infile)),
+			      std::istreambuf_iterator<char>());
+	ASSERT_EQ(size, file_data.size());
+	ASSERT_EQ(0, memcmp(data, file_data.data(), size));
+    }
+    remove(path.c_str());
+
+    delete[] data;
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, buildFileTest) {
+    const std::string key_path = "surf_keys_test.tmp";
+    const std::string out_path = "surf_build_file_test.tmp";
+    const KeyFileFormat format_list[2] = {kKeysNewline, kKeysLengthPrefixed};
+    const level_t hash_len_list[kNumSuffixType] = {0, 8, 0, 4};
+    const level_t real_len_list[kNumSuffixType] = {0, 0, 8, 4};
+    // the small limit makes the builder spill every kSpillCheckInterval keys
+    const uint64_t memory_limit_list[2] = {(1 << 16), (1 << 30)};
+    for (int f = 0; f < 2; f++) {
+	std::ofstream keyfile(key_path, std::ios::binary);
+	for (unsigned i = 0; i < words.size(); i++) {
+	    if (format_list[f] == kKeysNewline) {
+		keyfile << words[i] << '\n';
+	    } else {
+		uint32_t len = words[i].length();
+		keyfile.write(reinterpret_cast<const char*>(&len), sizeof(len));
+		keyfile.write(words[i].data(), len);
+	    }
+	}
+	keyfile.close();
+
+	for (int t = 0; t < kNumSuffixType; t++) {
+	    SuRF* ref_surf = new SuRF(words, kIncludeDense, kSparseDenseRatio, kSuffixTypeList[t],
+				      hash_len_list[t], real_len_list[t]);
+	    uint64_t size = ref_surf->serializedSize(kSerializeCompact);
+	    char* ref_data = ref_surf->serialize(kSerializeCompact);
+	    for (int m = 0; m < 2; m++) {
+		ASSERT_TRUE(SuRF::buildFile(key_path, format_list[f], out_path,
+					    memory_limit_list[m], ".",
+					    kIncludeDense, kSparseDenseRatio, kSuffixTypeList[t],
+					    hash_len_list[t], real_len_list[t]));
+		std::ifstream infile(out_path, std::ios::binary);
+		std::string file_data((std::istreambuf_iterator<char>(infile)),
+				      std::istreambuf_iterator<char>());
+		ASSERT_EQ(size, file_data.size());
+		ASSERT_EQ(0, memcmp(ref_data, file_data.data(), size));
+	    }
+	    delete[] ref_data;
+	    ref_surf->destroy();
+	    delete ref_surf;
+	}
+    }
+
+    surf_ = SuRF::open(out_path);
+    ASSERT_TRUE(surf_ != nullptr);
+    testLookupWord(kMixed);
+    surf_->destroy();
+    delete surf_;
+    remove(key_path.c_str());
+    remove(out_path.c_str());
+}
+
+TEST_F (SuRFUnitTest, keyFileIndexTest) {
+    const std::string key_path = "surf_keys_index_test.tmp";
+    const KeyFileFormat format_list[2] = {kKeysNewline, kKeysLengthPrefixed};
+    for (int f = 0; f < 2; f++) {
+	std::ofstream keyfile(key_path, std::ios::binary);
+	for (unsigned i = 0; i < words.size(); i++) {
+	    if (format_list[f] == kKeysNewline) {
+		keyfile << words[i] << '\n';
+	    } else {
+		uint32_t len = words[i].length();
+		keyfile.write(reinterpret_cast<const char*>(&len), sizeof(len));
+		keyfile.write(words[i].data(), len);
+	    }
+	}
+	if (format_list[f] == kKeysLengthPrefixed) {
+	    // a truncated record ends the file, as for next()
+	    uint32_t len = 100;
+	    keyfile.write(reinterpret_cast<const char*>(&len), sizeof(len));
+	    keyfile.write("abc", 3);
+	}
+	keyfile.close();
+
+	KeyFile keys;
+	ASSERT_TRUE(keys.open(key_path, format_list[f]));
+	ASSERT_EQ(words.size(), keys.index(words.size() + 10));
+	ASSERT_EQ(words.size(), keys.numKeys());
+	std::string key;
+	for (unsigned i = 0; i < words.size(); i++) {
+	    ASSERT_TRUE(keys.next(key));
+	    ASSERT_EQ(words[i], key);
+	    ASSERT_EQ(words[i], std::string(keys.keyData(i), keys.keyLen(i)));
+	}
+	ASSERT_FALSE(keys.next(key));
+
+	ASSERT_EQ(10u, keys.index(10));
+	ASSERT_EQ(words[9], std::string(keys.keyData(9), keys.keyLen(9)));
+	keys.close();
+	ASSERT_EQ(0u, keys.numKeys());
+    }
+    remove(key_path.c_str());
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "surf.hpp"
+#include "trace.hpp"
+
+namespace surf {
+
+namespace tracetest {
+
+static const SuffixType kSuffixType = kReal;
+static const level_t kSuffixLen = 8;
+// only level 0 is in louds-dense
+static const uint32_t kSparseOnlyRatio = 1000000;
+
+class TraceTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	keys_.push_back(std::string("f"));
+	keys_.push_back(std::string("far"));
+	keys_.push_back(std::string("fas"));
+	keys_.push_back(std::string("fast"));
+	keys_.push_back(std::string("fat"));
+	keys_.push_back(std::string("s"));
+	keys_.push_back(std::string("top"));
+	keys_.push_back(std::string("toy"));
+	keys_.push_back(std::string("trie"));
+	keys_.push_back(std::string("trip"));
+	keys_.push_back(std::string("try"));
+	surf_ = new SuRF(keys_, kIncludeDense, kSparseOnlyRatio, kSuffixType, 0, kSuffixLen);
+	setTraceSampleInterval(1);
+	resetPhaseTrace();
+    }
+    virtual void TearDown () {
+	setTraceSampleInterval(kDefaultTraceSampleInterval);
+	delete surf_;
+    }
+
+    std::vector<std::string> keys_;
+    SuRF* surf_;
+};
+
+TEST_F (TraceTest, LookupPhasesTest) {
+    for (unsigned i = 0; i < keys_.size(); i++)
+	ASSERT_TRUE(surf_->lookupKey(keys_[i]));
+    PhaseTrace trace = getPhaseTrace();
+#ifdef SURF_TRACE
+    ASSERT_EQ(keys_.size(), trace.numQueries());
+    ASSERT_TRUE(trace.cycles(kPhaseDense) > 0);
+    ASSERT_TRUE(trace.cycles(kPhaseHandoff) > 0);
+    ASSERT_TRUE(trace.cycles(kPhaseSparse) > 0);
+    ASSERT_TRUE(trace.cycles(kPhaseSuffix) > 0);
+    ASSERT_EQ(0u, trace.cycles(kPhaseIterKey));
+#else
+    for (int i = 0; i < kNumTraceCounters; i++)
+	ASSERT_EQ(0u, trace.counts[i]);
+#endif
+}
+
+#ifdef SURF_TRACE
+TEST_F (TraceTest, IterTest) {
+    // moveToKeyLessThan runs moveToKeyGreaterThan and lookupKey inside:
+    // one traced query
+    SuRF::Iter iter = surf_->moveToKeyLessThan(std::string("trio"), true);
+    ASSERT_TRUE(iter.isValid());
+    ASSERT_EQ(1u, getPhaseTrace().numQueries());
+    ASSERT_EQ(0u, getPhaseTrace().cycles(kPhaseIterKey));
+
+    std::string key = iter.getKey();
+    ASSERT_EQ(std::string("trie"), key);
+    ASSERT_EQ(2u, getPhaseTrace().numQueries());
+    ASSERT_TRUE(getPhaseTrace().cycles(kPhaseIterKey) > 0);
+}
+
+TEST_F (TraceTest, SampleIntervalTest) {
+    static const int kNumLookups = 1000;
+    setTraceSampleInterval(0);
+    for (int i = 0; i < kNumLookups; i++)
+	surf_->lookupKey(keys_[i % keys_.size()]);
+    ASSERT_EQ(0u, getPhaseTrace().numQueries());
+
+    setTraceSampleInterval(4);
+    for (int i = 0; i < kNumLookups; i++)
+	surf_->lookupKey(keys_[i % keys_.size()]);
+    ASSERT_EQ((uint64_t)(kNumLookups / 4), getPhaseTrace().numQueries());
+
+    resetPhaseTrace();
+    PhaseTrace trace = getPhaseTrace();
+    for (int i = 0; i < kNumTraceCounters; i++)
+	ASSERT_EQ(0u, trace.counts[i]);
+}
+
+TEST_F (TraceTest, ThreadsTest) {
+    static const int kNumThreads = 4;
+    static const int kNumLookups = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+	threads.push_back(std::thread([this] {
+	    for (int i = 0; i < kNumLookups; i++)
+		surf_->lookupKey(keys_[i % keys_.size()]);
+	}));
+    }
+    for (int t = 0; t < kNumThreads; t++)
+	threads[t].join();
+    ASSERT_EQ((uint64_t)(kNumThreads * kNumLookups), getPhaseTrace().numQueries());
+}
+#endif
+
+} // namespace tracetest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}